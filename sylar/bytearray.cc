@@ -4,46 +4,342 @@
 #include <fstream>
 
 #include <iostream>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "bytearray.h"
+#include "hash.h"
 #include "log.h"
+#include "config.h"
 
 namespace sylar
 {
     static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+    static ConfigVar<uint64_t>::ptr g_bytearray_node_pool_max_bytes =
+        Config::Add<uint64_t>("bytearray.node_pool.max_bytes", 4 * 1024 * 1024, "max cached bytearray node bytes per thread, 0 disables the pool");
+
+    static uint64_t s_node_pool_max_bytes = 0;
+
+    struct _NodePoolIniter
+    {
+        _NodePoolIniter() {
+            s_node_pool_max_bytes = g_bytearray_node_pool_max_bytes->getValue();
+            g_bytearray_node_pool_max_bytes->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+                SYLAR_LOG_INFO(g_logger) << "bytearray node pool max_bytes changed from " << old_value << " to " << new_value;
+                s_node_pool_max_bytes = new_value;
+            });
+        }
+    };
+    static _NodePoolIniter s_node_pool_initer;
+
+    // 内存块大小类: 64, 128, ... 1M，更大的内存块不缓存
+    static const size_t s_node_min_class_size = 64;
+    static const int s_node_class_count = 15;
+
+    static int GetNodeClass(size_t size) {
+        size_t class_size = s_node_min_class_size;
+        for (int i = 0; i < s_node_class_count; ++i) {
+            if (size <= class_size) {
+                return i;
+            }
+            class_size <<= 1;
+        }
+        return -1;
+    }
+
+    // 每个线程的内存块缓存池，空闲的内存块按大小类用next串成链表
+    class NodePool
+    {
+    public:
+        ~NodePool();
+        ByteArray::Node* pop(int cls);
+        bool push(int cls, ByteArray::Node* node);
+
+        ByteArray::NodePoolStats stats;
+    private:
+        ByteArray::Node* m_free[s_node_class_count] = {};
+        uint64_t m_bytes = 0;
+    };
+
+    static thread_local bool t_node_pool_destroyed = false;
+
+    static NodePool* GetThisNodePool() {
+        if (t_node_pool_destroyed) {
+            return nullptr;
+        }
+        static thread_local NodePool t_node_pool;
+        return &t_node_pool;
+    }
+
+    NodePool::~NodePool() {
+        for (int i = 0; i < s_node_class_count; ++i) {
+            while (m_free[i]) {
+                ByteArray::Node* node = m_free[i];
+                m_free[i] = node->next;
+                delete node;
+            }
+        }
+        t_node_pool_destroyed = true;
+    }
+
+    ByteArray::Node* NodePool::pop(int cls) {
+        ByteArray::Node* node = m_free[cls];
+        if (!node) {
+            ++stats.misses;
+            return nullptr;
+        }
+        m_free[cls] = node->next;
+        node->next = nullptr;
+        m_bytes -= s_node_min_class_size << cls;
+        ++stats.hits;
+        --stats.cached;
+        return node;
+    }
+
+    bool NodePool::push(int cls, ByteArray::Node* node) {
+        size_t size = s_node_min_class_size << cls;
+        if (m_bytes + size > s_node_pool_max_bytes) {
+            return false;
+        }
+        node->next = m_free[cls];
+        m_free[cls] = node;
+        m_bytes += size;
+        ++stats.cached;
+        return true;
+    }
+
+    // 分配count个大小为size的内存块并串成链表，last返回最后一个
+    // 可缓存的内存块按大小类分配，size仍是ByteArray使用的大小
+    static ByteArray::Node* AllocNodes(size_t size, size_t count, ByteArray::Node*& last) {
+        int cls = GetNodeClass(size);
+        NodePool* pool = cls >= 0 ? GetThisNodePool() : nullptr;
+        ByteArray::Node* head = nullptr;
+        last = nullptr;
+        for (size_t i = 0; i < count; ++i) {
+            ByteArray::Node* node = pool ? pool->pop(cls) : nullptr;
+            if (!node) {
+                node = new ByteArray::Node(cls >= 0 ? s_node_min_class_size << cls : size);
+            }
+            node->size = size;
+            if (last) {
+                last->next = node;
+            } else {
+                head = node;
+            }
+            last = node;
+        }
+        return head;
+    }
+
+    // 释放node开始的整个链表，放回当前线程的缓存池
+    static void ReleaseNodes(ByteArray::Node* node) {
+        NodePool* pool = node ? GetThisNodePool() : nullptr;
+        while (node) {
+            ByteArray::Node* next = node->next;
+            int cls = GetNodeClass(node->size);
+            // 映射的文件和被切片引用的内存不能放回池中复用
+            if (cls < 0 || !pool || node->mapped || node->buffer.use_count() > 1 || !pool->push(cls, node)) {
+                delete node;
+            }
+            node = next;
+        }
+    }
+
+    // 内存块被切片引用时换成一块新的内存并复制数据，之后的写入不影响切片
+    static inline void DetachNode(ByteArray::Node* node) {
+        if (!node->readonly && node->buffer.use_count() <= 1) {
+            return;
+        }
+        // 按大小类分配，放回池中后仍可用于同一大小类的任何大小
+        int cls = GetNodeClass(node->size);
+        size_t size = cls >= 0 ? s_node_min_class_size << cls : node->size;
+        char* ptr = new char[size];
+        memcpy(ptr, node->ptr, node->size);
+        node->buffer.reset(ptr, std::default_delete<char[]>());
+        node->ptr = ptr;
+        node->mapped = false;
+        node->readonly = false;
+    }
+
+    ByteArray::NodePoolStats ByteArray::GetNodePoolStats() {
+        NodePool* pool = GetThisNodePool();
+        return pool ? pool->stats : NodePoolStats();
+    }
+
     ByteArray::Node::Node()
         : ptr(nullptr)
         , next(nullptr)
-        , size(0) {}
+        , size(0)
+        , mapped(false)
+        , readonly(false) {}
 
     ByteArray::Node::Node(size_t s)
         : ptr(new char[s])
         , next(nullptr)
-        , size(s) {}
+        , size(s)
+        , buffer(ptr, std::default_delete<char[]>())
+        , mapped(false)
+        , readonly(false) {}
+
+    ByteArray::Node::~Node() {}
 
-    ByteArray::Node::~Node() {
-        if (ptr) {
-            delete[] ptr;
-            ptr = nullptr;
+    struct ByteArray::FileMapping
+    {
+        ~FileMapping() {
+            if (addr != MAP_FAILED) {
+                munmap(addr, length);
+            }
+            // 切片也释放后才截断，否则访问被截掉的页会SIGBUS
+            if (writable && ftruncate(fd, size)) {
+                SYLAR_LOG_ERROR(g_logger) << "ByteArray ftruncate fd=" << fd
+                    << " size=" << size << " errno=" << errno << " errstr=" << strerror(errno);
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
         }
-    }
+
+        int fd = -1;
+        void* addr = MAP_FAILED;
+        size_t length = 0;
+        size_t size = 0;            // 释放时文件截断到的大小
+        bool writable = false;
+    };
 
     ByteArray::ByteArray(size_t baseSize)
         : m_baseSize(baseSize)
         , m_position(0)
         , m_capacity(baseSize)
         , m_size(0)
-        , m_root(new Node(baseSize))
-        , m_cur(m_root) {}
+        , m_root(nullptr)
+        , m_cur(nullptr) {
+        Node* last = nullptr;
+        m_root = AllocNodes(baseSize, 1, last);
+        m_cur = m_root;
+    }
 
     ByteArray::~ByteArray() {
-        Node* tmp = m_root;
-        while (tmp) {
-            m_cur = tmp;
-            tmp = tmp->next;
-            delete m_cur;
+        if (m_mapping && m_mapping->writable) {
+            sync();
+            // 去掉为整数个内存块多扩展的部分，在最后一个引用映射的切片释放时截断
+            m_mapping->size = m_size;
+        }
+        ReleaseNodes(m_root);
+    }
+
+    ByteArray::ptr ByteArray::MapFile(const std::string& name, bool writable, size_t baseSize, size_t reserve) {
+        int fd = ::open(name.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+        if (fd < 0) {
+            SYLAR_LOG_ERROR(g_logger) << "MapFile open name=" << name
+                << " errno=" << errno << " errstr=" << strerror(errno);
+            return nullptr;
+        }
+        std::shared_ptr<FileMapping> mapping(new FileMapping);
+        mapping->fd = fd;
+        struct stat st;
+        if (fstat(fd, &st)) {
+            SYLAR_LOG_ERROR(g_logger) << "MapFile fstat name=" << name
+                << " errno=" << errno << " errstr=" << strerror(errno);
+            return nullptr;
+        }
+        size_t size = st.st_size;
+        // 之后失败时恢复原来的大小
+        mapping->size = size;
+        mapping->writable = writable;
+        size_t length = size;
+        if (writable) {
+            // 可写时映射整数个内存块，写满一个内存块也不会越过文件末尾
+            length = std::max(std::max(size, reserve), (size_t)1);
+            length = (length + baseSize - 1) / baseSize * baseSize;
+            if (ftruncate(fd, length)) {
+                SYLAR_LOG_ERROR(g_logger) << "MapFile ftruncate name=" << name << " length=" << length
+                    << " errno=" << errno << " errstr=" << strerror(errno);
+                return nullptr;
+            }
+        }
+        ByteArray::ptr ba(new ByteArray(baseSize));
+        if (length == 0) {
+            return ba;
         }
+        void* addr = mmap(nullptr, length, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+            writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            SYLAR_LOG_ERROR(g_logger) << "MapFile mmap name=" << name << " length=" << length
+                << " errno=" << errno << " errstr=" << strerror(errno);
+            return nullptr;
+        }
+        mapping->addr = addr;
+        mapping->length = length;
+
+        // 每个内存块引用映射，最后一个引用释放时才munmap
+        Node* head = nullptr;
+        Node* last = nullptr;
+        size_t count = length / baseSize;
+        for (size_t i = 0; i < count; ++i) {
+            Node* node = new Node();
+            node->ptr = (char*)addr + i * baseSize;
+            node->size = baseSize;
+            node->buffer.reset(node->ptr, [mapping](char*) {});
+            node->mapped = true;
+            node->readonly = !writable;
+            if (last) {
+                last->next = node;
+            } else {
+                head = node;
+            }
+            last = node;
+        }
+        // 只读时文件末尾不足一个内存块的部分复制出来，越过文件末尾的页不能访问
+        size_t tail = length % baseSize;
+        if (tail) {
+            Node* node = nullptr;
+            AllocNodes(baseSize, 1, node);
+            memcpy(node->ptr, (char*)addr + count * baseSize, tail);
+            if (last) {
+                last->next = node;
+            } else {
+                head = node;
+            }
+            ++count;
+        }
+        ReleaseNodes(ba->m_root);
+        ba->m_root = head;
+        ba->m_cur = head;
+        ba->m_capacity = count * baseSize;
+        ba->m_size = size;
+        ba->m_mapping = mapping;
+        return ba;
+    }
+
+    bool ByteArray::sync() {
+        if (!m_mapping || !m_mapping->writable) {
+            return false;
+        }
+        bool rt = true;
+        size_t offset = 0;
+        for (Node* cur = m_root; cur && offset < m_size; cur = cur->next) {
+            size_t len = std::min(cur->size, m_size - offset);
+            if (!cur->mapped) {
+                if (pwrite(m_mapping->fd, cur->ptr, len, offset) != (ssize_t)len) {
+                    SYLAR_LOG_ERROR(g_logger) << "ByteArray sync pwrite fd=" << m_mapping->fd
+                        << " offset=" << offset << " errno=" << errno << " errstr=" << strerror(errno);
+                    rt = false;
+                }
+            }
+            offset += cur->size;
+        }
+        if (msync(m_mapping->addr, m_mapping->length, MS_SYNC)) {
+            SYLAR_LOG_ERROR(g_logger) << "ByteArray sync msync errno=" << errno << " errstr=" << strerror(errno);
+            rt = false;
+        }
+        return rt;
     }
 
     void ByteArray::writeFint8(int8_t value) {
@@ -125,6 +421,50 @@ namespace sylar
         write(tmp, i);
     }
 
+    static inline size_t EncodeVarint(uint64_t value, uint8_t* out) {
+        size_t i = 0;
+        while (value >= 0x80) {
+            out[i++] = (value & 0x7f) | 0x80;
+            value >>= 7;
+        }
+        out[i++] = value;
+        return i;
+    }
+
+    // 每批最多编码这么多个值再调用一次write
+    static const size_t s_varint_batch = 128;
+
+    // conv把数组元素转成要编码的无符号值
+    template<typename T, typename Conv>
+    static void WriteVarintArray(ByteArray& ba, const T* values, size_t count, Conv conv) {
+        uint8_t buf[s_varint_batch * 10];
+        for (size_t i = 0; i < count;) {
+            size_t n = std::min(count - i, s_varint_batch);
+            size_t len = 0;
+            for (size_t j = 0; j < n; ++j) {
+                len += EncodeVarint(conv(values[i + j]), buf + len);
+            }
+            ba.write(buf, len);
+            i += n;
+        }
+    }
+
+    void ByteArray::writeInt32Array(const int32_t* values, size_t count) {
+        WriteVarintArray(*this, values, count, [](int32_t v) { return (uint64_t)EncodeZigzag32(v); });
+    }
+
+    void ByteArray::writeUint32Array(const uint32_t* values, size_t count) {
+        WriteVarintArray(*this, values, count, [](uint32_t v) { return (uint64_t)v; });
+    }
+
+    void ByteArray::writeInt64Array(const int64_t* values, size_t count) {
+        WriteVarintArray(*this, values, count, [](int64_t v) { return EncodeZigzag64(v); });
+    }
+
+    void ByteArray::writeUint64Array(const uint64_t* values, size_t count) {
+        WriteVarintArray(*this, values, count, [](uint64_t v) { return v; });
+    }
+
     void ByteArray::writeFloat(float value) {
         uint32_t v;
         memcpy(&v, &value, sizeof(value));
@@ -241,6 +581,122 @@ namespace sylar
         return result;
     }
 
+    // 批量解码: 每次看16个字节的最高位，一次解出其中所有完整的varint
+    // 用到的8字节读取要求小端序，其他平台只走逐字节的路径
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    static inline uint32_t GatherHighBits(uint64_t w) {
+        return (((w & 0x8080808080808080ull) >> 7) * 0x0102040810204080ull) >> 56;
+    }
+
+    // 16个字节中最高位为1(后面还有字节)的掩码，第j位对应第j个字节
+    static inline uint32_t ContinuationMask16(const uint8_t* p) {
+#ifdef __SSE2__
+        return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p));
+#else
+        uint64_t lo;
+        uint64_t hi;
+        memcpy(&lo, p, sizeof(lo));
+        memcpy(&hi, p + 8, sizeof(hi));
+        return GatherHighBits(lo) | (GatherHighBits(hi) << 8);
+#endif
+    }
+
+    // 解码p开始的len个字节，不逐字节判断最高位
+    static inline uint64_t DecodeVarint(const uint8_t* p, size_t len) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        if (len < 8) {
+            w &= (1ull << (len * 8)) - 1;
+        }
+        // 去掉每个字节的最高位，再把7位一组的数据逐级拼接起来
+        w &= 0x7f7f7f7f7f7f7f7full;
+        w = (w & 0x007f007f007f007full) | ((w & 0x7f007f007f007f00ull) >> 1);
+        w = (w & 0x00003fff00003fffull) | ((w & 0x3fff00003fff0000ull) >> 2);
+        w = (w & 0x000000000fffffffull) | ((w & 0x0fffffff00000000ull) >> 4);
+        if (len > 8) {
+            w |= (uint64_t)(p[8] & 0x7f) << 56;
+            if (len > 9) {
+                w |= (uint64_t)p[9] << 63;
+            }
+        }
+        return w;
+    }
+#endif
+
+    template<typename T>
+    void ByteArray::readVarintArray(T* values, size_t count) {
+        // 与readUint32/readUint64一致，最多读取这么多字节
+        const size_t max_len = sizeof(T) == sizeof(uint32_t) ? 5 : 10;
+        size_t i = 0;
+        while (i < count) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            size_t npos = m_position % m_baseSize;
+            size_t avail = m_cur ? std::min(m_cur->size - npos, getReadSize()) : 0;
+            const uint8_t* p = avail ? (const uint8_t*)m_cur->ptr + npos : nullptr;
+            size_t used = 0;
+            // 留出32字节，解码16字节窗口中的数据时8字节的读取不会越界
+            while (i < count && avail - used >= 32) {
+                const uint8_t* q = p + used;
+                uint32_t mask = ContinuationMask16(q);
+                if (mask == 0) {
+                    // 16个单字节的值
+                    size_t n = std::min((size_t)16, count - i);
+                    for (size_t j = 0; j < n; ++j) {
+                        values[i + j] = q[j];
+                    }
+                    i += n;
+                    used += n;
+                    continue;
+                }
+                uint32_t ends = ~mask & 0xffff;     // 每个varint的最后一个字节
+                size_t pos = 0;
+                while (ends && i < count) {
+                    size_t len = __builtin_ctz(ends) + 1 - pos;
+                    len = std::min(len, max_len);
+                    values[i++] = (T)DecodeVarint(q + pos, len);
+                    pos += len;
+                    ends &= ~((1u << pos) - 1);
+                }
+                if (pos == 0) {
+                    // 16个字节都没有结束，按最大长度截断
+                    values[i++] = (T)DecodeVarint(q, max_len);
+                    pos = max_len;
+                }
+                used += pos;
+            }
+            if (used) {
+                commit(used);
+            }
+#endif
+            // 内存块末尾不足一个窗口时，逐个读取跨越内存块的值
+            if (i < count) {
+                values[i++] = sizeof(T) == sizeof(uint32_t) ? readUint32() : readUint64();
+            }
+        }
+    }
+
+    void ByteArray::readInt32Array(int32_t* values, size_t count) {
+        readVarintArray((uint32_t*)values, count);
+        for (size_t i = 0; i < count; ++i) {
+            values[i] = DecodeZigzag32((uint32_t)values[i]);
+        }
+    }
+
+    void ByteArray::readUint32Array(uint32_t* values, size_t count) {
+        readVarintArray(values, count);
+    }
+
+    void ByteArray::readInt64Array(int64_t* values, size_t count) {
+        readVarintArray((uint64_t*)values, count);
+        for (size_t i = 0; i < count; ++i) {
+            values[i] = DecodeZigzag64((uint64_t)values[i]);
+        }
+    }
+
+    void ByteArray::readUint64Array(uint64_t* values, size_t count) {
+        readVarintArray(values, count);
+    }
+
     float ByteArray::readFloat() {
         uint32_t v = readFuint32();
         float result;
@@ -290,12 +746,9 @@ namespace sylar
     void ByteArray::clear() {
         m_position = 0;
         m_size = 0;
-        Node* tmp = m_root->next;
-        while (tmp) {
-            m_cur = tmp;
-            tmp = tmp->next;
-            delete m_cur;
-        }
+        m_capacity = m_root->size;
+        DetachNode(m_root);
+        ReleaseNodes(m_root->next);
         m_cur = m_root;
         m_root->next = nullptr;
     }
@@ -309,6 +762,7 @@ namespace sylar
         size_t ncap = m_cur->size - npos;          // 当前内存块的容量
         size_t bpos = 0;                           // 已写入数据长度
         while (size > 0) {
+            DetachNode(m_cur);
             if (ncap >= size) {
                 memcpy(m_cur->ptr + npos, (const char*)buf + bpos, size);
                 if (m_cur->size == npos + size) {
@@ -419,6 +873,13 @@ namespace sylar
                 << " error, errno=" << errno << ", errstr=" << strerror(errno);
             return false;
         }
+        // 按文件大小一次分配内存块，避免容量刚好用完时每次扩容都从头遍历链表
+        ifs.seekg(0, std::ios::end);
+        std::streamoff len = ifs.tellg();
+        ifs.seekg(0, std::ios::beg);
+        if (len > 0) {
+            addCapacity(len);
+        }
         std::shared_ptr<char[]> buff(new char[m_baseSize]);
         while (!ifs.eof()) {
             ifs.read(buff.get(), m_baseSize);
@@ -449,6 +910,272 @@ namespace sylar
         return ss.str();
     }
 
+    uint64_t ByteArray::getWriteBuffer(std::vector<iovec>& buffers, uint64_t len) {
+        if (len == 0) {
+            return 0;
+        }
+        addCapacity(len);
+        uint64_t size = len;
+        size_t npos = m_position % m_baseSize;
+        size_t ncap = m_cur->size - npos;
+        Node* cur = m_cur;
+        struct iovec iov;
+        while (len > 0) {
+            DetachNode(cur);
+            iov.iov_base = cur->ptr + npos;
+            if (ncap >= len) {
+                iov.iov_len = len;
+                len = 0;
+            } else {
+                iov.iov_len = ncap;
+                len -= ncap;
+                cur = cur->next;
+                ncap = cur->size;
+                npos = 0;
+            }
+            buffers.push_back(iov);
+        }
+        return size;
+    }
+
+    uint64_t ByteArray::getReadBuffer(std::vector<iovec>& buffers, uint64_t len) const {
+        len = len > getReadSize() ? getReadSize() : len;
+        if (len == 0) {
+            return 0;
+        }
+        uint64_t size = len;
+        size_t npos = m_position % m_baseSize;
+        size_t ncap = m_cur->size - npos;
+        Node* cur = m_cur;
+        struct iovec iov;
+        while (len > 0) {
+            iov.iov_base = cur->ptr + npos;
+            if (ncap >= len) {
+                iov.iov_len = len;
+                len = 0;
+            } else {
+                iov.iov_len = ncap;
+                len -= ncap;
+                cur = cur->next;
+                ncap = cur->size;
+                npos = 0;
+            }
+            buffers.push_back(iov);
+        }
+        return size;
+    }
+
+    uint64_t ByteArray::getReadBuffer(std::vector<iovec>& buffers, uint64_t len, uint64_t position) const {
+        if (position >= m_size) {
+            return 0;
+        }
+        len = len > m_size - position ? m_size - position : len;
+        if (len == 0) {
+            return 0;
+        }
+        uint64_t size = len;
+        // 内存块都是m_baseSize大小
+        Node* cur = m_root;
+        for (size_t count = position / m_baseSize; count > 0; --count) {
+            cur = cur->next;
+        }
+        size_t npos = position % m_baseSize;
+        size_t ncap = cur->size - npos;
+        struct iovec iov;
+        while (len > 0) {
+            iov.iov_base = cur->ptr + npos;
+            if (ncap >= len) {
+                iov.iov_len = len;
+                len = 0;
+            } else {
+                iov.iov_len = ncap;
+                len -= ncap;
+                cur = cur->next;
+                ncap = cur->size;
+                npos = 0;
+            }
+            buffers.push_back(iov);
+        }
+        return size;
+    }
+
+    // 对[position, position + len)所在的每段连续内存调用cb，len已经截断到数据末尾
+    template<typename F>
+    static void ForEachBlock(ByteArray::Node* root, size_t base_size, size_t position, size_t len, F cb) {
+        if (len == 0) {
+            return;
+        }
+        ByteArray::Node* cur = root;
+        for (size_t count = position / base_size; count > 0; --count) {
+            cur = cur->next;
+        }
+        size_t npos = position % base_size;
+        while (len > 0) {
+            size_t n = std::min(len, cur->size - npos);
+            cb(cur->ptr + npos, n);
+            len -= n;
+            cur = cur->next;
+            npos = 0;
+        }
+    }
+
+    uint32_t ByteArray::crc32c(size_t position, size_t len) const {
+        if (position >= m_size) {
+            return 0;
+        }
+        len = std::min(len, m_size - position);
+        uint32_t crc = 0;
+        ForEachBlock(m_root, m_baseSize, position, len, [&crc](const char* data, size_t n) {
+            crc = Crc32cExtend(crc, data, n);
+        });
+        return crc;
+    }
+
+    uint64_t ByteArray::xxhash64(size_t position, size_t len, uint64_t seed) const {
+        XXHash64 hash(seed);
+        if (position < m_size) {
+            len = std::min(len, m_size - position);
+            ForEachBlock(m_root, m_baseSize, position, len, [&hash](const char* data, size_t n) {
+                hash.update(data, n);
+            });
+        }
+        return hash.digest();
+    }
+
+    uint32_t ByteArray::appendCrc32c(size_t position) {
+        if (position > m_position) {
+            throw std::out_of_range("checksum position out of range");
+        }
+        uint32_t crc = crc32c(position, m_position - position);
+        writeFuint32(crc);
+        return crc;
+    }
+
+    uint64_t ByteArray::appendXXHash64(size_t position, uint64_t seed) {
+        if (position > m_position) {
+            throw std::out_of_range("checksum position out of range");
+        }
+        uint64_t hash = xxhash64(position, m_position - position, seed);
+        writeFuint64(hash);
+        return hash;
+    }
+
+    void ByteArray::commit(size_t len) {
+        if (len > m_capacity - m_position) {
+            throw std::out_of_range("commit out of range");
+        }
+        // 从当前内存块往后走，不像setPosition那样从头查找
+        size_t npos = m_position % m_baseSize + len;
+        while (m_cur && npos >= m_cur->size) {
+            npos -= m_cur->size;
+            m_cur = m_cur->next;
+        }
+        m_position += len;
+        if (m_position > m_size) {
+            m_size = m_position;
+        }
+    }
+
+    ByteSlice ByteArray::slice(size_t len) const {
+        return slice(m_position, std::min(len, getReadSize()));
+    }
+
+    ByteSlice ByteArray::slice(size_t position, size_t len) const {
+        ByteSlice result;
+        if (position >= m_size) {
+            return result;
+        }
+        len = std::min(len, m_size - position);
+        Node* cur = m_root;
+        for (size_t count = position / m_baseSize; count > 0; --count) {
+            cur = cur->next;
+        }
+        size_t npos = position % m_baseSize;
+        while (len > 0) {
+            size_t n = std::min(len, cur->size - npos);
+            result.appendSegment(cur->buffer, cur->ptr + npos, n);
+            len -= n;
+            cur = cur->next;
+            npos = 0;
+        }
+        return result;
+    }
+
+    void ByteSlice::appendSegment(const std::shared_ptr<char>& buffer, const char* data, size_t len) {
+        if (len == 0) {
+            return;
+        }
+        // 与上一段在同一块内存中相邻时合并
+        if (!m_segments.empty()) {
+            Segment& last = m_segments.back();
+            if (last.buffer == buffer && last.data + last.len == data) {
+                last.len += len;
+                m_size += len;
+                return;
+            }
+        }
+        Segment seg;
+        seg.buffer = buffer;
+        seg.data = data;
+        seg.len = len;
+        m_segments.push_back(seg);
+        m_size += len;
+    }
+
+    void ByteSlice::append(const ByteSlice& other) {
+        // other可能就是自己
+        std::vector<Segment> segments = other.m_segments;
+        for (auto& seg : segments) {
+            appendSegment(seg.buffer, seg.data, seg.len);
+        }
+    }
+
+    void ByteSlice::append(const void* data, size_t len) {
+        if (len == 0) {
+            return;
+        }
+        std::shared_ptr<char> buffer(new char[len], std::default_delete<char[]>());
+        memcpy(buffer.get(), data, len);
+        appendSegment(buffer, buffer.get(), len);
+    }
+
+    ByteSlice ByteSlice::slice(size_t offset, size_t len) const {
+        ByteSlice result;
+        for (auto& seg : m_segments) {
+            if (len == 0) {
+                break;
+            }
+            if (offset >= seg.len) {
+                offset -= seg.len;
+                continue;
+            }
+            size_t n = std::min(len, seg.len - offset);
+            result.appendSegment(seg.buffer, seg.data + offset, n);
+            len -= n;
+            offset = 0;
+        }
+        return result;
+    }
+
+    uint64_t ByteSlice::getIovec(std::vector<iovec>& buffers) const {
+        for (auto& seg : m_segments) {
+            struct iovec iov;
+            iov.iov_base = (void*)seg.data;
+            iov.iov_len = seg.len;
+            buffers.push_back(iov);
+        }
+        return m_size;
+    }
+
+    std::string ByteSlice::toString() const {
+        std::string str;
+        str.reserve(m_size);
+        for (auto& seg : m_segments) {
+            str.append(seg.data, seg.len);
+        }
+        return str;
+    }
+
     void ByteArray::setPosition(size_t v) {
         if (v > m_capacity) {
             throw std::out_of_range("setPosition out of range");
@@ -473,19 +1200,16 @@ namespace sylar
             return;
         }
         size_t count = (size + m_baseSize - 1) / m_baseSize;
-        Node* tmp = m_root;
+        // 末尾的内存块在当前内存块之后
+        Node* tmp = m_cur ? m_cur : m_root;
         while (tmp->next) {
             tmp = tmp->next;
         }
-        Node* first = nullptr;
-        for (size_t i = 0; i < count; ++i) {
-            tmp->next = new Node(m_baseSize);
-            if (first == nullptr) {
-                first = tmp->next;
-            }
-            tmp = tmp->next;
-            m_capacity += m_baseSize;
-        }
+        // 一次取出所有需要的内存块再接到末尾
+        Node* last = nullptr;
+        Node* first = AllocNodes(m_baseSize, count, last);
+        tmp->next = first;
+        m_capacity += count * m_baseSize;
         if (oldCap == 0) {
             m_cur = first;
         }
@@ -4,11 +4,59 @@
 #include <memory>
 #include <stdint.h>
 #include <vector>
+#include <string>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 namespace sylar
 {
+    /*
+        ByteArray数据的只读切片，共享引用内存块而不复制
+        创建切片后ByteArray再写入被引用的内存块时会换成新的内存块，切片内容不变
+    */
+    class ByteSlice
+    {
+    public:
+        ByteSlice() : m_size(0) {}
+
+        // 引用拼接另一个切片
+        void append(const ByteSlice& other);
+
+        // 复制数据到新的内存中再拼接，用于在切片前后加上少量的数据(如协议头)
+        void append(const void* data, size_t len);
+        void append(const std::string& data) { append(data.c_str(), data.size()); }
+
+        // 从offset开始长度为len的子切片，同样不复制
+        ByteSlice slice(size_t offset, size_t len = ~0ull) const;
+
+        // 保存成iovec数组，可以直接交给writev/sendmsg，返回数据的长度
+        uint64_t getIovec(std::vector<iovec>& buffers) const;
+
+        // 复制出所有数据
+        std::string toString() const;
+
+        size_t size() const { return m_size; }
+        bool empty() const { return m_size == 0; }
+        // 引用的内存段数量
+        size_t getSegmentCount() const { return m_segments.size(); }
+
+    private:
+        friend class ByteArray;
+
+        void appendSegment(const std::shared_ptr<char>& buffer, const char* data, size_t len);
+
+        struct Segment
+        {
+            std::shared_ptr<char> buffer;   // 持有内存块的引用
+            const char* data;
+            size_t len;
+        };
+
+        std::vector<Segment> m_segments;
+        size_t m_size;
+    };
+
     class ByteArray
     {
     public:
@@ -24,11 +72,34 @@ namespace sylar
             char* ptr;
             Node* next;
             size_t size;
+            std::shared_ptr<char> buffer;       // ptr所在的内存，被切片引用时引用计数大于1
+            bool mapped;                        // ptr指向映射的文件，释放时不能放回内存块池
+            bool readonly;                      // ptr指向只读的内存，写入前先复制到新的内存
+        };
+
+        // 当前线程内存块池的统计
+        struct NodePoolStats
+        {
+            uint64_t hits = 0;          // 从池中取到的内存块数量
+            uint64_t misses = 0;        // 池中没有而新分配的内存块数量
+            uint64_t cached = 0;        // 池中缓存的内存块数量
         };
 
         ByteArray(size_t baseSize = 4096);
         ~ByteArray();
 
+        static NodePoolStats GetNodePoolStats();
+
+        /*
+            把文件映射成ByteArray，内存块直接指向映射的内存，不复制数据，访问时才按页加载
+            writable为false时私有只读映射，写入时把内存块复制出来，不影响文件
+            writable为true时共享映射，写入直接修改文件，文件不存在时创建;
+            文件扩展到能容纳reserve的整数个内存块，ByteArray和它的切片都释放后截断回数据的大小
+            失败返回nullptr
+        */
+        static ByteArray::ptr MapFile(const std::string& name, bool writable = false,
+            size_t baseSize = 1024 * 1024, size_t reserve = 0);
+
         // 写入固定长度int8_t类型的数据
         void writeFint8(int8_t value);
         void writeFuint8(uint8_t value);
@@ -47,6 +118,12 @@ namespace sylar
         void writeFloat(float value);
         void writeDouble(double value);
 
+        // 批量变长写入，先编码到栈上的缓冲区再成批写入
+        void writeInt32Array(const int32_t* values, size_t count);
+        void writeUint32Array(const uint32_t* values, size_t count);
+        void writeInt64Array(const int64_t* values, size_t count);
+        void writeUint64Array(const uint64_t* values, size_t count);
+
         // 写入std::string类型的数据，用uint_16作为长度类型
         void writeStringF16(const std::string& value);
         void writeStringF32(const std::string& value);
@@ -73,6 +150,12 @@ namespace sylar
         float readFloat();
         double readDouble();
 
+        // 批量变长读取，数据在一个内存块中时成批解码，跨内存块时逐字节读取
+        void readInt32Array(int32_t* values, size_t count);
+        void readUint32Array(uint32_t* values, size_t count);
+        void readInt64Array(int64_t* values, size_t count);
+        void readUint64Array(uint64_t* values, size_t count);
+
         std::string readStringF16();
         std::string readStringF32();
         std::string readStringF64();
@@ -91,6 +174,12 @@ namespace sylar
         // 从指定位置position读取size长度的数据
         void read(void* buf, size_t size, size_t position) const;
 
+        // 可写映射时把数据写回文件: 映射的部分msync，超出映射或已复制出来的内存块用pwrite
+        bool sync();
+
+        // 是否映射了文件
+        bool isMapped() const { return (bool)m_mapping; }
+
         // 把ByteArray的数据写入文件中
         bool writeToFile(const std::string& name) const;
 
@@ -103,26 +192,45 @@ namespace sylar
         // 将ByteArray里面的数据[m_position, m_size]转成16进制的std::string
         std::string toHexString() const;
 
-        /*  
-            获取可写入的缓存，保存成iovec数组
+        /*
+            获取可写入的缓存，保存成iovec数组，iovec直接指向内存块
             len: 写入的长度，如果m_position + len > m_capacity，则m_capacity扩容
-            返回实际的长度
+            返回实际的长度，写入后调用commit移动位置
         */
-        // uint64_t getWriteBuffer(std::vector<iovec>& buffers, uint64_t len);
+        uint64_t getWriteBuffer(std::vector<iovec>& buffers, uint64_t len);
 
         /*
             读取可读取的缓存，保存成iovec数组
             len: 读取数据的长度，如果len > getReadSize()，则len = getReadSize();
-            返回实际数据的长度
-        */ 
-        // uint64_t getReadBuffer(std::vector<iovec>& buffers, uint64_t len = ~0ull) const;
+            返回实际数据的长度，不改变当前位置
+        */
+        uint64_t getReadBuffer(std::vector<iovec>& buffers, uint64_t len = ~0ull) const;
 
         /*
             从position位置开始，读取可读取的缓存，保存成iovec数组
-            len: 读取数据的长度，如果len > getReadSize()，则len = getReadSize();
+            len: 读取数据的长度，如果len > getSize() - position，则len = getSize() - position;
             返回实际数据的长度
-        */ 
-        // uint64_t getReadBuffer(std::vector<iovec>& buffers, uint64_t len, uint64_t position) const;
+        */
+        uint64_t getReadBuffer(std::vector<iovec>& buffers, uint64_t len, uint64_t position) const;
+
+        // 从当前位置开始长度为len的切片，不改变当前位置
+        ByteSlice slice(size_t len = ~0ull) const;
+
+        // 从position位置开始长度为len的切片
+        ByteSlice slice(size_t position, size_t len) const;
+
+        // 原地计算[position, position + len)的CRC32C，len超过数据末尾时截断
+        uint32_t crc32c(size_t position, size_t len) const;
+
+        // 原地计算[position, position + len)的xxHash64
+        uint64_t xxhash64(size_t position, size_t len, uint64_t seed = 0) const;
+
+        // 计算[position, 当前位置)的校验值，按writeFuint32/writeFuint64写在当前位置作为帧尾，返回校验值
+        uint32_t appendCrc32c(size_t position);
+        uint64_t appendXXHash64(size_t position, uint64_t seed = 0);
+
+        // 当前位置前移len，用于getWriteBuffer写入或getReadBuffer取走部分数据之后，超过当前大小时扩大m_size
+        void commit(size_t len);
 
         // 返回内存块的大小
         size_t getBaseSize() const { return m_baseSize; }
@@ -146,6 +254,10 @@ namespace sylar
         // 扩容ByteArray，使其可以容纳size个数据，如果原本可以容纳，则不扩容
         void addCapacity(size_t size);
 
+        // 批量读取无符号varint，T为uint32_t或uint64_t
+        template<typename T>
+        void readVarintArray(T* values, size_t count);
+
     private:
         size_t m_baseSize;      // 内存块大小
         size_t m_position;      // 当前操作位置
@@ -153,6 +265,8 @@ namespace sylar
         size_t m_size;          // 当前数据的大小
         Node* m_root;           // 第一个内存块的指针
         Node* m_cur;            // 当前操作的内存块指针
+        struct FileMapping;
+        std::shared_ptr<FileMapping> m_mapping;     // 映射的文件，没有映射时为空
 
     };
 }
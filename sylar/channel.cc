@@ -0,0 +1,125 @@
+#include "channel.h"
+#include "iomanager.h"
+#include "util.h"
+#include "macro.h"
+
+namespace sylar
+{
+    void ChannelBase::close() {
+        std::list<FiberEvent::ptr> recv_waiters;
+        std::list<FiberEvent::ptr> send_waiters;
+        {
+            SpinLock::Lock lock(m_mutex);
+            if (m_closed) {
+                return;
+            }
+            m_closed = true;
+            recv_waiters.swap(m_recvWaiters);
+            send_waiters.swap(m_sendWaiters);
+        }
+        for (auto& event : recv_waiters) {
+            event->set();
+        }
+        for (auto& event : send_waiters) {
+            event->set();
+        }
+    }
+
+    bool ChannelBase::isClosed() {
+        SpinLock::Lock lock(m_mutex);
+        return m_closed;
+    }
+
+    void ChannelBase::NotifyOne(std::list<FiberEvent::ptr>& waiters) {
+        while (!waiters.empty()) {
+            FiberEvent::ptr event;
+            event.swap(waiters.front());
+            waiters.pop_front();
+            if (event->set()) {
+                return;
+            }
+        }
+    }
+
+    void ChannelBase::wait(std::list<FiberEvent::ptr>& waiters) {
+        FiberEvent::ptr event = std::make_shared<FiberEvent>();
+        waiters.push_back(event);
+        m_mutex.unlock();
+        // 只有通知者会把事件从队列中取走，被唤醒时不需要再删除
+        event->wait();
+    }
+
+    void ChannelBase::Unwatch(std::list<FiberEvent::ptr>& waiters, const FiberEvent::ptr& event, bool ready) {
+        for (auto it = waiters.begin(); it != waiters.end(); ++it) {
+            if (*it == event) {
+                waiters.erase(it);
+                return;
+            }
+        }
+        // 这次通知被select用在了其他分支上，转给下一个等待者
+        if (ready) {
+            NotifyOne(waiters);
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    int ChannelSelect::tryWait() {
+        for (size_t i = 0; i < m_cases.size(); ++i) {
+            if (m_cases[i]->tryDo()) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    int ChannelSelect::wait(uint64_t timeout_ms, TimerManager* timer) {
+        SYLAR_ASSERT(!m_cases.empty());
+        uint64_t deadline = ~0ull;
+        if (timeout_ms != ~0ull) {
+            deadline = GetCurrentMS() + timeout_ms;
+            if (!timer) {
+                timer = IOManager::GetThisIOManager();
+            }
+            SYLAR_ASSERT2(timer, "ChannelSelect timeout needs a TimerManager");
+        }
+        while (true) {
+            int idx = tryWait();
+            if (idx >= 0) {
+                return idx;
+            }
+            uint64_t now = GetCurrentMS();
+            if (deadline != ~0ull && now >= deadline) {
+                return -1;
+            }
+            FiberEvent::ptr event = std::make_shared<FiberEvent>();
+            size_t watched = 0;
+            bool ready = false;
+            for (; watched < m_cases.size(); ++watched) {
+                if (m_cases[watched]->watch(event)) {
+                    ready = true;
+                    break;
+                }
+            }
+            if (ready) {
+                // 已经挂上的通道可能抢先set了事件，这时仍要消耗掉这次唤醒
+                if (!event->cancel()) {
+                    event->wait();
+                }
+            } else {
+                Timer::ptr t;
+                if (deadline != ~0ull) {
+                    t = timer->addTimer(deadline - now, [event]() {
+                        event->set();
+                    });
+                }
+                event->wait();
+                if (t) {
+                    t->cancel();
+                }
+            }
+            for (size_t i = 0; i < watched; ++i) {
+                m_cases[i]->unwatch(event);
+            }
+        }
+    }
+}
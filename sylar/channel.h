@@ -0,0 +1,277 @@
+#ifndef __SYLAR_CHANNEL_H__
+#define __SYLAR_CHANNEL_H__
+
+#include <deque>
+#include <list>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include "fiber_sync.h"
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace sylar
+{
+    class TimerManager;
+
+    // 通道中与元素类型无关的部分: 关闭状态和收发两端的等待队列
+    class ChannelBase : Noncopyable
+    {
+        friend class ChannelSelect;
+    public:
+        virtual ~ChannelBase() {}
+
+        // 关闭通道并唤醒所有等待者，之后send失败，recv取完剩余元素后失败
+        void close();
+        bool isClosed();
+        size_t capacity() const { return m_capacity; }
+
+    protected:
+        ChannelBase(size_t capacity) : m_capacity(capacity) {}
+
+        // 以下函数需持有m_mutex
+        // 唤醒一个等待者，跳过已经被其他通道或超时唤醒的
+        static void NotifyOne(std::list<FiberEvent::ptr>& waiters);
+        // 挂到等待队列上，释放m_mutex并挂起，返回时不持有锁
+        void wait(std::list<FiberEvent::ptr>& waiters);
+        // 从等待队列中删除事件，事件已被通知者取走而通道仍然就绪时，把通知转给下一个等待者
+        static void Unwatch(std::list<FiberEvent::ptr>& waiters, const FiberEvent::ptr& event, bool ready);
+
+    protected:
+        SpinLock m_mutex;
+        size_t m_capacity;                          // 0表示不限长度
+        bool m_closed = false;
+        std::list<FiberEvent::ptr> m_recvWaiters;   // 等待数据的协程
+        std::list<FiberEvent::ptr> m_sendWaiters;   // 等待空位的协程
+    };
+
+    // 协程间传递消息的通道，收发时挂起协程而不是阻塞线程
+    // 元素以移动的方式放入和取出
+    template<typename T>
+    class Channel : public ChannelBase
+    {
+        friend class ChannelSelect;
+    public:
+        using ptr = std::shared_ptr<Channel>;
+
+        // capacity为0时不限长度，send不会挂起
+        Channel(size_t capacity = 0) : ChannelBase(capacity) {}
+
+        // 通道已满时挂起，通道关闭时返回false
+        bool send(T&& value) {
+            m_mutex.lock();
+            while (!canSend()) {
+                wait(m_sendWaiters);
+                m_mutex.lock();
+            }
+            if (m_closed) {
+                m_mutex.unlock();
+                return false;
+            }
+            doSend(value);
+            m_mutex.unlock();
+            return true;
+        }
+
+        bool send(const T& value) {
+            T tmp(value);
+            return send(std::move(tmp));
+        }
+
+        // 不挂起，通道已满或已关闭时返回false，此时value保持不变
+        bool trySend(T&& value) {
+            SpinLock::Lock lock(m_mutex);
+            if (m_closed || isFull()) {
+                return false;
+            }
+            doSend(value);
+            return true;
+        }
+
+        bool trySend(const T& value) {
+            T tmp(value);
+            return trySend(std::move(tmp));
+        }
+
+        // 通道为空时挂起，通道关闭且已取完时返回false
+        bool recv(T& value) {
+            m_mutex.lock();
+            while (!canRecv()) {
+                wait(m_recvWaiters);
+                m_mutex.lock();
+            }
+            if (m_queue.empty()) {
+                m_mutex.unlock();
+                return false;
+            }
+            doRecv(value);
+            m_mutex.unlock();
+            return true;
+        }
+
+        // 不挂起，通道为空时返回false
+        bool tryRecv(T& value) {
+            SpinLock::Lock lock(m_mutex);
+            if (m_queue.empty()) {
+                return false;
+            }
+            doRecv(value);
+            return true;
+        }
+
+        size_t size() {
+            SpinLock::Lock lock(m_mutex);
+            return m_queue.size();
+        }
+
+    private:
+        // 以下函数需持有m_mutex
+        bool isFull() const { return m_capacity && m_queue.size() >= m_capacity; }
+        bool canSend() const { return m_closed || !isFull(); }
+        bool canRecv() const { return m_closed || !m_queue.empty(); }
+
+        void doSend(T& value) {
+            m_queue.push_back(std::move(value));
+            NotifyOne(m_recvWaiters);
+        }
+
+        void doRecv(T& value) {
+            value = std::move(m_queue.front());
+            m_queue.pop_front();
+            NotifyOne(m_sendWaiters);
+        }
+
+    private:
+        std::deque<T> m_queue;
+    };
+
+    // 同时等待多个通道的收发，按添加顺序执行第一个可以完成的分支
+    //  ChannelSelect sel;
+    //  sel.recv(*ch1, v1).recv(*ch2, v2, &ok).send(*ch3, std::move(msg));
+    //  int idx = sel.wait(100);        // 返回完成的分支下标，超时返回-1
+    // 通道关闭时对应分支也算完成，ok被置为false
+    class ChannelSelect : Noncopyable
+    {
+    public:
+        template<typename T>
+        ChannelSelect& recv(Channel<T>& chan, T& value, bool* ok = nullptr) {
+            m_cases.push_back(Case::ptr(new RecvCase<T>(chan, value, ok)));
+            return *this;
+        }
+
+        // 只有分支完成时value才会被放入通道
+        template<typename T>
+        ChannelSelect& send(Channel<T>& chan, T&& value, bool* ok = nullptr) {
+            m_cases.push_back(Case::ptr(new SendCase<T>(chan, std::move(value), ok)));
+            return *this;
+        }
+
+        // 不挂起，没有可以完成的分支时返回-1
+        int tryWait();
+        // timeout_ms为~0ull时一直等待
+        // 超时依赖定时器，timer为空时使用当前线程的IOManager
+        int wait(uint64_t timeout_ms = ~0ull, TimerManager* timer = nullptr);
+
+    private:
+        class Case
+        {
+        public:
+            using ptr = std::shared_ptr<Case>;
+            virtual ~Case() {}
+            // 尝试完成分支
+            virtual bool tryDo() = 0;
+            // 分支可以完成时返回true，否则把事件挂到通道的等待队列上
+            virtual bool watch(const FiberEvent::ptr& event) = 0;
+            virtual void unwatch(const FiberEvent::ptr& event) = 0;
+        };
+
+        template<typename T>
+        class RecvCase : public Case
+        {
+        public:
+            RecvCase(Channel<T>& chan, T& value, bool* ok)
+                : m_chan(chan), m_value(value), m_ok(ok) {}
+
+            bool tryDo() override {
+                SpinLock::Lock lock(m_chan.m_mutex);
+                if (!m_chan.canRecv()) {
+                    return false;
+                }
+                bool ok = !m_chan.m_queue.empty();
+                if (ok) {
+                    m_chan.doRecv(m_value);
+                }
+                if (m_ok) {
+                    *m_ok = ok;
+                }
+                return true;
+            }
+
+            bool watch(const FiberEvent::ptr& event) override {
+                SpinLock::Lock lock(m_chan.m_mutex);
+                if (m_chan.canRecv()) {
+                    return true;
+                }
+                m_chan.m_recvWaiters.push_back(event);
+                return false;
+            }
+
+            void unwatch(const FiberEvent::ptr& event) override {
+                SpinLock::Lock lock(m_chan.m_mutex);
+                ChannelBase::Unwatch(m_chan.m_recvWaiters, event, m_chan.canRecv());
+            }
+
+        private:
+            Channel<T>& m_chan;
+            T& m_value;
+            bool* m_ok;
+        };
+
+        template<typename T>
+        class SendCase : public Case
+        {
+        public:
+            SendCase(Channel<T>& chan, T&& value, bool* ok)
+                : m_chan(chan), m_value(std::move(value)), m_ok(ok) {}
+
+            bool tryDo() override {
+                SpinLock::Lock lock(m_chan.m_mutex);
+                if (!m_chan.canSend()) {
+                    return false;
+                }
+                bool ok = !m_chan.m_closed;
+                if (ok) {
+                    m_chan.doSend(m_value);
+                }
+                if (m_ok) {
+                    *m_ok = ok;
+                }
+                return true;
+            }
+
+            bool watch(const FiberEvent::ptr& event) override {
+                SpinLock::Lock lock(m_chan.m_mutex);
+                if (m_chan.canSend()) {
+                    return true;
+                }
+                m_chan.m_sendWaiters.push_back(event);
+                return false;
+            }
+
+            void unwatch(const FiberEvent::ptr& event) override {
+                SpinLock::Lock lock(m_chan.m_mutex);
+                ChannelBase::Unwatch(m_chan.m_sendWaiters, event, m_chan.canSend());
+            }
+
+        private:
+            Channel<T>& m_chan;
+            T m_value;
+            bool* m_ok;
+        };
+
+    private:
+        std::vector<Case::ptr> m_cases;
+    };
+}
+
+#endif
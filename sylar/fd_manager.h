@@ -21,6 +21,7 @@ namespace sylar
 
         void setSysNonblock(bool v) { m_sysNonblock = v; }
         void setUserNonblock(bool v) { m_userNonblock = v; }
+        void setClosed(bool v) { m_isClosed = v; }
 
         uint64_t getTimeout(int type);
         void setTimeout(int type, uint64_t v);
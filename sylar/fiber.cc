@@ -5,6 +5,7 @@
 #include "util.h"
 #include "macro.h"
 #include <stdlib.h>
+#include <sys/mman.h>
 #include "scheduler.h"
 
 namespace sylar
@@ -18,44 +19,227 @@ namespace sylar
     static thread_local Fiber::ptr t_mainFiber = nullptr;     // 主协程
 
     static ConfigVar<uint32_t>::ptr g_fiber_stack_size = Config::Add<uint32_t>("fiber.stack_size", 128 * 1024, "fiber stack size");
+    static ConfigVar<uint32_t>::ptr g_fiber_stack_pool_max_count =
+        Config::Add<uint32_t>("fiber.stack_pool.max_count", 256, "max cached fiber stacks per size class per thread");
+    static ConfigVar<uint64_t>::ptr g_fiber_stack_pool_max_bytes =
+        Config::Add<uint64_t>("fiber.stack_pool.max_bytes", 64 * 1024 * 1024, "max cached fiber stack bytes per thread");
+
+    static uint32_t s_fiber_stack_size = 0;
+    static uint32_t s_stack_pool_max_count = 0;
+    static uint64_t s_stack_pool_max_bytes = 0;
+
+    struct _StackPoolIniter
+    {
+        _StackPoolIniter() {
+            s_fiber_stack_size = g_fiber_stack_size->getValue();
+            g_fiber_stack_size->addListener([](const uint32_t& old_value, const uint32_t& new_value) {
+                SYLAR_LOG_INFO(g_logger) << "fiber stack size changed from " << old_value << " to " << new_value;
+                s_fiber_stack_size = new_value;
+            });
+            s_stack_pool_max_count = g_fiber_stack_pool_max_count->getValue();
+            s_stack_pool_max_bytes = g_fiber_stack_pool_max_bytes->getValue();
+            g_fiber_stack_pool_max_count->addListener([](const uint32_t& old_value, const uint32_t& new_value) {
+                SYLAR_LOG_INFO(g_logger) << "fiber stack pool max_count changed from " << old_value << " to " << new_value;
+                s_stack_pool_max_count = new_value;
+            });
+            g_fiber_stack_pool_max_bytes->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+                SYLAR_LOG_INFO(g_logger) << "fiber stack pool max_bytes changed from " << old_value << " to " << new_value;
+                s_stack_pool_max_bytes = new_value;
+            });
+        }
+    };
+    static _StackPoolIniter s_stack_pool_initer;
+
+    // 栈大小类: 16K, 32K, ... 2M，更大的栈不缓存
+    static const size_t s_stack_min_class_size = 16 * 1024;
+    static const int s_stack_class_count = 8;
+
+    static size_t GetPageSize() {
+        static size_t s_page_size = sysconf(_SC_PAGESIZE);
+        return s_page_size;
+    }
+
+    static int GetStackClass(size_t size) {
+        size_t class_size = s_stack_min_class_size;
+        for (int i = 0; i < s_stack_class_count; ++i) {
+            if (size <= class_size) {
+                return i;
+            }
+            class_size <<= 1;
+        }
+        return -1;
+    }
+
+    // 每个线程的栈缓存池
+    class StackPool
+    {
+    public:
+        StackPool();
+        ~StackPool();
+        void* pop(int cls);
+        bool push(int cls, void* p, size_t size);
+
+        std::atomic<uint64_t> hits{ 0 };
+        std::atomic<uint64_t> misses{ 0 };
+        std::atomic<uint64_t> resident{ 0 };
+    private:
+        std::vector<void*> m_stacks[s_stack_class_count];
+        uint64_t m_bytes = 0;
+    };
+
+    // 已退出线程的计数，以及所有存活线程的栈池
+    static Mutex& GetStackPoolMutex() {
+        static Mutex s_mutex;
+        return s_mutex;
+    }
+    static std::vector<StackPool*>& GetStackPools() {
+        static std::vector<StackPool*> s_pools;
+        return s_pools;
+    }
+    static std::atomic<uint64_t> s_stack_exited_hits(0);
+    static std::atomic<uint64_t> s_stack_exited_misses(0);
+    static std::atomic<uint64_t> s_stack_active(0);
+
+    static thread_local bool t_stack_pool_destroyed = false;
+
+    static StackPool* GetThisStackPool() {
+        if (t_stack_pool_destroyed) {
+            return nullptr;
+        }
+        static thread_local StackPool t_stack_pool;
+        return &t_stack_pool;
+    }
+
+    // mmap一块栈内存，最低地址处为PROT_NONE的保护页，栈溢出时直接SIGSEGV而不是破坏堆
+    static void* MapStack(size_t size) {
+        size_t page = GetPageSize();
+        void* base = mmap(nullptr, size + page, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        SYLAR_ASSERT2(base != MAP_FAILED, "mmap fiber stack size=" << size << " errno=" << errno);
+        if (mprotect(base, page, PROT_NONE)) {
+            SYLAR_ASSERT2(false, "mprotect fiber stack guard page errno=" << errno);
+        }
+        return (char*)base + page;
+    }
+
+    static void UnmapStack(void* p, size_t size) {
+        size_t page = GetPageSize();
+        munmap((char*)p - page, size + page);
+    }
+
+    StackPool::StackPool() {
+        Mutex::Lock lock(GetStackPoolMutex());
+        GetStackPools().push_back(this);
+    }
+
+    StackPool::~StackPool() {
+        size_t class_size = s_stack_min_class_size;
+        for (int i = 0; i < s_stack_class_count; ++i) {
+            for (void* p : m_stacks[i]) {
+                UnmapStack(p, class_size);
+            }
+            class_size <<= 1;
+        }
+        {
+            Mutex::Lock lock(GetStackPoolMutex());
+            auto& pools = GetStackPools();
+            for (auto it = pools.begin(); it != pools.end(); ++it) {
+                if (*it == this) {
+                    pools.erase(it);
+                    break;
+                }
+            }
+            s_stack_exited_hits += hits;
+            s_stack_exited_misses += misses;
+        }
+        t_stack_pool_destroyed = true;
+    }
+
+    void* StackPool::pop(int cls) {
+        std::vector<void*>& stacks = m_stacks[cls];
+        if (stacks.empty()) {
+            misses.store(misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        void* p = stacks.back();
+        stacks.pop_back();
+        m_bytes -= s_stack_min_class_size << cls;
+        hits.store(hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        resident.store(resident.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        return p;
+    }
+
+    bool StackPool::push(int cls, void* p, size_t size) {
+        std::vector<void*>& stacks = m_stacks[cls];
+        if (stacks.size() >= s_stack_pool_max_count
+            || m_bytes + size > s_stack_pool_max_bytes) {
+            return false;
+        }
+        stacks.push_back(p);
+        m_bytes += size;
+        resident.store(resident.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return true;
+    }
 
     class StackAllocator
     {
     public:
-        static void* Alloc(size_t size) {
-            return malloc(size);
+        // size向上取整到大小类，返回实际可用的栈大小
+        static void* Alloc(size_t& size) {
+            ++s_stack_active;
+            int cls = GetStackClass(size);
+            if (cls < 0) {
+                size_t page = GetPageSize();
+                size = (size + page - 1) / page * page;
+                return MapStack(size);
+            }
+            size = s_stack_min_class_size << cls;
+            StackPool* pool = GetThisStackPool();
+            void* p = pool ? pool->pop(cls) : nullptr;
+            return p ? p : MapStack(size);
         }
-        static void Dealloc(void* p) {
-            free(p);
+        static void Dealloc(void* p, size_t size) {
+            --s_stack_active;
+            int cls = GetStackClass(size);
+            StackPool* pool = GetThisStackPool();
+            if (cls >= 0 && pool && pool->push(cls, p, size)) {
+                return;
+            }
+            UnmapStack(p, size);
         }
     };
 
-    Fiber::Fiber() : m_id(0), m_stacksize(0), m_state(State::EXEC), m_stack(nullptr) {
-        if (getcontext(&m_ctx)) {
-            SYLAR_ASSERT2(false, "getcontext");
+    Fiber::StackStats Fiber::GetStackStats() {
+        StackStats stats;
+        Mutex::Lock lock(GetStackPoolMutex());
+        stats.hits = s_stack_exited_hits;
+        stats.misses = s_stack_exited_misses;
+        for (StackPool* pool : GetStackPools()) {
+            stats.hits += pool->hits.load(std::memory_order_relaxed);
+            stats.misses += pool->misses.load(std::memory_order_relaxed);
+            stats.resident += pool->resident.load(std::memory_order_relaxed);
         }
+        stats.active = s_stack_active;
+        return stats;
+    }
+
+    Fiber::Fiber() : m_id(0), m_stacksize(0), m_state(State::EXEC), m_stack(nullptr) {
+        m_ctx.init();
         ++s_fiber_count;
         SYLAR_LOG_DEBUG(g_logger) << "Fiber::Fiber()";
     }
 
     Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool usecaller)
         : m_id(++s_fiber_id), m_state(State::READY), m_cb(cb) {
-        m_stacksize = stacksize ? stacksize : g_fiber_stack_size->getValue();
-        m_stack = StackAllocator::Alloc(m_stacksize);
-        if (getcontext(&m_ctx)) {
-            SYLAR_ASSERT2(false, "getcontext");
-        }
-        m_ctx.uc_stack.ss_sp = m_stack;
-        m_ctx.uc_stack.ss_size = m_stacksize;
-        // m_ctx.uc_link = &GetMainFiber()->m_ctx;
-        // m_ctx.uc_link = &Scheduler::GetSchedulerFiber()->m_ctx;
+        size_t size = stacksize ? stacksize : s_fiber_stack_size;
+        m_stack = StackAllocator::Alloc(size);
+        m_stacksize = size;
         ++s_fiber_count;
         if (usecaller) {
-            m_ctx.uc_link = &GetMainFiber()->m_ctx;
-            makecontext(&m_ctx, &Fiber::CallerMainFunc, 0);
+            GetMainFiber();
+            m_ctx.make(m_stack, m_stacksize, &Fiber::CallerMainFunc);
         } else {
-            // m_ctx.uc_link = &Scheduler::GetSchedulerFiber()->m_ctx;
-            makecontext(&m_ctx, &Fiber::MainFunc, 0);
+            m_ctx.make(m_stack, m_stacksize, &Fiber::MainFunc);
         }
         SYLAR_LOG_DEBUG(g_logger) << "Fiber::Fiber id = " << m_id;
     }
@@ -65,7 +249,7 @@ namespace sylar
             SYLAR_ASSERT(m_state == State::TERM
                 || m_state == State::EXCEPT
                 || m_state == State::READY);
-            StackAllocator::Dealloc(m_stack);
+            StackAllocator::Dealloc(m_stack, m_stacksize);
         } else {
             SYLAR_ASSERT(!m_cb);
             SYLAR_ASSERT(m_state == State::EXEC);
@@ -81,14 +265,27 @@ namespace sylar
         SYLAR_LOG_DEBUG(g_logger) << "Fiber::~Fiber id = " << m_id;
     }
 
+    // 复用协程的栈执行新的回调，只有未运行或已结束的协程可以重置
+    void Fiber::reset(std::function<void()> cb) {
+        SYLAR_ASSERT(m_stack);
+        SYLAR_ASSERT(m_state == State::TERM
+            || m_state == State::EXCEPT
+            || m_state == State::READY);
+        m_cb.swap(cb);
+        m_ctx.make(m_stack, m_stacksize, &Fiber::MainFunc);
+        m_state = State::READY;
+    }
+
     void Fiber::swapIn() {
         // SetThis(shared_from_this());
         SetThis(this);
         SYLAR_ASSERT(m_state != State::EXEC);
         m_state = State::EXEC;
-        // if (swapcontext(&GetMainFiber()->m_ctx, &m_ctx)) {
-        if (swapcontext(&Scheduler::GetSchedulerFiber()->m_ctx, &m_ctx)) {
-            SYLAR_ASSERT2(false, "swapcontext");
+        FiberContext::Swap(Scheduler::GetSchedulerFiber()->m_ctx, m_ctx);
+        // 协程让出时仍是EXEC，切换完成(上下文已保存)后才置为HOLD，
+        // 避免其他线程在上下文保存之前就切入
+        if (m_state == State::EXEC) {
+            m_state = State::HOLD;
         }
     }
 
@@ -96,18 +293,13 @@ namespace sylar
         // SetThis(GetMainFiber()->shared_from_this());
         // SetThis(Scheduler::GetSchedulerFiber()->shared_from_this());
         SetThis(Scheduler::GetSchedulerFiber().get());
-        // if (swapcontext(&m_ctx, &GetMainFiber()->m_ctx)) {
-        if (swapcontext(&m_ctx, &Scheduler::GetSchedulerFiber()->m_ctx)) {
-            SYLAR_ASSERT2(false, "swapcontext");
-        }
+        FiberContext::Swap(m_ctx, Scheduler::GetSchedulerFiber()->m_ctx);
     }
 
     // 单独测试Fiber
     // void Fiber::swapOut() {
     //     SetThis(GetMainFiber().get());
-    //     if (swapcontext(&m_ctx, &GetMainFiber()->m_ctx)) {
-    //         SYLAR_ASSERT2(false, "swapcontext");
-    //     }
+    //     FiberContext::Swap(m_ctx, GetMainFiber()->m_ctx);
     // }
 
     void Fiber::call() {
@@ -115,8 +307,9 @@ namespace sylar
         SetThis(this);
         SYLAR_ASSERT(m_state != State::EXEC);
         m_state = State::EXEC;
-        if (swapcontext(&GetMainFiber()->m_ctx, &m_ctx)) {
-            SYLAR_ASSERT2(false, "swapcontext");
+        FiberContext::Swap(GetMainFiber()->m_ctx, m_ctx);
+        if (m_state == State::EXEC) {
+            m_state = State::HOLD;
         }
     }
 
@@ -168,12 +361,14 @@ namespace sylar
                 << " fiber_id=" << cur->getId()
                 << std::endl
                 << sylar::BacktraceToString();
+            cur->m_cb = nullptr;
         } catch (...) {
             cur->m_state = State::EXCEPT;
             SYLAR_LOG_ERROR(g_logger) << "Fiber Except: "
                 << " fiber_id=" << cur->getId()
                 << std::endl
                 << sylar::BacktraceToString();
+            cur->m_cb = nullptr;
         }
         // SetThis(Scheduler::GetSchedulerFiber().get());
         cur->swapOut();
@@ -194,14 +389,23 @@ namespace sylar
                 << " fiber_id=" << cur->getId()
                 << std::endl
                 << sylar::BacktraceToString();
+            cur->m_cb = nullptr;
         } catch (...) {
             cur->m_state = State::EXCEPT;
             SYLAR_LOG_ERROR(g_logger) << "Fiber Except: "
                 << " fiber_id=" << cur->getId()
                 << std::endl
                 << sylar::BacktraceToString();
+            cur->m_cb = nullptr;
         }
-        SetThis(GetMainFiber().get());
+        // 没有uc_link，需要主动切回主协程
+        SetThis(t_mainFiber.get());
+        FiberContext::Swap(cur->m_ctx, t_mainFiber->m_ctx);
+        SYLAR_ASSERT2(false, "never reach fiber_id=" + std::to_string(cur->getId()));
+    }
+
+    uint32_t Fiber::GetDefaultStackSize() {
+        return s_fiber_stack_size;
     }
 
     uint64_t Fiber::GetFiberId() {
@@ -215,8 +419,7 @@ namespace sylar
         // Fiber::ptr cur = GetThis();
         Fiber* cur = GetThis();
         SYLAR_ASSERT(cur->m_state == State::EXEC);
-        // cur->m_state = State::READY;
-        cur->m_state = State::HOLD;
+        // 由切入方在切换完成后置为HOLD
         cur->swapOut();
     }
 
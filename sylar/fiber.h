@@ -2,9 +2,10 @@
 #define __SALAR_FIBER_H__
 
 #include <functional>
-#include <ucontext.h>
 #include <stdint.h>
 #include <memory>
+#include <atomic>
+#include "fiber_context.h"
 
 namespace sylar
 {
@@ -23,6 +24,14 @@ namespace sylar
             READY,      // 可执行
             EXCEPT      // 异常
         };
+        // 协程栈池统计
+        struct StackStats
+        {
+            uint64_t hits = 0;          // 从栈池中复用的次数
+            uint64_t misses = 0;        // 栈池为空，新mmap的次数
+            uint64_t resident = 0;      // 栈池中缓存的栈数量
+            uint64_t active = 0;        // 正在被协程使用的栈数量
+        };
     private:
         Fiber();
     public:
@@ -30,6 +39,9 @@ namespace sylar
         ~Fiber();
         uint64_t getId() const { return m_id; }
         State getState() const { return m_state; }
+        uint32_t getStackSize() const { return m_stacksize; }
+
+        void reset(std::function<void()> cb);
 
         void swapIn();
         void swapOut();
@@ -44,12 +56,14 @@ namespace sylar
         static void CallerMainFunc();
         static uint64_t GetFiberId();
         static void YieldToHold();
+        static StackStats GetStackStats();
+        static uint32_t GetDefaultStackSize();
 
     private:
         uint64_t m_id;
         uint32_t m_stacksize;
-        State m_state;
-        ucontext_t m_ctx;
+        std::atomic<State> m_state;
+        FiberContext m_ctx;
         void* m_stack;
         std::function<void()> m_cb;
     };
@@ -0,0 +1,87 @@
+#include "fiber_context.h"
+#include "macro.h"
+#include <stdint.h>
+#include <string.h>
+
+#ifndef SYLAR_FIBER_UCONTEXT
+extern "C" {
+    // 实现在fiber_context.S
+    void sylar_swap_context(void** from_sp, void* to_sp);
+    void sylar_context_entry();
+}
+#endif
+
+namespace sylar
+{
+#ifdef SYLAR_FIBER_UCONTEXT
+
+    void FiberContext::init() {
+        if (getcontext(&m_ctx)) {
+            SYLAR_ASSERT2(false, "getcontext");
+        }
+    }
+
+    void FiberContext::make(void* stack, size_t size, EntryFunc func) {
+        if (getcontext(&m_ctx)) {
+            SYLAR_ASSERT2(false, "getcontext");
+        }
+        m_ctx.uc_link = nullptr;
+        m_ctx.uc_stack.ss_sp = stack;
+        m_ctx.uc_stack.ss_size = size;
+        makecontext(&m_ctx, func, 0);
+    }
+
+    void FiberContext::Swap(FiberContext& from, FiberContext& to) {
+        if (swapcontext(&from.m_ctx, &to.m_ctx)) {
+            SYLAR_ASSERT2(false, "swapcontext");
+        }
+    }
+
+    const char* FiberContext::GetBackendName() {
+        return "ucontext";
+    }
+
+#else
+
+    // 当前执行流的寄存器在第一次Swap切出时才会保存
+    void FiberContext::init() {
+        m_sp = nullptr;
+    }
+
+    // 在栈顶伪造一个sylar_swap_context切出时的栈帧，返回地址为sylar_context_entry
+    void FiberContext::make(void* stack, size_t size, EntryFunc func) {
+        uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+#if defined(__x86_64__)
+        // [mxcsr|fpucw] r12 r13 r14 r15 rbx rbp ret
+        uint64_t* frame = (uint64_t*)(top - 8 * sizeof(uint64_t));
+        memset(frame, 0, 8 * sizeof(uint64_t));
+        uint32_t mxcsr = 0x1F80;
+        uint16_t fpucw = 0x037F;
+        memcpy((char*)frame, &mxcsr, sizeof(mxcsr));
+        memcpy((char*)frame + 4, &fpucw, sizeof(fpucw));
+        frame[1] = (uint64_t)func;                      // r12
+        frame[7] = (uint64_t)&sylar_context_entry;      // ret
+#elif defined(__aarch64__)
+        // d8-d15 x19-x28 x29 x30
+        uint64_t* frame = (uint64_t*)(top - 20 * sizeof(uint64_t));
+        memset(frame, 0, 20 * sizeof(uint64_t));
+        frame[8] = (uint64_t)func;                      // x19
+        frame[19] = (uint64_t)&sylar_context_entry;     // x30
+#endif
+        m_sp = frame;
+    }
+
+    void FiberContext::Swap(FiberContext& from, FiberContext& to) {
+        sylar_swap_context(&from.m_sp, to.m_sp);
+    }
+
+    const char* FiberContext::GetBackendName() {
+#if defined(__x86_64__)
+        return "asm_x86_64";
+#else
+        return "asm_aarch64";
+#endif
+    }
+
+#endif
+}
@@ -0,0 +1,43 @@
+#ifndef __SYLAR_FIBER_CONTEXT_H__
+#define __SYLAR_FIBER_CONTEXT_H__
+
+#include <stddef.h>
+
+// 默认在x86_64/aarch64上使用汇编实现的上下文切换，只保存callee-saved寄存器，
+// 不会像swapcontext那样每次切换都调用rt_sigprocmask
+// 定义SYLAR_FIBER_UCONTEXT(cmake -DSYLAR_FIBER_UCONTEXT=ON)可强制使用ucontext
+#if !defined(SYLAR_FIBER_UCONTEXT) && !defined(__x86_64__) && !defined(__aarch64__)
+#define SYLAR_FIBER_UCONTEXT
+#endif
+
+#ifdef SYLAR_FIBER_UCONTEXT
+#include <ucontext.h>
+#endif
+
+namespace sylar
+{
+    class FiberContext
+    {
+    public:
+        using EntryFunc = void(*)();
+
+        // 以当前执行流初始化上下文(线程主协程使用)
+        void init();
+        // 在指定的栈上创建上下文，切换进入后执行func，func不能返回
+        void make(void* stack, size_t size, EntryFunc func);
+
+        // 保存当前上下文到from，并切换到to
+        static void Swap(FiberContext& from, FiberContext& to);
+        // 当前使用的上下文切换实现
+        static const char* GetBackendName();
+
+    private:
+#ifdef SYLAR_FIBER_UCONTEXT
+        ucontext_t m_ctx;
+#else
+        void* m_sp = nullptr;           // 切出时保存的栈顶
+#endif
+    };
+}
+
+#endif
@@ -0,0 +1,171 @@
+#include "fiber_sync.h"
+#include "scheduler.h"
+#include "macro.h"
+
+namespace sylar
+{
+    // 当前是否在调度器的任务协程中执行(可以让出)
+    static bool CanYield() {
+        if (!Scheduler::GetThisScheduler()) {
+            return false;
+        }
+        Fiber* cur = Fiber::GetThis();
+        return cur->getStackSize() > 0
+            && cur != Scheduler::GetSchedulerFiber().get();
+    }
+
+    FiberEvent::FiberEvent() : m_set(false) {
+        if (CanYield()) {
+            m_scheduler = Scheduler::GetThisScheduler();
+            m_fiber = Fiber::GetThis()->shared_from_this();
+        }
+    }
+
+    void FiberEvent::wait() {
+        if (m_scheduler) {
+            Fiber::YieldToHold();
+        } else {
+            m_sem.wait();
+        }
+        SYLAR_ASSERT(m_set);
+    }
+
+    bool FiberEvent::set() {
+        bool expected = false;
+        if (!m_set.compare_exchange_strong(expected, true)) {
+            return false;
+        }
+        if (m_scheduler) {
+            // 先取出成员，schedule之后协程可能已经恢复执行并销毁了事件
+            Scheduler* scheduler = m_scheduler;
+            Fiber::ptr fiber;
+            fiber.swap(m_fiber);
+            scheduler->schedule(fiber);
+        } else {
+            m_sem.notify();
+        }
+        return true;
+    }
+
+    bool FiberEvent::cancel() {
+        bool expected = false;
+        if (!m_set.compare_exchange_strong(expected, true)) {
+            return false;
+        }
+        m_fiber.reset();
+        return true;
+    }
+
+    // 把当前协程(或线程)加入等待队列并挂起
+    // 调用时持有lock，挂起前释放
+    static void Park(std::list<FiberEvent*>& waiters, SpinLock& lock) {
+        FiberEvent event;
+        waiters.push_back(&event);
+        lock.unlock();
+        event.wait();
+    }
+
+    // ------------------------------------------------------------------------
+    void FiberMutex::lock() {
+        m_mutex.lock();
+        if (!m_locked) {
+            m_locked = true;
+            m_mutex.unlock();
+            return;
+        }
+        // 被唤醒时锁已经交给了当前协程
+        Park(m_waiters, m_mutex);
+    }
+
+    bool FiberMutex::tryLock() {
+        SpinLock::Lock lock(m_mutex);
+        if (m_locked) {
+            return false;
+        }
+        m_locked = true;
+        return true;
+    }
+
+    void FiberMutex::unlock() {
+        FiberEvent* waiter = nullptr;
+        {
+            SpinLock::Lock lock(m_mutex);
+            SYLAR_ASSERT(m_locked);
+            if (m_waiters.empty()) {
+                m_locked = false;
+                return;
+            }
+            waiter = m_waiters.front();
+            m_waiters.pop_front();
+        }
+        waiter->set();
+    }
+
+    // ------------------------------------------------------------------------
+    void FiberCondition::wait(FiberMutex::Lock& lock) {
+        m_mutex.lock();
+        // 先加入等待队列再释放互斥锁，不会错过之后的notify
+        lock.unlock();
+        Park(m_waiters, m_mutex);
+        lock.lock();
+    }
+
+    void FiberCondition::notify() {
+        FiberEvent* waiter = nullptr;
+        {
+            SpinLock::Lock lock(m_mutex);
+            if (m_waiters.empty()) {
+                return;
+            }
+            waiter = m_waiters.front();
+            m_waiters.pop_front();
+        }
+        waiter->set();
+    }
+
+    void FiberCondition::notifyAll() {
+        std::list<FiberEvent*> waiters;
+        {
+            SpinLock::Lock lock(m_mutex);
+            waiters.swap(m_waiters);
+        }
+        for (auto& waiter : waiters) {
+            waiter->set();
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    void FiberSemaphore::wait() {
+        m_mutex.lock();
+        if (m_count > 0) {
+            --m_count;
+            m_mutex.unlock();
+            return;
+        }
+        // 被唤醒时notify已经把计数交给了当前协程
+        Park(m_waiters, m_mutex);
+    }
+
+    bool FiberSemaphore::tryWait() {
+        SpinLock::Lock lock(m_mutex);
+        if (m_count > 0) {
+            --m_count;
+            return true;
+        }
+        return false;
+    }
+
+    void FiberSemaphore::notify() {
+        FiberEvent* waiter = nullptr;
+        {
+            SpinLock::Lock lock(m_mutex);
+            if (m_waiters.empty()) {
+                ++m_count;
+                return;
+            }
+            waiter = m_waiters.front();
+            m_waiters.pop_front();
+        }
+        waiter->set();
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef __SYLAR_FIBER_SYNC_H__
+#define __SYLAR_FIBER_SYNC_H__
+
+#include <list>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include "mutex.h"
+#include "fiber.h"
+#include "noncopyable.h"
+
+namespace sylar
+{
+    class Scheduler;
+
+    // 一次性唤醒事件: 在调度器的任务协程中创建时挂起协程等待，否则阻塞线程等待
+    // 可以同时挂在多个等待队列上(如Channel的select)，只有第一次set生效
+    class FiberEvent : Noncopyable
+    {
+    public:
+        using ptr = std::shared_ptr<FiberEvent>;
+
+        // 记录当前协程(或线程)，之后只能由创建者调用wait
+        FiberEvent();
+
+        // 挂起直到被set，每个事件只能wait一次
+        void wait();
+        // 唤醒等待者，已经被set或cancel过时返回false
+        // 返回true后不再访问自身成员，等待者可以立即销毁事件
+        bool set();
+        // 不唤醒等待者地把事件标记为已触发，返回false说明已经被set，调用者仍需wait
+        bool cancel();
+        bool isSet() const { return m_set; }
+
+    private:
+        std::atomic<bool> m_set;
+        Scheduler* m_scheduler = nullptr;
+        Fiber::ptr m_fiber;
+        Semaphore m_sem;
+    };
+
+    // 协程互斥锁: 竞争时只挂起当前协程，不阻塞工作线程
+    // 解锁时直接把锁交给等待最久的协程(FIFO)
+    class FiberMutex : Noncopyable
+    {
+    public:
+        using Lock = ScopedLockImpl<FiberMutex>;
+
+        void lock();
+        bool tryLock();
+        void unlock();
+
+    private:
+        SpinLock m_mutex;
+        bool m_locked = false;
+        std::list<FiberEvent*> m_waiters;
+    };
+
+    // 协程条件变量，配合FiberMutex使用
+    class FiberCondition : Noncopyable
+    {
+    public:
+        // 释放lock并挂起，被唤醒后重新加锁
+        void wait(FiberMutex::Lock& lock);
+        void notify();
+        void notifyAll();
+
+    private:
+        SpinLock m_mutex;
+        std::list<FiberEvent*> m_waiters;
+    };
+
+    // 协程信号量
+    class FiberSemaphore : Noncopyable
+    {
+    public:
+        FiberSemaphore(uint32_t count = 0) : m_count(count) {}
+
+        void wait();
+        bool tryWait();
+        void notify();
+
+    private:
+        SpinLock m_mutex;
+        uint32_t m_count;
+        std::list<FiberEvent*> m_waiters;
+    };
+}
+
+#endif
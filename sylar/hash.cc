@@ -0,0 +1,230 @@
+#include "hash.h"
+#include <string.h>
+#include <endian.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace sylar
+{
+    static inline uint32_t ReadLE32(const unsigned char* p) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return le32toh(v);
+    }
+
+    static inline uint64_t ReadLE64(const unsigned char* p) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return le64toh(v);
+    }
+
+    static inline uint64_t Rotl64(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    // slicing-by-8的查表，table[k][i]为字节i后面再跟k个0字节的CRC
+    struct Crc32cTable
+    {
+        uint32_t table[8][256];
+
+        Crc32cTable() {
+            const uint32_t poly = 0x82F63B78;   // 0x1EDC6F41按位反转
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (int j = 0; j < 8; ++j) {
+                    crc = (crc >> 1) ^ (poly & (0 - (crc & 1)));
+                }
+                table[0][i] = crc;
+            }
+            for (uint32_t i = 0; i < 256; ++i) {
+                for (int k = 1; k < 8; ++k) {
+                    table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+                }
+            }
+        }
+    };
+
+    static const Crc32cTable& GetCrc32cTable() {
+        static Crc32cTable s_table;
+        return s_table;
+    }
+
+    uint32_t Crc32cExtendSoftware(uint32_t crc, const void* data, size_t len) {
+        const uint32_t (*t)[256] = GetCrc32cTable().table;
+        const unsigned char* p = (const unsigned char*)data;
+        crc = ~crc;
+        while (len >= 8) {
+            uint32_t lo = ReadLE32(p) ^ crc;
+            uint32_t hi = ReadLE32(p + 4);
+            crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff]
+                ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+                ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff]
+                ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+            p += 8;
+            len -= 8;
+        }
+        while (len > 0) {
+            crc = t[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+            ++p;
+            --len;
+        }
+        return ~crc;
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("sse4.2")))
+    static uint32_t Crc32cExtendHardware(uint32_t crc, const void* data, size_t len) {
+        const unsigned char* p = (const unsigned char*)data;
+        uint64_t crc64 = ~crc;
+        // 先按字节对齐到8字节
+        while (len > 0 && ((uintptr_t)p & 7)) {
+            crc64 = _mm_crc32_u8((uint32_t)crc64, *p);
+            ++p;
+            --len;
+        }
+        while (len >= 8) {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            crc64 = _mm_crc32_u64(crc64, v);
+            p += 8;
+            len -= 8;
+        }
+        uint32_t crc32 = (uint32_t)crc64;
+        while (len > 0) {
+            crc32 = _mm_crc32_u8(crc32, *p);
+            ++p;
+            --len;
+        }
+        return ~crc32;
+    }
+
+    static bool DetectCrc32cHardware() {
+        // 在其他静态初始化中调用时需要先初始化CPU信息
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.2");
+    }
+
+    // 静态初始化之前被调用时为false，使用查表实现，结果相同
+    static bool s_crc32c_hardware = DetectCrc32cHardware();
+#else
+    static bool s_crc32c_hardware = false;
+#endif
+
+    uint32_t Crc32cExtend(uint32_t crc, const void* data, size_t len) {
+#if defined(__x86_64__)
+        if (s_crc32c_hardware) {
+            return Crc32cExtendHardware(crc, data, len);
+        }
+#endif
+        return Crc32cExtendSoftware(crc, data, len);
+    }
+
+    bool Crc32cHardwareEnabled() {
+        return s_crc32c_hardware;
+    }
+
+    static const uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+    static const uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+    static const uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+    static const uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+    static const uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+    static inline uint64_t XXH64Round(uint64_t acc, uint64_t input) {
+        acc += input * XXH_PRIME64_2;
+        acc = Rotl64(acc, 31);
+        return acc * XXH_PRIME64_1;
+    }
+
+    static inline uint64_t XXH64Merge(uint64_t acc, uint64_t val) {
+        acc ^= XXH64Round(0, val);
+        return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+
+    XXHash64::XXHash64(uint64_t seed)
+        : m_seed(seed) {
+        m_v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        m_v[1] = seed + XXH_PRIME64_2;
+        m_v[2] = seed;
+        m_v[3] = seed - XXH_PRIME64_1;
+    }
+
+    void XXHash64::update(const void* data, size_t len) {
+        const unsigned char* p = (const unsigned char*)data;
+        m_total += len;
+        if (m_memSize + len < sizeof(m_mem)) {
+            memcpy(m_mem + m_memSize, p, len);
+            m_memSize += len;
+            return;
+        }
+        // 先补满上次剩下的数据
+        if (m_memSize > 0) {
+            size_t fill = sizeof(m_mem) - m_memSize;
+            memcpy(m_mem + m_memSize, p, fill);
+            for (int i = 0; i < 4; ++i) {
+                m_v[i] = XXH64Round(m_v[i], ReadLE64(m_mem + i * 8));
+            }
+            p += fill;
+            len -= fill;
+            m_memSize = 0;
+        }
+        while (len >= 32) {
+            m_v[0] = XXH64Round(m_v[0], ReadLE64(p));
+            m_v[1] = XXH64Round(m_v[1], ReadLE64(p + 8));
+            m_v[2] = XXH64Round(m_v[2], ReadLE64(p + 16));
+            m_v[3] = XXH64Round(m_v[3], ReadLE64(p + 24));
+            p += 32;
+            len -= 32;
+        }
+        if (len > 0) {
+            memcpy(m_mem, p, len);
+            m_memSize = len;
+        }
+    }
+
+    uint64_t XXHash64::digest() const {
+        uint64_t h;
+        if (m_total >= 32) {
+            h = Rotl64(m_v[0], 1) + Rotl64(m_v[1], 7) + Rotl64(m_v[2], 12) + Rotl64(m_v[3], 18);
+            for (int i = 0; i < 4; ++i) {
+                h = XXH64Merge(h, m_v[i]);
+            }
+        } else {
+            h = m_seed + XXH_PRIME64_5;
+        }
+        h += m_total;
+
+        const unsigned char* p = m_mem;
+        size_t len = m_memSize;
+        while (len >= 8) {
+            h ^= XXH64Round(0, ReadLE64(p));
+            h = Rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+            p += 8;
+            len -= 8;
+        }
+        if (len >= 4) {
+            h ^= (uint64_t)ReadLE32(p) * XXH_PRIME64_1;
+            h = Rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+            p += 4;
+            len -= 4;
+        }
+        while (len > 0) {
+            h ^= (*p) * XXH_PRIME64_5;
+            h = Rotl64(h, 11) * XXH_PRIME64_1;
+            ++p;
+            --len;
+        }
+        h ^= h >> 33;
+        h *= XXH_PRIME64_2;
+        h ^= h >> 29;
+        h *= XXH_PRIME64_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    uint64_t XXH64(const void* data, size_t len, uint64_t seed) {
+        XXHash64 hash(seed);
+        hash.update(data, len);
+        return hash.digest();
+    }
+}
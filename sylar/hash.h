@@ -0,0 +1,45 @@
+#ifndef __SYLAR_HASH_H__
+#define __SYLAR_HASH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace sylar
+{
+    // CRC32C(Castagnoli)，crc为之前数据的结果，可以分段计算
+    // x86_64上CPU支持SSE4.2时使用crc32指令，否则查表
+    uint32_t Crc32cExtend(uint32_t crc, const void* data, size_t len);
+
+    inline uint32_t Crc32c(const void* data, size_t len) {
+        return Crc32cExtend(0, data, len);
+    }
+
+    // 查表实现，用于测试和对比
+    uint32_t Crc32cExtendSoftware(uint32_t crc, const void* data, size_t len);
+
+    // 当前是否使用SSE4.2计算CRC32C
+    bool Crc32cHardwareEnabled();
+
+    // xxHash64，非加密的64位哈希，数据可以分多次update
+    class XXHash64
+    {
+    public:
+        XXHash64(uint64_t seed = 0);
+
+        void update(const void* data, size_t len);
+
+        // 不改变状态，可以继续update
+        uint64_t digest() const;
+
+    private:
+        uint64_t m_v[4];
+        uint64_t m_seed;
+        uint64_t m_total = 0;
+        unsigned char m_mem[32];    // 不足32字节的数据
+        size_t m_memSize = 0;
+    };
+
+    uint64_t XXH64(const void* data, size_t len, uint64_t seed = 0);
+}
+
+#endif
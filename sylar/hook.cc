@@ -7,6 +7,7 @@
 #include <dlfcn.h>
 #include <functional>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 
 #define HOOK_FUN(XX)    \
@@ -18,9 +19,13 @@
     XX(read)            \
     XX(recv)            \
     XX(recvfrom)        \
+    XX(readv)           \
+    XX(recvmsg)         \
     XX(write)           \
     XX(send)            \
     XX(sendto)          \
+    XX(writev)          \
+    XX(sendmsg)         \
     XX(close)           \
     XX(fcntl)           \
     XX(getsockopt)      \
@@ -72,6 +77,37 @@ struct timer_info
     int cancelled = 0;
 };
 
+// IO_URING后端下把请求交给io_uring，支持的函数返回true，结果放在n中
+template<typename OriginFun, typename... Args>
+static bool uring_io(sylar::IOManager* iom, OriginFun fun, uint64_t timeout, ssize_t& n, int fd, Args&&... args) {
+    return false;
+}
+
+static bool uring_io(sylar::IOManager* iom, read_fun fun, uint64_t timeout, ssize_t& n, int fd, void* buf, size_t count) {
+    n = iom->uringRead(fd, buf, count, timeout);
+    return true;
+}
+
+static bool uring_io(sylar::IOManager* iom, write_fun fun, uint64_t timeout, ssize_t& n, int fd, const void* buf, size_t count) {
+    n = iom->uringWrite(fd, buf, count, timeout);
+    return true;
+}
+
+static bool uring_io(sylar::IOManager* iom, recv_fun fun, uint64_t timeout, ssize_t& n, int fd, void* buf, size_t len, int flags) {
+    n = iom->uringRecv(fd, buf, len, flags, timeout);
+    return true;
+}
+
+static bool uring_io(sylar::IOManager* iom, send_fun fun, uint64_t timeout, ssize_t& n, int fd, const void* buf, size_t len, int flags) {
+    n = iom->uringSend(fd, buf, len, flags, timeout);
+    return true;
+}
+
+static bool uring_io(sylar::IOManager* iom, accept_fun fun, uint64_t timeout, ssize_t& n, int fd, struct sockaddr* addr, socklen_t* addrlen) {
+    n = iom->uringAccept(fd, addr, addrlen, timeout);
+    return true;
+}
+
 template<typename OriginFun, typename... Args>
 static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t event, int timeoutType, Args&&... args) {
     if (!sylar::t_hook_enable) {
@@ -98,6 +134,18 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t
         } while (n == -1 && errno == EINTR);
         if (n == -1 && errno == EAGAIN) {
             sylar::IOManager* iom = sylar::IOManager::GetThisIOManager();
+            // 系统调用立即完成时不经过io_uring，只有需要等待时才提交请求
+            if (iom->getBackend() == sylar::IOManager::IO_URING
+                && uring_io(iom, fun, timeout, n, fd, std::forward<Args>(args)...)) {
+                if (ctx->isClosed()) {
+                    errno = EBADF;
+                    return -1;
+                }
+                // 旧内核对非阻塞fd直接返回EAGAIN，退回epoll等待
+                if (n != -1 || errno != EAGAIN) {
+                    return n;
+                }
+            }
             sylar::Timer::ptr timer;
             std::weak_ptr<timer_info> winfo(tinfo);
             if (timeout != (uint64_t)-1) {
@@ -113,12 +161,25 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t
 
             int ret = iom->addEvent(fd, (sylar::IOManager::Event)(event));
             if (ret == -1) {
-                SYLAR_LOG_ERROR(g_logger) << hook_fun_name << " addEvent(" << fd << ", " << event << ")";
+                // 另一个线程的close已经关闭了fd
+                if (ctx->isClosed()) {
+                    errno = EBADF;
+                } else {
+                    SYLAR_LOG_ERROR(g_logger) << hook_fun_name << " addEvent(" << fd << ", " << event << ")";
+                }
                 if (timer) {
                     timer->cancel();
                 }
                 return -1;
             }
+            // 另一个线程的close在addEvent之前已经cancelAll，事件不会再被触发，自己删除后返回
+            if (ctx->isClosed() && iom->delEvent(fd, (sylar::IOManager::Event)(event))) {
+                if (timer) {
+                    timer->cancel();
+                }
+                errno = EBADF;
+                return -1;
+            }
             sylar::Fiber::YieldToHold();
             if (timer) {
                 timer->cancel();
@@ -127,6 +188,11 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t
                 errno = tinfo->cancelled;
                 return -1;
             }
+            // 等待期间被关闭，fd可能已被复用，不能再操作
+            if (ctx->isClosed()) {
+                errno = EBADF;
+                return -1;
+            }
             continue;
         }
         return n;
@@ -201,9 +267,22 @@ extern "C" {
         if (!ctx->isSocket() || ctx->getUserNonblock()) {
             return connect_f(sockfd, addr, addrlen);
         }
-        int n = connect_f(sockfd, addr, addrlen);
+        sylar::IOManager* iom = sylar::IOManager::GetThisIOManager();
+        int n = -1;
+        if (iom->getBackend() == sylar::IOManager::IO_URING) {
+            n = iom->uringConnect(sockfd, addr, addrlen, timeout_ms);
+            if (ctx->isClosed()) {
+                errno = EBADF;
+                return -1;
+            }
+            // 旧内核对非阻塞fd直接返回EINPROGRESS，退回epoll等待
+            if (n == -1 && errno == EAGAIN) {
+                errno = EINPROGRESS;
+            }
+        } else {
+            n = connect_f(sockfd, addr, addrlen);
+        }
         if (n == -1 && errno == EINPROGRESS) {
-            sylar::IOManager* iom = sylar::IOManager::GetThisIOManager();
             sylar::Timer::ptr timer;
             std::shared_ptr<timer_info> tinfo(new timer_info);
             std::weak_ptr<timer_info> winfo(tinfo);
@@ -260,6 +339,14 @@ extern "C" {
         return do_io(sockfd, recvfrom_f, "recv", sylar::IOManager::Event::READ, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);
     }
 
+    ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
+        return do_io(fd, readv_f, "readv", sylar::IOManager::Event::READ, SO_RCVTIMEO, iov, iovcnt);
+    }
+
+    ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags) {
+        return do_io(sockfd, recvmsg_f, "recvmsg", sylar::IOManager::Event::READ, SO_RCVTIMEO, msg, flags);
+    }
+
     ssize_t write(int fd, const void* buf, size_t count) {
         return do_io(fd, write_f, "write", sylar::IOManager::Event::WRITE, SO_SNDTIMEO, buf, count);
     }
@@ -272,12 +359,21 @@ extern "C" {
         return do_io(sockfd, sendto_f, "sendto", sylar::IOManager::Event::WRITE, SO_SNDTIMEO, buf, len, flags, dest_addr, addrlen);
     }
 
+    ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+        return do_io(fd, writev_f, "writev", sylar::IOManager::Event::WRITE, SO_SNDTIMEO, iov, iovcnt);
+    }
+
+    ssize_t sendmsg(int sockfd, const struct msghdr* msg, int flags) {
+        return do_io(sockfd, sendmsg_f, "sendmsg", sylar::IOManager::Event::WRITE, SO_SNDTIMEO, msg, flags);
+    }
+
     int close(int fd) {
         if (!sylar::t_hook_enable) {
             return close_f(fd);
         }
         sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
         if (ctx) {
+            ctx->setClosed(true);
             sylar::IOManager* iom = sylar::IOManager::GetThisIOManager();
             if (iom) {
                 iom->cancelAll(fd);
@@ -39,6 +39,12 @@ extern "C" {
     using recvfrom_fun = ssize_t(*)(int, void*, size_t, int, struct sockaddr*, socklen_t*);
     extern recvfrom_fun recvfrom_f;
 
+    using readv_fun = ssize_t(*)(int, const struct iovec*, int);
+    extern readv_fun readv_f;
+
+    using recvmsg_fun = ssize_t(*)(int, struct msghdr*, int);
+    extern recvmsg_fun recvmsg_f;
+
     // write
     using write_fun = ssize_t(*)(int, const void*, size_t);
     extern write_fun write_f;
@@ -49,6 +55,12 @@ extern "C" {
     using sendto_fun = ssize_t(*)(int, const void*, size_t, int, const struct sockaddr*, socklen_t);
     extern sendto_fun sendto_f;
 
+    using writev_fun = ssize_t(*)(int, const struct iovec*, int);
+    extern writev_fun writev_f;
+
+    using sendmsg_fun = ssize_t(*)(int, const struct msghdr*, int);
+    extern sendmsg_fun sendmsg_f;
+
     // close
     using close_fun = int(*)(int);
     extern close_fun close_f;
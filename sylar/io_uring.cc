@@ -0,0 +1,291 @@
+#include "io_uring.h"
+#include "log.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+// 需要5.19以上内核的头文件(按fd取消请求)
+#if defined(IORING_ASYNC_CANCEL_FD) && defined(__NR_io_uring_setup)
+#define SYLAR_HAVE_IO_URING 1
+#endif
+
+namespace sylar
+{
+    static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+#ifdef SYLAR_HAVE_IO_URING
+
+    static int sys_io_uring_setup(uint32_t entries, struct io_uring_params* p) {
+        return syscall(__NR_io_uring_setup, entries, p);
+    }
+
+    static int sys_io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+        return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+    }
+
+    static int sys_io_uring_register(int fd, uint32_t opcode, void* arg, uint32_t nr_args) {
+        return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+    }
+
+    IoUring::IoUring() {}
+
+    IoUring::~IoUring() {
+        if (m_sqes) {
+            munmap(m_sqes, m_sqesSize);
+        }
+        if (m_cqRing && m_cqRing != m_sqRing) {
+            munmap(m_cqRing, m_cqRingSize);
+        }
+        if (m_sqRing) {
+            munmap(m_sqRing, m_sqRingSize);
+        }
+        if (m_fd != -1) {
+            ::close(m_fd);
+        }
+    }
+
+    IoUring::ptr IoUring::Create(uint32_t entries) {
+        IoUring::ptr ring(new IoUring);
+        if (!ring->init(entries) || !ring->probe()) {
+            return nullptr;
+        }
+        return ring;
+    }
+
+    bool IoUring::init(uint32_t entries) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        m_fd = sys_io_uring_setup(entries, &params);
+        if (m_fd < 0) {
+            m_fd = -1;
+            SYLAR_LOG_WARN(g_logger) << "io_uring_setup(" << entries << ") errno=" << errno
+                << " errstr=" << strerror(errno);
+            return false;
+        }
+        m_features = params.features;
+        // 完成事件不丢失、提交时拷贝参数、socket读写由内核poll而不是占用io-wq线程
+        uint32_t required = IORING_FEAT_NODROP | IORING_FEAT_SUBMIT_STABLE | IORING_FEAT_FAST_POLL;
+        if ((m_features & required) != required) {
+            SYLAR_LOG_WARN(g_logger) << "io_uring features=" << m_features << " missing required features";
+            return false;
+        }
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single_mmap = m_features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        }
+        m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (m_sqRing == MAP_FAILED) {
+            m_sqRing = nullptr;
+            return false;
+        }
+        if (single_mmap) {
+            m_cqRing = m_sqRing;
+        } else {
+            m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+            if (m_cqRing == MAP_FAILED) {
+                m_cqRing = nullptr;
+                return false;
+            }
+        }
+        m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        m_sqes = (struct io_uring_sqe*)mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (m_sqes == MAP_FAILED) {
+            m_sqes = nullptr;
+            return false;
+        }
+
+        char* sq = (char*)m_sqRing;
+        m_sqHead = (uint32_t*)(sq + params.sq_off.head);
+        m_sqTail = (uint32_t*)(sq + params.sq_off.tail);
+        m_sqMask = *(uint32_t*)(sq + params.sq_off.ring_mask);
+        m_sqEntries = params.sq_entries;
+        m_sqeTail = *m_sqTail;
+        // SQ数组和SQE一一对应，之后只需要移动tail
+        uint32_t* array = (uint32_t*)(sq + params.sq_off.array);
+        for (uint32_t i = 0; i < m_sqEntries; ++i) {
+            array[i] = i;
+        }
+        static_assert(sizeof(Timespec) == sizeof(struct __kernel_timespec), "Timespec layout");
+        m_timeouts.resize(m_sqEntries);
+
+        char* cq = (char*)m_cqRing;
+        m_cqHead = (uint32_t*)(cq + params.cq_off.head);
+        m_cqTail = (uint32_t*)(cq + params.cq_off.tail);
+        m_cqMask = *(uint32_t*)(cq + params.cq_off.ring_mask);
+        m_cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    bool IoUring::probe() {
+        size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+        std::vector<char> buf(len, 0);
+        struct io_uring_probe* probe = (struct io_uring_probe*)&buf[0];
+        if (sys_io_uring_register(m_fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+            SYLAR_LOG_WARN(g_logger) << "io_uring probe errno=" << errno << " errstr=" << strerror(errno);
+            return false;
+        }
+        static const int s_ops[] = {
+            IORING_OP_READ, IORING_OP_WRITE, IORING_OP_RECV, IORING_OP_SEND,
+            IORING_OP_ACCEPT, IORING_OP_CONNECT, IORING_OP_LINK_TIMEOUT, IORING_OP_ASYNC_CANCEL
+        };
+        for (int op : s_ops) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                SYLAR_LOG_WARN(g_logger) << "io_uring op " << op << " not supported";
+                return false;
+            }
+        }
+        // 按fd取消需要5.19，旧内核会返回-EINVAL
+        if (!prepCancelFd(m_fd) || submit() != 1) {
+            return false;
+        }
+        if (sys_io_uring_enter(m_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0) {
+            return false;
+        }
+        uint64_t user_data = 0;
+        int res = 0;
+        if (!popCompletion(user_data, res) || res == -EINVAL) {
+            SYLAR_LOG_WARN(g_logger) << "io_uring cancel by fd not supported";
+            return false;
+        }
+        return true;
+    }
+
+    struct io_uring_sqe* IoUring::getSqe(uint32_t count) {
+        uint32_t head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if (m_sqeTail + count - head > m_sqEntries) {
+            return nullptr;
+        }
+        struct io_uring_sqe* sqe = &m_sqes[m_sqeTail & m_sqMask];
+        ++m_sqeTail;
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    bool IoUring::prepRw(int op, int fd, uint64_t addr, uint32_t len, uint64_t off,
+            uint64_t user_data, uint64_t timeout_ms, uint32_t op_flags) {
+        struct io_uring_sqe* sqe = getSqe(timeout_ms == ~0ull ? 1 : 2);
+        if (!sqe) {
+            return false;
+        }
+        sqe->opcode = op;
+        sqe->fd = fd;
+        sqe->addr = addr;
+        sqe->len = len;
+        sqe->off = off;
+        sqe->rw_flags = op_flags;
+        sqe->user_data = user_data;
+        if (timeout_ms != ~0ull) {
+            sqe->flags |= IOSQE_IO_LINK;
+            // 时间在提交时由内核拷贝(IORING_FEAT_SUBMIT_STABLE)
+            Timespec& ts = m_timeouts[m_sqeTail & m_sqMask];
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+            struct io_uring_sqe* tsqe = getSqe();
+            tsqe->opcode = IORING_OP_LINK_TIMEOUT;
+            tsqe->fd = -1;
+            tsqe->addr = (uint64_t)&ts;
+            tsqe->len = 1;
+            tsqe->user_data = 0;
+        }
+        return true;
+    }
+
+    bool IoUring::prepRead(int fd, void* buf, size_t len, uint64_t user_data, uint64_t timeout_ms) {
+        // offset为-1时使用(并更新)文件当前位置，与read一致
+        return prepRw(IORING_OP_READ, fd, (uint64_t)buf, len, (uint64_t)-1, user_data, timeout_ms);
+    }
+
+    bool IoUring::prepWrite(int fd, const void* buf, size_t len, uint64_t user_data, uint64_t timeout_ms) {
+        return prepRw(IORING_OP_WRITE, fd, (uint64_t)buf, len, (uint64_t)-1, user_data, timeout_ms);
+    }
+
+    bool IoUring::prepRecv(int fd, void* buf, size_t len, int flags, uint64_t user_data, uint64_t timeout_ms) {
+        return prepRw(IORING_OP_RECV, fd, (uint64_t)buf, len, 0, user_data, timeout_ms, flags);
+    }
+
+    bool IoUring::prepSend(int fd, const void* buf, size_t len, int flags, uint64_t user_data, uint64_t timeout_ms) {
+        return prepRw(IORING_OP_SEND, fd, (uint64_t)buf, len, 0, user_data, timeout_ms, flags);
+    }
+
+    bool IoUring::prepAccept(int fd, struct sockaddr* addr, socklen_t* addrlen, uint64_t user_data, uint64_t timeout_ms) {
+        return prepRw(IORING_OP_ACCEPT, fd, (uint64_t)addr, 0, (uint64_t)addrlen, user_data, timeout_ms);
+    }
+
+    bool IoUring::prepConnect(int fd, const struct sockaddr* addr, socklen_t addrlen, uint64_t user_data, uint64_t timeout_ms) {
+        return prepRw(IORING_OP_CONNECT, fd, (uint64_t)addr, 0, addrlen, user_data, timeout_ms);
+    }
+
+    bool IoUring::prepCancelFd(int fd) {
+        return prepRw(IORING_OP_ASYNC_CANCEL, fd, 0, 0, 0, 0, ~0ull,
+            IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL);
+    }
+
+    int IoUring::submit() {
+        uint32_t tail = *m_sqTail;
+        uint32_t count = m_sqeTail - tail;
+        if (count == 0) {
+            return 0;
+        }
+        __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+        while (true) {
+            int rt = sys_io_uring_enter(m_fd, count, 0, 0);
+            if (rt >= 0) {
+                return rt;
+            }
+            if (errno != EINTR) {
+                return -errno;
+            }
+        }
+    }
+
+    bool IoUring::popCompletion(uint64_t& user_data, int& res) {
+        uint32_t head = *m_cqHead;
+        if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        struct io_uring_cqe* cqe = &m_cqes[head & m_cqMask];
+        user_data = cqe->user_data;
+        res = cqe->res;
+        __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+#else
+
+    IoUring::IoUring() {}
+    IoUring::~IoUring() {}
+
+    IoUring::ptr IoUring::Create(uint32_t entries) {
+        SYLAR_LOG_WARN(g_logger) << "io_uring not available at compile time";
+        return nullptr;
+    }
+
+    bool IoUring::prepRead(int, void*, size_t, uint64_t, uint64_t) { return false; }
+    bool IoUring::prepWrite(int, const void*, size_t, uint64_t, uint64_t) { return false; }
+    bool IoUring::prepRecv(int, void*, size_t, int, uint64_t, uint64_t) { return false; }
+    bool IoUring::prepSend(int, const void*, size_t, int, uint64_t, uint64_t) { return false; }
+    bool IoUring::prepAccept(int, struct sockaddr*, socklen_t*, uint64_t, uint64_t) { return false; }
+    bool IoUring::prepConnect(int, const struct sockaddr*, socklen_t, uint64_t, uint64_t) { return false; }
+    bool IoUring::prepCancelFd(int) { return false; }
+    int IoUring::submit() { return -ENOSYS; }
+    bool IoUring::popCompletion(uint64_t&, int&) { return false; }
+
+#endif
+}
@@ -0,0 +1,84 @@
+#ifndef __SYLAR_IO_URING_H__
+#define __SYLAR_IO_URING_H__
+
+#include <memory>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+#include "noncopyable.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace sylar
+{
+    // 不依赖liburing的io_uring封装，只提供IOManager需要的操作
+    // 本身不加锁，提交和收割需要由调用者分别串行化
+    class IoUring : Noncopyable
+    {
+    public:
+        using ptr = std::shared_ptr<IoUring>;
+
+        // 内核(或编译时的头文件)不支持io_uring、缺少所需的操作或特性时返回nullptr
+        static IoUring::ptr Create(uint32_t entries);
+        ~IoUring();
+
+        int getFd() const { return m_fd; }
+
+        // 以下函数在SQ中放入一个请求，SQ空间不够时返回false
+        // timeout_ms不为~0ull时链接一个超时请求，超时后请求以-ECANCELED完成
+        bool prepRead(int fd, void* buf, size_t len, uint64_t user_data, uint64_t timeout_ms);
+        bool prepWrite(int fd, const void* buf, size_t len, uint64_t user_data, uint64_t timeout_ms);
+        bool prepRecv(int fd, void* buf, size_t len, int flags, uint64_t user_data, uint64_t timeout_ms);
+        bool prepSend(int fd, const void* buf, size_t len, int flags, uint64_t user_data, uint64_t timeout_ms);
+        bool prepAccept(int fd, struct sockaddr* addr, socklen_t* addrlen, uint64_t user_data, uint64_t timeout_ms);
+        bool prepConnect(int fd, const struct sockaddr* addr, socklen_t addrlen, uint64_t user_data, uint64_t timeout_ms);
+        // 取消fd上所有未完成的请求，完成事件的user_data为0
+        bool prepCancelFd(int fd);
+
+        // 提交所有放入的请求，返回提交的数量，失败时返回-errno
+        int submit();
+        // 取出一个完成事件，没有时返回false
+        bool popCompletion(uint64_t& user_data, int& res);
+
+    private:
+        IoUring();
+        bool init(uint32_t entries);
+        bool probe();
+        // 取一个清零的SQE，count为需要连续取的个数
+        struct io_uring_sqe* getSqe(uint32_t count = 1);
+        bool prepRw(int op, int fd, uint64_t addr, uint32_t len, uint64_t off,
+            uint64_t user_data, uint64_t timeout_ms, uint32_t op_flags = 0);
+
+    private:
+        // 与__kernel_timespec布局相同
+        struct Timespec
+        {
+            int64_t tv_sec;
+            int64_t tv_nsec;
+        };
+
+        int m_fd = -1;
+        uint32_t m_features = 0;
+        // SQ
+        void* m_sqRing = nullptr;
+        size_t m_sqRingSize = 0;
+        uint32_t* m_sqHead = nullptr;
+        uint32_t* m_sqTail = nullptr;
+        uint32_t m_sqMask = 0;
+        uint32_t m_sqEntries = 0;
+        uint32_t m_sqeTail = 0;                     // 本地已放入但未提交的位置
+        struct io_uring_sqe* m_sqes = nullptr;
+        size_t m_sqesSize = 0;
+        std::vector<Timespec> m_timeouts;           // 链接超时请求的时间，按SQE下标存放到提交为止
+        // CQ
+        void* m_cqRing = nullptr;
+        size_t m_cqRingSize = 0;
+        uint32_t* m_cqHead = nullptr;
+        uint32_t* m_cqTail = nullptr;
+        uint32_t m_cqMask = 0;
+        struct io_uring_cqe* m_cqes = nullptr;
+    };
+}
+
+#endif
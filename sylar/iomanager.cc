@@ -1,59 +1,164 @@
 #include "iomanager.h"
+#include "io_uring.h"
+#include "config.h"
 #include "macro.h"
 #include "log.h"
+#include "fd_manager.h"
+#include "util.h"
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <stdlib.h>
+#include <new>
 
 namespace sylar
 {
 
     static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+    static ConfigVar<std::string>::ptr g_iomanager_backend =
+        Config::Add("iomanager.backend", std::string("epoll"), "iomanager io backend: epoll or io_uring");
+
+    static ConfigVar<uint32_t>::ptr g_iomanager_uring_entries =
+        Config::Add("iomanager.io_uring.entries", (uint32_t)256, "io_uring submission queue size");
+
+    static ConfigVar<bool>::ptr g_iomanager_persistent_epoll =
+        Config::Add("iomanager.persistent_epoll", false, "keep fds registered in epoll until close");
+
+    static ConfigVar<bool>::ptr g_iomanager_multi_reactor =
+        Config::Add("iomanager.multi_reactor", false, "one epoll instance per worker thread");
+
+    static ConfigVar<std::string>::ptr g_iomanager_reactor_balance =
+        Config::Add("iomanager.reactor_balance", std::string("round_robin"), "how new connections pick a reactor: round_robin or load");
+
+    static IOManager::Backend s_iomanager_backend = IOManager::EPOLL;
+    static uint32_t s_iomanager_uring_entries = 256;
+    static bool s_iomanager_persistent_epoll = false;
+    static bool s_iomanager_multi_reactor = false;
+    static bool s_iomanager_balance_by_load = false;
+
+    // 另一个线程关闭fd后内核已把它从epoll中移除，此时删除或修改失败，但等待的协程仍要处理
+    static bool is_closed_fd_error(int err) {
+        return err == EBADF || err == ENOENT;
+    }
+
+    struct _IOManagerIniter
+    {
+        static IOManager::Backend ParseBackend(const std::string& name) {
+            if (name == "io_uring") {
+                return IOManager::IO_URING;
+            }
+            if (name != "epoll") {
+                SYLAR_LOG_ERROR(g_logger) << "unknown iomanager.backend " << name << ", use epoll";
+            }
+            return IOManager::EPOLL;
+        }
+
+        _IOManagerIniter() {
+            s_iomanager_backend = ParseBackend(g_iomanager_backend->getValue());
+            s_iomanager_uring_entries = g_iomanager_uring_entries->getValue();
+            s_iomanager_persistent_epoll = g_iomanager_persistent_epoll->getValue();
+            s_iomanager_multi_reactor = g_iomanager_multi_reactor->getValue();
+            s_iomanager_balance_by_load = g_iomanager_reactor_balance->getValue() == "load";
+
+            g_iomanager_backend->addListener([](const std::string& old_value, const std::string& new_value) {
+                SYLAR_LOG_INFO(g_logger) << "iomanager backend changed from " << old_value << " to " << new_value;
+                s_iomanager_backend = ParseBackend(new_value);
+            });
+            g_iomanager_uring_entries->addListener([](const uint32_t& old_value, const uint32_t& new_value) {
+                s_iomanager_uring_entries = new_value;
+            });
+            g_iomanager_persistent_epoll->addListener([](const bool& old_value, const bool& new_value) {
+                SYLAR_LOG_INFO(g_logger) << "iomanager persistent_epoll changed from " << old_value << " to " << new_value;
+                s_iomanager_persistent_epoll = new_value;
+            });
+            g_iomanager_multi_reactor->addListener([](const bool& old_value, const bool& new_value) {
+                SYLAR_LOG_INFO(g_logger) << "iomanager multi_reactor changed from " << old_value << " to " << new_value;
+                s_iomanager_multi_reactor = new_value;
+            });
+            g_iomanager_reactor_balance->addListener([](const std::string& old_value, const std::string& new_value) {
+                SYLAR_LOG_INFO(g_logger) << "iomanager reactor_balance changed from " << old_value << " to " << new_value;
+                s_iomanager_balance_by_load = new_value == "load";
+            });
+        }
+    };
+
+    static _IOManagerIniter s_iomanager_initer;
+
     IOManager* IOManager::GetThisIOManager() {
         return dynamic_cast<IOManager*>(Scheduler::GetThisScheduler());
     }
 
-    IOManager::IOManager(size_t threadCount, bool usecaller, const std::string& name)
-        : Scheduler(threadCount, usecaller, name) {
-        m_epollfd = epoll_create(1);
-        SYLAR_ASSERT(m_epollfd != -1);
-        m_eventfd = eventfd(0, EFD_NONBLOCK);
-        SYLAR_ASSERT(m_eventfd != -1);
+    IOManager::IOManager(size_t threadCount, bool usecaller, const std::string& name, Backend backend)
+        : Scheduler(threadCount, usecaller, name)
+        , m_persistent(s_iomanager_persistent_epoll)
+        , m_multiReactor(s_iomanager_multi_reactor) {
         struct epoll_event event;
         memset(&event, 0, sizeof(event));
         event.events = EPOLLET | EPOLLIN;
-        event.data.fd = m_eventfd;
-        int ret = epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_eventfd, &event);
-        SYLAR_ASSERT(ret != -1);
-        contextResize(32);
+        size_t reactors = m_multiReactor ? getWorkerCount() : 1;
+        for (size_t i = 0; i < reactors; ++i) {
+            Reactor* reactor = new Reactor();
+            reactor->epollfd = epoll_create(1);
+            SYLAR_ASSERT(reactor->epollfd != -1);
+            reactor->eventfd = eventfd(0, EFD_NONBLOCK);
+            SYLAR_ASSERT(reactor->eventfd != -1);
+            event.data.fd = reactor->eventfd;
+            int ret = epoll_ctl(reactor->epollfd, EPOLL_CTL_ADD, reactor->eventfd, &event);
+            SYLAR_ASSERT(ret != -1);
+            m_reactors.push_back(reactor);
+        }
+        if (backend == Backend::DEFAULT) {
+            backend = s_iomanager_backend;
+        }
+        if (backend == Backend::IO_URING) {
+            // io_uring的fd在有完成事件时可读，放进epoll，空闲线程仍然只等待epoll
+            // 多reactor模式下只放进第一个epoll，避免每次完成都唤醒所有线程
+            m_uring = IoUring::Create(s_iomanager_uring_entries);
+            if (m_uring) {
+                event.data.fd = m_uring->getFd();
+                int ret = epoll_ctl(m_reactors[0]->epollfd, EPOLL_CTL_ADD, m_uring->getFd(), &event);
+                SYLAR_ASSERT(ret != -1);
+                m_backend = Backend::IO_URING;
+            } else {
+                SYLAR_LOG_WARN(g_logger) << "IOManager " << name << " io_uring not supported, fallback to epoll";
+            }
+        }
+        for (size_t i = 0; i < FD_SEGMENT_COUNT; ++i) {
+            m_fdSegments[i].store(nullptr, std::memory_order_relaxed);
+        }
         start();
     }
 
     IOManager::~IOManager() {
         stop();
-        close(m_eventfd);
-        close(m_epollfd);
-        for (size_t i = 0; i < m_fdContexts.size(); ++i) {
-            if (m_fdContexts[i]) {
-                delete m_fdContexts[i];
+        m_uring.reset();
+        for (Reactor* reactor : m_reactors) {
+            close(reactor->eventfd);
+            close(reactor->epollfd);
+            delete reactor;
+        }
+        for (size_t i = 0; i < FD_SEGMENT_COUNT; ++i) {
+            FdSegment* segment = m_fdSegments[i].load(std::memory_order_relaxed);
+            if (!segment) {
+                continue;
+            }
+            for (size_t j = 0; j < FD_SEGMENT_SIZE; ++j) {
+                delete segment->contexts[j].load(std::memory_order_relaxed);
             }
+            delete segment;
         }
     }
 
     int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
-        FdContext* fdcontext;
-        {
-            RWMutexType::ReadLock readlock(m_mutex);
-            if (fd < (int)m_fdContexts.size()) {
-                fdcontext = m_fdContexts[fd];
-            } else {
-                readlock.unlock();
-                RWMutexType::WriteLock writelock(m_mutex);
-                contextResize(fd * 1.5);
-                fdcontext = m_fdContexts[fd];
-            }
+        FdContext* fdcontext = getFdContext(fd, true);
+        if (!fdcontext) {
+            SYLAR_LOG_ERROR(g_logger) << "addEvent fd=" << fd << " out of range";
+            return -1;
+        }
+        if (m_persistent) {
+            return addPersistentEvent(fdcontext, event, cb);
         }
         FdContext::MutexType::Lock lock(fdcontext->mutex);
         if (fdcontext->events & event) {
@@ -63,16 +168,24 @@ namespace sylar
             SYLAR_ASSERT(false);
         }
         int op = fdcontext->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        Reactor* reactor = fdcontext->events ? fdcontext->reactor : getThisReactor();
         struct epoll_event epollevent;
         memset(&epollevent, 0, sizeof(epollevent));
         epollevent.events = EPOLLET | fdcontext->events | event;
         epollevent.data.ptr = fdcontext;
-        int ret = epoll_ctl(m_epollfd, op, fd, &epollevent);
+        int ret = epoll_ctl(reactor->epollfd, op, fd, &epollevent);
         if (ret == -1) {
-            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epollfd << ", "
-                << op << ", " << fd << ", " << epollevent.events << "): " << strerror(errno);
+            // fd被其他线程关闭时由调用者判断是否是错误
+            if (errno != EBADF) {
+                SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << reactor->epollfd << ", "
+                    << op << ", " << fd << ", " << epollevent.events << "): " << strerror(errno);
+            }
             return -1;
         }
+        if (op == EPOLL_CTL_ADD) {
+            fdcontext->reactor = reactor;
+            ++reactor->fdCount;
+        }
         ++m_pendingEventCount;
         fdcontext->events = (Event)(fdcontext->events | event);
         EventContext& eventContext = fdcontext->getContext(event);
@@ -89,27 +202,32 @@ namespace sylar
     }
 
     bool IOManager::delEvent(int fd, Event event) {
-        RWMutex::ReadLock readlock(m_mutex);
-        if (fd >= (int)m_fdContexts.size()) {
+        FdContext* fdcontext = getFdContext(fd, false);
+        if (!fdcontext) {
             return false;
         }
-        FdContext* fdcontext = m_fdContexts[fd];
-        readlock.unlock();
         FdContext::MutexType::Lock lock(fdcontext->mutex);
         if (!(fdcontext->events & event)) {
             return false;
         }
         Event newEvents = (Event)(fdcontext->events & ~event);
-        int op = newEvents ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-        struct epoll_event epollevent;
-        memset(&epollevent, 0, sizeof(epollevent));
-        epollevent.events = EPOLLET | newEvents;
-        epollevent.data.ptr = fdcontext;
-        int ret = epoll_ctl(m_epollfd, op, fd, &epollevent);
-        if (ret == -1) {
-            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epollfd << ", "
-                << op << ", " << fd << ", " << epollevent.events << "): " << strerror(errno);
-            return false;
+        // 持久注册模式下fd保持注册，只去掉等待者
+        if (!m_persistent) {
+            int op = newEvents ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+            struct epoll_event epollevent;
+            memset(&epollevent, 0, sizeof(epollevent));
+            epollevent.events = EPOLLET | newEvents;
+            epollevent.data.ptr = fdcontext;
+            int ret = epoll_ctl(fdcontext->reactor->epollfd, op, fd, &epollevent);
+            if (ret == -1 && !is_closed_fd_error(errno)) {
+                SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << fdcontext->reactor->epollfd << ", "
+                    << op << ", " << fd << ", " << epollevent.events << "): " << strerror(errno);
+                return false;
+            }
+            if (op == EPOLL_CTL_DEL) {
+                --fdcontext->reactor->fdCount;
+                fdcontext->reactor = nullptr;
+            }
         }
         --m_pendingEventCount;
         fdcontext->events = newEvents;
@@ -119,27 +237,32 @@ namespace sylar
 
     // // 取消事件，如果事件存在则触发事件
     bool IOManager::cancelEvent(int fd, Event event) {
-        RWMutex::ReadLock readlock(m_mutex);
-        if (fd >= (int)m_fdContexts.size()) {
+        FdContext* fdcontext = getFdContext(fd, false);
+        if (!fdcontext) {
             return false;
         }
-        FdContext* fdcontext = m_fdContexts[fd];
-        readlock.unlock();
         FdContext::MutexType::Lock lock(fdcontext->mutex);
         if (!(fdcontext->events & event)) {
             return false;
         }
         Event newEvents = (Event)(fdcontext->events & ~event);
-        int op = newEvents ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-        struct epoll_event epollevent;
-        memset(&epollevent, 0, sizeof(epollevent));
-        epollevent.events = EPOLLET | newEvents;
-        epollevent.data.ptr = fdcontext;
-        int ret = epoll_ctl(m_epollfd, op, fd, &epollevent);
-        if (ret == -1) {
-            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epollfd << ", "
-                << op << ", " << fd << ", " << epollevent.events << "): " << strerror(errno);
-            return false;
+        // 持久注册模式下fd保持注册，只去掉等待者
+        if (!m_persistent) {
+            int op = newEvents ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+            struct epoll_event epollevent;
+            memset(&epollevent, 0, sizeof(epollevent));
+            epollevent.events = EPOLLET | newEvents;
+            epollevent.data.ptr = fdcontext;
+            int ret = epoll_ctl(fdcontext->reactor->epollfd, op, fd, &epollevent);
+            if (ret == -1 && !is_closed_fd_error(errno)) {
+                SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << fdcontext->reactor->epollfd << ", "
+                    << op << ", " << fd << ", " << epollevent.events << "): " << strerror(errno);
+                return false;
+            }
+            if (op == EPOLL_CTL_DEL) {
+                --fdcontext->reactor->fdCount;
+                fdcontext->reactor = nullptr;
+            }
         }
         --m_pendingEventCount;
         fdcontext->triggerEvent(event);
@@ -147,22 +270,43 @@ namespace sylar
     }
 
     bool IOManager::cancelAll(int fd) {
-        RWMutex::ReadLock readlock(m_mutex);
-        if (fd >= (int)m_fdContexts.size()) {
+        if (m_uring) {
+            // 取消fd上未完成的io_uring请求，等待的协程以-ECANCELED恢复
+            MutexType::Lock lock(m_uringSubmitMutex);
+            if (m_uring->prepCancelFd(fd)) {
+                m_uring->submit();
+            }
+        }
+        FdContext* fdcontext = getFdContext(fd, false);
+        if (!fdcontext) {
             return false;
         }
-        FdContext* fdcontext = m_fdContexts[fd];
-        readlock.unlock();
 
         FdContext::MutexType::Lock lock(fdcontext->mutex);
-        if (!fdcontext->events) {
-            return false;
-        }
-        int ret = epoll_ctl(m_epollfd, EPOLL_CTL_DEL, fd, NULL);
-        if (ret == -1) {
-            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epollfd << ", "
-                << EPOLL_CTL_DEL << ", " << fd << "): " << strerror(errno);
-            return false;
+        if (m_persistent) {
+            // fd即将关闭，编号可能被新的fd复用，清除注册状态和残留的就绪事件
+            if (fdcontext->registered) {
+                epoll_ctl(fdcontext->reactor->epollfd, EPOLL_CTL_DEL, fd, NULL);
+                --fdcontext->reactor->fdCount;
+                fdcontext->reactor = nullptr;
+                fdcontext->registered = false;
+            }
+            fdcontext->ready = Event::NONE;
+            if (!fdcontext->events) {
+                return false;
+            }
+        } else {
+            if (!fdcontext->events) {
+                return false;
+            }
+            int ret = epoll_ctl(fdcontext->reactor->epollfd, EPOLL_CTL_DEL, fd, NULL);
+            if (ret == -1 && !is_closed_fd_error(errno)) {
+                SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << fdcontext->reactor->epollfd << ", "
+                    << EPOLL_CTL_DEL << ", " << fd << "): " << strerror(errno);
+                return false;
+            }
+            --fdcontext->reactor->fdCount;
+            fdcontext->reactor = nullptr;
         }
         if (fdcontext->events & Event::READ) {
             --m_pendingEventCount;
@@ -176,25 +320,217 @@ namespace sylar
         return true;
     }
 
-    void IOManager::contextResize(size_t size) {
-        m_fdContexts.resize(size);
-        for (size_t i = 0; i < m_fdContexts.size(); ++i) {
-            if (!m_fdContexts[i]) {
-                m_fdContexts[i] = new FdContext();
-                m_fdContexts[i]->fd = i;
+    int IOManager::addPersistentEvent(FdContext* fdcontext, Event event, std::function<void()>& cb) {
+        Scheduler* scheduler = Scheduler::GetThisScheduler();
+        // 快速路径: 已注册且边沿已到达，取走就绪标志后直接调度，不需要加锁和系统调用
+        if (fdcontext->registered && (fdcontext->ready.fetch_and(~event) & event)) {
+            if (cb) {
+                scheduler->schedule(cb);
+            } else {
+                scheduler->schedule(Fiber::GetThis()->shared_from_this());
+            }
+            return 0;
+        }
+        FdContext::MutexType::Lock lock(fdcontext->mutex);
+        if (fdcontext->events & event) {
+            SYLAR_LOG_ERROR(g_logger) << "addEvent assert fd=" << fdcontext->fd
+                << " event=" << event
+                << " fdcontext->events=" << fdcontext->events;
+            SYLAR_ASSERT(false);
+        }
+        if (!fdcontext->registered) {
+            Reactor* reactor = getThisReactor();
+            struct epoll_event epollevent;
+            memset(&epollevent, 0, sizeof(epollevent));
+            epollevent.events = EPOLLET | EPOLLIN | EPOLLOUT;
+            epollevent.data.ptr = fdcontext;
+            int ret = epoll_ctl(reactor->epollfd, EPOLL_CTL_ADD, fdcontext->fd, &epollevent);
+            if (ret == -1) {
+                if (errno != EBADF) {
+                    SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << reactor->epollfd << ", "
+                        << EPOLL_CTL_ADD << ", " << fdcontext->fd << ", " << epollevent.events << "): " << strerror(errno);
+                }
+                return -1;
+            }
+            fdcontext->reactor = reactor;
+            ++reactor->fdCount;
+            fdcontext->ready = Event::NONE;
+            fdcontext->registered = true;
+        } else if (fdcontext->ready.fetch_and(~event) & event) {
+            // 检查之后、加锁之前到达的边沿
+            if (cb) {
+                scheduler->schedule(cb);
+            } else {
+                scheduler->schedule(Fiber::GetThis()->shared_from_this());
+            }
+            return 0;
+        }
+        ++m_pendingEventCount;
+        fdcontext->events = (Event)(fdcontext->events | event);
+        EventContext& eventContext = fdcontext->getContext(event);
+        SYLAR_ASSERT(!eventContext.scheduler && !eventContext.fiber && !eventContext.cb);
+        eventContext.scheduler = scheduler;
+        if (cb) {
+            eventContext.cb.swap(cb);
+        } else {
+            eventContext.fiber = Fiber::GetThis()->shared_from_this();
+            SYLAR_ASSERT2(eventContext.fiber->getState() == Fiber::State::EXEC,
+                "state=" << eventContext.fiber->getState());
+        }
+        return 0;
+    }
+
+    void IOManager::triggerPersistent(FdContext* fdcontext, uint32_t events, int thread) {
+        uint32_t real_events = Event::NONE;
+        if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            real_events |= Event::READ;
+        }
+        if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+            real_events |= Event::WRITE;
+        }
+        FdContext::MutexType::Lock lock(fdcontext->mutex);
+        if (!fdcontext->registered) {
+            return;
+        }
+        // 有等待者时直接唤醒，否则锁存起来留给下一次addEvent
+        uint32_t latch = real_events & ~fdcontext->events;
+        if (latch) {
+            fdcontext->ready.fetch_or(latch);
+        }
+        if (real_events & fdcontext->events & Event::READ) {
+            fdcontext->triggerEvent(Event::READ, thread);
+            --m_pendingEventCount;
+        }
+        if (real_events & fdcontext->events & Event::WRITE) {
+            fdcontext->triggerEvent(Event::WRITE, thread);
+            --m_pendingEventCount;
+        }
+    }
+
+    IOManager::FdContext* IOManager::getFdContext(int fd, bool auto_create) {
+        if (fd < 0 || (size_t)fd >= FD_SEGMENT_SIZE * FD_SEGMENT_COUNT) {
+            return nullptr;
+        }
+        std::atomic<FdSegment*>& slot = m_fdSegments[fd >> FD_SEGMENT_BITS];
+        FdSegment* segment = slot.load(std::memory_order_acquire);
+        if (!segment) {
+            if (!auto_create) {
+                return nullptr;
+            }
+            // 值初始化把所有指针清零
+            FdSegment* created = new FdSegment();
+            if (slot.compare_exchange_strong(segment, created, std::memory_order_acq_rel)) {
+                segment = created;
+            } else {
+                delete created;
+            }
+        }
+        std::atomic<FdContext*>& entry = segment->contexts[fd & (FD_SEGMENT_SIZE - 1)];
+        FdContext* fdcontext = entry.load(std::memory_order_acquire);
+        if (!fdcontext && auto_create) {
+            FdContext* created = new FdContext();
+            created->fd = fd;
+            if (entry.compare_exchange_strong(fdcontext, created, std::memory_order_acq_rel)) {
+                fdcontext = created;
+            } else {
+                delete created;
             }
         }
+        return fdcontext;
     }
 
     // ----------------------------------------------------------
     void IOManager::tickle() {
-        if (hasIdleThreads()) {
-            uint64_t one = 1;
-            ssize_t ret = write(m_eventfd, &one, sizeof(uint64_t));
-            SYLAR_ASSERT(ret == sizeof(uint64_t));
+        if (!hasIdleThreads()) {
+            return;
+        }
+        if (!m_multiReactor) {
+            wakeup(m_reactors[0]);
+            return;
+        }
+        // 唤醒一个正在epoll_wait的线程，清除sleeping标志避免连续的tickle重复唤醒同一个
+        // 还没有标记sleeping的空闲线程在epoll_wait之前会检查队列，不需要唤醒
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        size_t count = m_reactors.size();
+        size_t begin = m_nextReactor++;
+        for (size_t i = 0; i < count; ++i) {
+            Reactor* reactor = m_reactors[(begin + i) % count];
+            bool expected = true;
+            if (reactor->sleeping.compare_exchange_strong(expected, false)) {
+                wakeup(reactor);
+                return;
+            }
         }
     }
 
+    void IOManager::tickleThread(int thread_id) {
+        if (!m_multiReactor || thread_id == -1) {
+            tickle();
+            return;
+        }
+        // 指定线程的任务只有该线程能执行，必须唤醒它自己的epoll
+        if (thread_id == sylar::GetThreadId()) {
+            return;
+        }
+        for (size_t i = 0; i < m_reactors.size(); ++i) {
+            if (getWorkerThreadId(i) == thread_id) {
+                m_reactors[i]->sleeping = false;
+                wakeup(m_reactors[i]);
+                return;
+            }
+        }
+        tickle();
+    }
+
+    void IOManager::wakeup(Reactor* reactor) {
+        uint64_t one = 1;
+        ssize_t ret = write(reactor->eventfd, &one, sizeof(uint64_t));
+        SYLAR_ASSERT(ret == sizeof(uint64_t));
+    }
+
+    IOManager::Reactor* IOManager::getThisReactor() {
+        if (!m_multiReactor) {
+            return m_reactors[0];
+        }
+        int index = getThisWorkerIndex();
+        if (index >= 0) {
+            return m_reactors[index];
+        }
+        // 不在工作线程中，轮询选择一个在运行的线程
+        size_t count = m_reactors.size();
+        size_t begin = m_nextReactor++;
+        for (size_t i = 0; i < count; ++i) {
+            size_t idx = (begin + i) % count;
+            if (getWorkerThreadId(idx) != m_rootThreadId) {
+                return m_reactors[idx];
+            }
+        }
+        return m_reactors[begin % count];
+    }
+
+    int IOManager::pickReactorThread() {
+        if (!m_multiReactor) {
+            return -1;
+        }
+        // usecaller时caller线程只在stop()中执行任务，不分配连接
+        size_t count = m_reactors.size();
+        size_t begin = m_nextReactor++;
+        int best = -1;
+        for (size_t i = 0; i < count; ++i) {
+            size_t idx = (begin + i) % count;
+            if (getWorkerThreadId(idx) == m_rootThreadId && count > 1) {
+                continue;
+            }
+            if (!s_iomanager_balance_by_load) {
+                return getWorkerThreadId(idx);
+            }
+            if (best == -1 || m_reactors[idx]->fdCount < m_reactors[best]->fdCount) {
+                best = idx;
+            }
+        }
+        return best == -1 ? -1 : getWorkerThreadId(best);
+    }
+
     bool IOManager::stopping() {
         uint64_t timeout = 0;
         return stopping(timeout);
@@ -216,10 +552,15 @@ namespace sylar
         const uint64_t MAX_EVENTS = 256;
         struct epoll_event* readyEvents = new struct epoll_event[MAX_EVENTS]();
         std::shared_ptr<struct epoll_event[]> shared_events(readyEvents);
+        // 多reactor模式下等待自己的epoll，唤醒的协程固定回到本线程
+        Reactor* reactor = m_multiReactor ? m_reactors[getThisWorkerIndex()] : m_reactors[0];
+        int thread = m_multiReactor ? sylar::GetThreadId() : -1;
         while (true) {
             uint64_t next_timeout = 0;
             if (stopping(next_timeout)) {
                 SYLAR_LOG_INFO(g_logger) << "name=" << getName() << " idle stopping exit";
+                // eventfd是边缘触发，一次tickle只能唤醒一个线程，退出前接力唤醒下一个
+                tickle();
                 break;
             }
             int readyNum = 0;
@@ -230,7 +571,17 @@ namespace sylar
                 } else {
                     next_timeout = MAX_TIMEOUT;
                 }
-                readyNum = epoll_wait(m_epollfd, readyEvents, MAX_EVENTS, (int)next_timeout);
+                reactor->sleeping = true;
+                // 先标记再检查队列: tickle在标记之前到达时没有唤醒本线程，这里能看到它提交的任务
+                if (m_multiReactor) {
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (hasPendingTask()) {
+                        reactor->sleeping = false;
+                        break;
+                    }
+                }
+                readyNum = epoll_wait(reactor->epollfd, readyEvents, MAX_EVENTS, (int)next_timeout);
+                reactor->sleeping = false;
                 if (readyNum > 0) {
                     SYLAR_LOG_DEBUG(g_logger) << "epoll_wait ready, ret = " << readyNum;
                     break;
@@ -253,14 +604,22 @@ namespace sylar
             }
             for (int i = 0; i < readyNum; ++i) {
                 struct epoll_event& event = readyEvents[i];
-                if (event.data.fd == m_eventfd) {
+                if (m_uring && event.data.fd == m_uring->getFd()) {
+                    uringReap();
+                    continue;
+                }
+                if (event.data.fd == reactor->eventfd) {
                     uint64_t two;
-                    read(m_eventfd, &two, sizeof(uint64_t));
-                    // ssize_t ret = read(m_eventfd, &two, sizeof(uint64_t));
+                    read(reactor->eventfd, &two, sizeof(uint64_t));
+                    // ssize_t ret = read(reactor->eventfd, &two, sizeof(uint64_t));
                     // SYLAR_ASSERT(ret == sizeof(uint64_t)); 
                     continue;
                 }
                 FdContext* fdcontext = (FdContext*)event.data.ptr;
+                if (m_persistent) {
+                    triggerPersistent(fdcontext, event.events, thread);
+                    continue;
+                }
                 FdContext::MutexType::Lock lock(fdcontext->mutex);
                 if (event.events & (EPOLLERR | EPOLLHUP)) {
                     event.events |= (EPOLLIN | EPOLLOUT) & fdcontext->events;
@@ -279,18 +638,22 @@ namespace sylar
                 int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
                 event.events = EPOLLET | left_events;
 
-                int ret = epoll_ctl(m_epollfd, op, fdcontext->fd, &event);
+                int ret = epoll_ctl(fdcontext->reactor->epollfd, op, fdcontext->fd, &event);
                 if (ret == -1) {
-                    SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epollfd << ", "
+                    SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << fdcontext->reactor->epollfd << ", "
                         << op << ", " << fdcontext->fd << ", " << event.events << "): " << strerror(errno);
                     continue;
                 }
+                if (op == EPOLL_CTL_DEL) {
+                    --fdcontext->reactor->fdCount;
+                    fdcontext->reactor = nullptr;
+                }
                 if (real_events & Event::READ) {
-                    fdcontext->triggerEvent(Event::READ);
+                    fdcontext->triggerEvent(Event::READ, thread);
                     --m_pendingEventCount;
                 }
                 if (real_events & Event::WRITE) {
-                    fdcontext->triggerEvent(Event::WRITE);
+                    fdcontext->triggerEvent(Event::WRITE, thread);
                     --m_pendingEventCount;
                 }
             }
@@ -299,6 +662,110 @@ namespace sylar
     }
 
 
+    // ----------------------------------------------------------
+    template<typename Prep>
+    ssize_t IOManager::uringWait(int fd, Prep prep, uint64_t timeout_ms) {
+        SYLAR_ASSERT(m_uring);
+        // close()会先设置关闭标志再删除上下文，提交前取出以便恢复后判断
+        FdCtx::ptr ctx = FdMgr::GetInstance()->get(fd);
+        uint64_t begin = timeout_ms != ~0ull ? GetCurrentMS() : 0;
+        UringRequest request;
+        request.scheduler = Scheduler::GetThisScheduler();
+        request.fiber = Fiber::GetThis()->shared_from_this();
+        {
+            MutexType::Lock lock(m_uringSubmitMutex);
+            // 每次都立即提交，SQ只有在提交失败时才会满
+            if (!prep(*m_uring, (uint64_t)&request)) {
+                errno = EAGAIN;
+                return -1;
+            }
+            ++m_pendingEventCount;
+            while (true) {
+                int rt = m_uring->submit();
+                if (rt >= 0) {
+                    break;
+                }
+                // CQ积压太多时内核拒绝提交，先收割再重试
+                if (rt == -EBUSY || rt == -EAGAIN) {
+                    uringReap();
+                    continue;
+                }
+                SYLAR_LOG_ERROR(g_logger) << "io_uring submit errno=" << -rt << " errstr=" << strerror(-rt);
+                SYLAR_ASSERT(false);
+            }
+        }
+        Fiber::YieldToHold();
+        if (request.res < 0) {
+            errno = -request.res;
+            if (request.res == -ECANCELED) {
+                // 区分取消的原因: close()关闭了fd、请求自己的超时、cancelAll()
+                if (ctx && ctx->isClosed()) {
+                    errno = EBADF;
+                } else if (timeout_ms != ~0ull && GetCurrentMS() - begin >= timeout_ms) {
+                    errno = ETIMEDOUT;
+                }
+            }
+            return -1;
+        }
+        return request.res;
+    }
+
+    void IOManager::uringReap() {
+        MutexType::Lock lock(m_uringReapMutex);
+        uint64_t user_data = 0;
+        int res = 0;
+        while (m_uring->popCompletion(user_data, res)) {
+            // 超时和取消请求的user_data为0
+            if (!user_data) {
+                continue;
+            }
+            UringRequest* request = (UringRequest*)user_data;
+            request->res = res;
+            Scheduler* scheduler = request->scheduler;
+            Fiber::ptr fiber;
+            fiber.swap(request->fiber);
+            --m_pendingEventCount;
+            // 之后协程可能立即恢复并销毁request
+            scheduler->schedule(fiber);
+        }
+    }
+
+    ssize_t IOManager::uringRead(int fd, void* buf, size_t count, uint64_t timeout_ms) {
+        return uringWait(fd, [=](IoUring& ring, uint64_t user_data) {
+            return ring.prepRead(fd, buf, count, user_data, timeout_ms);
+        }, timeout_ms);
+    }
+
+    ssize_t IOManager::uringWrite(int fd, const void* buf, size_t count, uint64_t timeout_ms) {
+        return uringWait(fd, [=](IoUring& ring, uint64_t user_data) {
+            return ring.prepWrite(fd, buf, count, user_data, timeout_ms);
+        }, timeout_ms);
+    }
+
+    ssize_t IOManager::uringRecv(int fd, void* buf, size_t len, int flags, uint64_t timeout_ms) {
+        return uringWait(fd, [=](IoUring& ring, uint64_t user_data) {
+            return ring.prepRecv(fd, buf, len, flags, user_data, timeout_ms);
+        }, timeout_ms);
+    }
+
+    ssize_t IOManager::uringSend(int fd, const void* buf, size_t len, int flags, uint64_t timeout_ms) {
+        return uringWait(fd, [=](IoUring& ring, uint64_t user_data) {
+            return ring.prepSend(fd, buf, len, flags, user_data, timeout_ms);
+        }, timeout_ms);
+    }
+
+    int IOManager::uringAccept(int fd, struct sockaddr* addr, socklen_t* addrlen, uint64_t timeout_ms) {
+        return uringWait(fd, [=](IoUring& ring, uint64_t user_data) {
+            return ring.prepAccept(fd, addr, addrlen, user_data, timeout_ms);
+        }, timeout_ms);
+    }
+
+    int IOManager::uringConnect(int fd, const struct sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms) {
+        return uringWait(fd, [=](IoUring& ring, uint64_t user_data) {
+            return ring.prepConnect(fd, addr, addrlen, user_data, timeout_ms);
+        }, timeout_ms);
+    }
+
     // ----------------------------------------------------------
     // 获取事件上下文类
     IOManager::EventContext& IOManager::FdContext::getContext(Event event) {
@@ -322,15 +789,27 @@ namespace sylar
     }
 
     // 触发事件
-    void IOManager::FdContext::triggerEvent(Event event) {
+    void* IOManager::FdContext::operator new(size_t size) {
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, alignof(FdContext), size) != 0) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    void IOManager::FdContext::operator delete(void* ptr) {
+        free(ptr);
+    }
+
+    void IOManager::FdContext::triggerEvent(Event event, int thread) {
         SYLAR_ASSERT(event & events);
         events = (Event)(events & ~event);
         EventContext& eventContext = getContext(event);
         if (eventContext.cb) {
-            eventContext.scheduler->schedule(eventContext.cb);
+            eventContext.scheduler->schedule(eventContext.cb, thread);
             eventContext.cb = nullptr;
         } else {
-            eventContext.scheduler->schedule(eventContext.fiber);
+            eventContext.scheduler->schedule(eventContext.fiber, thread);
             eventContext.fiber = nullptr;
         }
         eventContext.scheduler = nullptr;
@@ -3,18 +3,39 @@
 
 #include "scheduler.h"
 #include "timer.h"
+#include <sys/socket.h>
 
 namespace sylar
 {
+    class IoUring;
+
     class IOManager : public Scheduler, public TimerManager
     {
     public:
         using RWMutexType = RWMutex;
         using ptr = std::shared_ptr<IOManager>;
 
-        IOManager(size_t threadCount = 1, bool usecaller = true, const std::string& name = "");
+        // IO后端，DEFAULT使用配置iomanager.backend
+        enum Backend
+        {
+            DEFAULT = 0,
+            EPOLL = 1,
+            IO_URING = 2    // 内核不支持时退回EPOLL
+        };
+
+        IOManager(size_t threadCount = 1, bool usecaller = true, const std::string& name = "", Backend backend = DEFAULT);
         ~IOManager();
 
+        Backend getBackend() const { return m_backend; }
+        // 持久注册模式: fd首次等待时以EPOLLIN|EPOLLOUT|EPOLLET注册，直到cancelAll都不再epoll_ctl
+        bool isPersistent() const { return m_persistent; }
+        // 多reactor模式: 每个工作线程有自己的epoll和eventfd，fd注册在发起等待的线程上，
+        // 事件到达后协程回到该线程执行
+        bool isMultiReactor() const { return m_multiReactor; }
+        // 多reactor模式下为新连接选择工作线程(按iomanager.reactor_balance轮询或选择负载最小的)，
+        // 返回线程id，否则返回-1
+        int pickReactorThread();
+
         bool hasIdleThreads() const { return m_idleThreadCount > 0; }
         static IOManager* GetThisIOManager();
 
@@ -30,15 +51,35 @@ namespace sylar
         bool cancelEvent(int fd, Event event);  // 取消事件，如果事件存在则触发事件
         bool cancelAll(int fd);
 
+        // IO_URING后端: 直接提交读写请求，挂起当前协程直到完成
+        // 返回值和errno与对应的系统调用相同，超时返回-1且errno为ETIMEDOUT
+        // 等待时fd被close()返回-1且errno为EBADF，被cancelAll()取消时errno为ECANCELED
+        ssize_t uringRead(int fd, void* buf, size_t count, uint64_t timeout_ms);
+        ssize_t uringWrite(int fd, const void* buf, size_t count, uint64_t timeout_ms);
+        ssize_t uringRecv(int fd, void* buf, size_t len, int flags, uint64_t timeout_ms);
+        ssize_t uringSend(int fd, const void* buf, size_t len, int flags, uint64_t timeout_ms);
+        int uringAccept(int fd, struct sockaddr* addr, socklen_t* addrlen, uint64_t timeout_ms);
+        int uringConnect(int fd, const struct sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms);
+
     protected:
         void idle() override;
         void tickle() override;
+        void tickleThread(int thread_id) override;
         bool stopping() override;
         void onTimerInsertedAtFront() override;
 
         bool stopping(uint64_t& timeout);
 
     private:
+        // epoll实例，单reactor模式下所有线程共用一个
+        struct Reactor
+        {
+            int epollfd = -1;
+            int eventfd = -1;
+            std::atomic<bool> sleeping{ false };            // 是否在epoll_wait中，多reactor模式使用
+            std::atomic<size_t> fdCount{ 0 };               // 注册在此epoll上的fd数量
+        };
+
         // 事件上下文类
         struct EventContext
         {
@@ -47,30 +88,75 @@ namespace sylar
             std::function<void()> cb = nullptr;
         };
 
-        // Socket事件上下文类
-        struct FdContext
+        // Socket事件上下文类，按缓存行对齐，避免相邻fd的上下文伪共享
+        struct alignas(64) FdContext
         {
             using MutexType = Mutex;
 
+            // C++11的new不保证超过max_align_t的对齐
+            static void* operator new(size_t size);
+            static void operator delete(void* ptr);
+
             EventContext& getContext(Event event);               // 获取事件上下文类
             void resetContext(Event event);                      // 重置事件上下文
-            void triggerEvent(Event event);                      // 触发事件
+            void triggerEvent(Event event, int thread = -1);     // 触发事件，thread为协程回到的线程
 
             EventContext readEventContext;                      // 读事件的上下文
             EventContext writeEventContext;                     // 写事件的上下文
             Event events = Event::NONE;                         // 当前的事件
             int fd;                                             // 事件关联的句柄
             MutexType mutex;
+            Reactor* reactor = nullptr;                         // fd注册在哪个epoll上，未注册时为空
+            // 持久注册模式
+            std::atomic<bool> registered{ false };              // 是否已在epoll中注册
+            std::atomic<uint32_t> ready{ Event::NONE };         // 没有等待者时到达的就绪事件
         };
 
-        void contextResize(size_t size);
+        // 持久注册模式下的addEvent，就绪事件已到达时不挂起等待而是直接调度
+        int addPersistentEvent(FdContext* fdcontext, Event event, std::function<void()>& cb);
+        // 持久注册模式下处理epoll返回的事件
+        void triggerPersistent(FdContext* fdcontext, uint32_t events, int thread);
+        // 新注册fd使用的epoll: 多reactor模式下为当前线程的，非工作线程轮询选择
+        Reactor* getThisReactor();
+        void wakeup(Reactor* reactor);
+
+        // 获取fd的事件上下文，auto_create为true时不存在则创建，fd超出范围时返回nullptr
+        FdContext* getFdContext(int fd, bool auto_create);
+
+        // 等待io_uring请求完成的协程，在协程栈上直到请求完成
+        struct UringRequest
+        {
+            Scheduler* scheduler = nullptr;
+            Fiber::ptr fiber = nullptr;
+            int res = 0;
+        };
+
+        // prep把请求放入SQ，提交后挂起当前协程直到完成
+        template<typename Prep>
+        ssize_t uringWait(int fd, Prep prep, uint64_t timeout_ms);
+        // 收割所有完成事件并恢复对应的协程
+        void uringReap();
 
     private:
-        int m_epollfd;
-        int m_eventfd;
+        Backend m_backend = EPOLL;
+        bool m_persistent = false;
+        bool m_multiReactor = false;
+        std::vector<Reactor*> m_reactors;               // 单reactor模式下只有一个
+        std::atomic<uint32_t> m_nextReactor{ 0 };       // 轮询选择reactor的计数
+        std::shared_ptr<IoUring> m_uring;
+        MutexType m_uringSubmitMutex;                   // 串行化SQ的填写和提交
+        MutexType m_uringReapMutex;                     // 串行化CQ的收割
         std::atomic<size_t> m_pendingEventCount{ 0 };      // 当前等待执行的事件数量
-        RWMutexType m_mutex;
-        std::vector<FdContext*> m_fdContexts;           // socket事件上下文的容器
+
+        // 两级的fd上下文表，只增不减，段和上下文都在第一次使用时用CAS发布，查找不加锁
+        static const size_t FD_SEGMENT_BITS = 10;
+        static const size_t FD_SEGMENT_SIZE = 1 << FD_SEGMENT_BITS;
+        static const size_t FD_SEGMENT_COUNT = 1024;   // 最多支持1M个fd
+        struct FdSegment
+        {
+            std::atomic<FdContext*> contexts[FD_SEGMENT_SIZE];
+        };
+        std::atomic<FdSegment*> m_fdSegments[FD_SEGMENT_COUNT];
     };
 }
 
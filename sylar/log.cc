@@ -2,6 +2,17 @@
 #include "config.h"
 #include <map>
 #include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <deque>
+#include <sched.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <zlib.h>
 
 namespace sylar
 {
@@ -45,6 +56,23 @@ namespace sylar
     }
 
 
+    // ------------------------------- LogSite
+    // 从1开始，没有初始化的调用点(状态为0)不会匹配
+    std::atomic<uint64_t> LogSite::s_version{ 1 };
+
+    Logger* LogSite::refresh() {
+        // 先取版本号，判断期间级别又变化时下次调用重新判断
+        uint64_t version = s_version.load(std::memory_order_acquire);
+        Logger* logger = m_logger.load(std::memory_order_relaxed);
+        if (!logger) {
+            logger = LoggerMgr::GetInstance()->getLogger(m_name).get();
+            m_logger.store(logger, std::memory_order_relaxed);
+        }
+        bool enabled = m_level >= logger->getLevel();
+        m_state.store((version << 1) | enabled, std::memory_order_release);
+        return enabled ? logger : nullptr;
+    }
+
     // ------------------------------- Logger
     Logger::Logger(const std::string& name, LogLevel::Level level) : m_name(name), m_level(level) {
         m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S} %t %N %F [%p] [%c] %f:%l %m%n"));
@@ -107,19 +135,183 @@ namespace sylar
     }
 
 
+    // -------------------------------- LogStream
+    // 每个线程几个定长缓冲区: 日志内容和Appender格式化各用一个，嵌套日志时用后面的
+    struct LogBufferSlot
+    {
+        char data[4096];
+        std::atomic<bool> used{ false };    // 协程换线程后可能由其他线程归还
+    };
+
+    static const int s_log_buffer_count = 4;
+    static thread_local LogBufferSlot t_log_buffers[s_log_buffer_count];
+
+    class LogStream::StreamBuf : public std::streambuf
+    {
+    public:
+        StreamBuf(LogStream* stream) : m_stream(stream) {}
+
+    protected:
+        int_type overflow(int_type c) override {
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                char ch = traits_type::to_char_type(c);
+                m_stream->append(&ch, 1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        std::streamsize xsputn(const char* s, std::streamsize n) override {
+            m_stream->append(s, n);
+            return n;
+        }
+
+    private:
+        LogStream* m_stream;
+    };
+
+    LogStream::LogStream(bool local)
+        : m_data(nullptr), m_cap(0), m_buffer(nullptr) {
+        // 堆上的LogEvent可能比语句和创建它的线程活得更久，不使用线程局部的缓冲区
+        for (int i = 0; local && i < s_log_buffer_count; ++i) {
+            LogBufferSlot& slot = t_log_buffers[i];
+            // 与其他线程归还时的release配对，之后才能写入slot.data
+            if (!slot.used.load(std::memory_order_acquire)) {
+                slot.used.store(true, std::memory_order_relaxed);
+                m_buffer = &slot;
+                m_data = slot.data;
+                m_cap = sizeof(slot.data);
+                break;
+            }
+        }
+    }
+
+    LogStream::~LogStream() {
+        if (m_buffer) {
+            ((LogBufferSlot*)m_buffer)->used.store(false, std::memory_order_release);
+        }
+    }
+
+    void LogStream::reserve(size_t len) {
+        if (m_size + len <= m_cap) {
+            return;
+        }
+        size_t cap = std::max(std::max(m_cap * 2, m_size + len), (size_t)256);
+        bool on_heap = !m_heap.empty() && m_data == &m_heap[0];
+        m_heap.resize(cap);
+        if (!on_heap && m_size > 0) {
+            memcpy(&m_heap[0], m_data, m_size);
+        }
+        m_data = &m_heap[0];
+        m_cap = cap;
+    }
+
+    void LogStream::append(const char* data, size_t len) {
+        reserve(len);
+        memcpy(m_data + m_size, data, len);
+        m_size += len;
+    }
+
+    void LogStream::appendf(const char* fmt, va_list ap) {
+        va_list ap2;
+        va_copy(ap2, ap);
+        size_t avail = m_cap - m_size;
+        int len = vsnprintf(m_data ? m_data + m_size : nullptr, avail, fmt, ap);
+        if (len >= 0 && (size_t)len >= avail) {
+            reserve(len + 1);
+            vsnprintf(m_data + m_size, len + 1, fmt, ap2);
+        }
+        if (len > 0) {
+            m_size += len;
+        }
+        va_end(ap2);
+    }
+
+    LogStream& LogStream::operator<<(bool v) {
+        if (m_ostream) {
+            *m_ostream << v;
+            return *this;
+        }
+        return appendInteger((int)v);
+    }
+
+    LogStream& LogStream::operator<<(char v) {
+        if (m_ostream) {
+            *m_ostream << v;
+        } else {
+            append(&v, 1);
+        }
+        return *this;
+    }
+
+    LogStream& LogStream::operator<<(double v) {
+        if (m_ostream) {
+            *m_ostream << v;
+            return *this;
+        }
+        // 与std::ostream默认格式相同
+        char buf[32];
+        int len = snprintf(buf, sizeof(buf), "%g", v);
+        append(buf, len);
+        return *this;
+    }
+
+    LogStream& LogStream::operator<<(const char* v) {
+        if (m_ostream) {
+            *m_ostream << (v ? v : "(null)");
+        } else if (v) {
+            append(v, strlen(v));
+        } else {
+            append("(null)", 6);
+        }
+        return *this;
+    }
+
+    LogStream& LogStream::operator<<(const std::string& v) {
+        if (m_ostream) {
+            *m_ostream << v;
+        } else {
+            append(v.c_str(), v.size());
+        }
+        return *this;
+    }
+
+    LogStream& LogStream::operator<<(const void* v) {
+        if (m_ostream) {
+            *m_ostream << v;
+            return *this;
+        }
+        if (!v) {
+            append("0", 1);
+            return *this;
+        }
+        char buf[32];
+        int len = snprintf(buf, sizeof(buf), "%p", v);
+        append(buf, len);
+        return *this;
+    }
+
+    std::ostream& LogStream::getOStream() {
+        if (!m_ostream) {
+            m_streambuf.reset(new StreamBuf(this));
+            m_ostream.reset(new std::ostream(m_streambuf.get()));
+        }
+        return *m_ostream;
+    }
+
     // -------------------------------- LogEvent
     void LogEvent::format(const char* fmt, ...) {
         va_list al;
         va_start(al, fmt);
-        char* buf = nullptr;
-        int len = vasprintf(&buf, fmt, al);
-        if (len != -1) {
-            m_ss << std::string(buf, len);
-            free(buf);
-        }
+        m_ss.appendf(fmt, al);
         va_end(al);
     }
 
+    LocalLogEventWrap::~LocalLogEventWrap() {
+        // 不持有所有权，不分配控制块
+        LogEvent::ptr event(LogEvent::ptr(), &m_event);
+        m_event.getLogger()->log(m_event.getLevel(), event);
+    }
+
     // --------------------------------- LogFormatter
     LogFormatter::LogFormatter(const std::string& pattern) : m_pattern(pattern) {
         init();
@@ -140,6 +332,13 @@ namespace sylar
         return ofs;
     }
 
+    LogStream& LogFormatter::format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+        for (auto& it : m_items) {
+            it->format(os, logger, level, event);
+        }
+        return os;
+    }
+
     // %m %d{%Y-%m-%d %H:%M:%S} %%
     void LogFormatter::init() {
         /*
@@ -252,6 +451,457 @@ namespace sylar
     }
 
 
+    // --------------------------------- DateTimeFormatItem
+    // 每个线程缓存几个时间格式当前秒的结果，按格式id取模
+    struct DateTimeCache
+    {
+        uint64_t id = 0;
+        time_t sec = 0;
+        std::string text;               // 各段strftime结果连在一起
+        std::vector<size_t> ends;       // 各段在text中的结束位置
+    };
+
+    static const int s_datetime_cache_count = 8;
+    static thread_local DateTimeCache t_datetime_caches[s_datetime_cache_count];
+    static std::atomic<uint64_t> s_datetime_id{ 0 };
+
+    DateTimeFormatItem::DateTimeFormatItem(const std::string& format)
+        : m_format(format), m_id(++s_datetime_id) {
+        if (m_format.empty()) {
+            m_format = "%Y-%m-%d %H:%M:%S";
+        }
+        Part part{ "", 0 };
+        for (size_t i = 0; i < m_format.size(); ++i) {
+            if (m_format[i] != '%' || i + 1 == m_format.size()) {
+                part.format.push_back(m_format[i]);
+                continue;
+            }
+            char c = m_format[++i];
+            if (c == 'L' || c == 'f') {
+                part.subsecond = c == 'L' ? 3 : 6;
+                m_parts.push_back(part);
+                part = Part{ "", 0 };
+            } else {
+                // 其他的交给strftime，包括%%
+                part.format.push_back('%');
+                part.format.push_back(c);
+            }
+        }
+        if (!part.format.empty() || m_parts.empty()) {
+            m_parts.push_back(part);
+        }
+    }
+
+    void DateTimeFormatItem::format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+        LogStream ls(true);
+        format(ls, event->getTime(), event->getMicrosecond());
+        os.write(ls.data(), ls.size());
+    }
+
+    void DateTimeFormatItem::format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+        format(os, event->getTime(), event->getMicrosecond());
+    }
+
+    void DateTimeFormatItem::format(LogStream& os, time_t sec, uint32_t usec) {
+        DateTimeCache& cache = t_datetime_caches[m_id % s_datetime_cache_count];
+        if (cache.id != m_id || cache.sec != sec) {
+            struct tm tm;
+            localtime_r(&sec, &tm);
+            cache.text.clear();
+            cache.ends.clear();
+            char buf[128];
+            for (auto& part : m_parts) {
+                size_t len = part.format.empty() ? 0 : strftime(buf, sizeof(buf), part.format.c_str(), &tm);
+                cache.text.append(buf, len);
+                cache.ends.push_back(cache.text.size());
+            }
+            cache.id = m_id;
+            cache.sec = sec;
+        }
+        size_t begin = 0;
+        for (size_t i = 0; i < m_parts.size(); ++i) {
+            os.append(cache.text.c_str() + begin, cache.ends[i] - begin);
+            begin = cache.ends[i];
+            int width = m_parts[i].subsecond;
+            if (width > 0) {
+                uint32_t v = width == 3 ? usec / 1000 : usec;
+                char digits[6];
+                for (int j = width - 1; j >= 0; --j) {
+                    digits[j] = '0' + v % 10;
+                    v /= 10;
+                }
+                os.append(digits, width);
+            }
+        }
+    }
+
+    // --------------------------------- 异步日志
+    static ConfigVar<uint32_t>::ptr g_log_async_buffer_size =
+        Config::Add<uint32_t>("log.async.buffer_size", 1024 * 1024, "per thread async log ring buffer bytes");
+    static ConfigVar<uint32_t>::ptr g_log_async_flush_interval =
+        Config::Add<uint32_t>("log.async.flush_interval", 100, "async log flush interval ms");
+
+    static uint32_t s_log_async_buffer_size = 0;
+    static uint32_t s_log_async_flush_interval = 0;
+
+    struct _LogAsyncIniter
+    {
+        _LogAsyncIniter() {
+            s_log_async_buffer_size = g_log_async_buffer_size->getValue();
+            s_log_async_flush_interval = g_log_async_flush_interval->getValue();
+            g_log_async_buffer_size->addListener([](const uint32_t& old_value, const uint32_t& new_value) {
+                std::cout << "log async buffer_size changed from " << old_value << " to " << new_value << std::endl;
+                s_log_async_buffer_size = new_value;
+            });
+            g_log_async_flush_interval->addListener([](const uint32_t& old_value, const uint32_t& new_value) {
+                std::cout << "log async flush_interval changed from " << old_value << " to " << new_value << std::endl;
+                s_log_async_flush_interval = new_value;
+            });
+        }
+    };
+    static _LogAsyncIniter s_log_async_initer;
+
+    // 单生产者单消费者的环形缓冲区，生产者是写日志的线程，消费者是后台线程
+    // 记录为8字节头(appender id, 长度) + 数据，按8字节对齐，id为0的记录是跳回开头的填充
+    class LogRing
+    {
+    public:
+        using ptr = std::shared_ptr<LogRing>;
+
+        LogRing(size_t size) {
+            size_t cap = 4096;
+            while (cap < size) {
+                cap <<= 1;
+            }
+            m_buf.resize(cap);
+            m_mask = cap - 1;
+        }
+
+        static size_t RecordSize(size_t len) { return (8 + len + 7) & ~(size_t)7; }
+
+        size_t capacity() const { return m_buf.size(); }
+        size_t used() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+
+        // 空间不够时返回false
+        bool push(uint32_t id, const char* data, uint32_t len) {
+            size_t need = RecordSize(len);
+            uint64_t tail = m_tail.load(std::memory_order_relaxed);
+            uint64_t head = m_head.load(std::memory_order_acquire);
+            size_t off = tail & m_mask;
+            size_t to_end = m_buf.size() - off;
+            size_t total = need <= to_end ? need : to_end + need;
+            if (total > m_buf.size() - (tail - head)) {
+                return false;
+            }
+            if (need > to_end) {
+                writeHeader(off, 0, to_end - 8);
+                tail += to_end;
+                off = 0;
+            }
+            writeHeader(off, id, len);
+            memcpy(&m_buf[off + 8], data, len);
+            m_tail.store(tail + need, std::memory_order_release);
+            return true;
+        }
+
+        // 取出所有记录，cb(id, data, len)
+        template<typename F>
+        void pop(F cb) {
+            uint64_t head = m_head.load(std::memory_order_relaxed);
+            uint64_t tail = m_tail.load(std::memory_order_acquire);
+            while (head < tail) {
+                size_t off = head & m_mask;
+                uint32_t id;
+                uint32_t len;
+                memcpy(&id, &m_buf[off], 4);
+                memcpy(&len, &m_buf[off + 4], 4);
+                if (id != 0) {
+                    cb(id, &m_buf[off + 8], len);
+                }
+                head += RecordSize(len);
+            }
+            m_head.store(head, std::memory_order_release);
+        }
+
+        std::atomic<bool> closed{ false };      // 所属线程已经退出
+
+    private:
+        void writeHeader(size_t off, uint32_t id, uint32_t len) {
+            memcpy(&m_buf[off], &id, 4);
+            memcpy(&m_buf[off + 4], &len, 4);
+        }
+
+    private:
+        std::vector<char> m_buf;
+        size_t m_mask = 0;
+        std::atomic<uint64_t> m_head{ 0 };      // 消费位置
+        char m_pad[64];                         // head和tail不在同一个缓存行
+        std::atomic<uint64_t> m_tail{ 0 };      // 生产位置
+    };
+
+    // 后台写日志的线程，收集所有线程的环形缓冲区，按Appender合并后一次写出
+    class LogFlusher
+    {
+    public:
+        LogFlusher();
+        ~LogFlusher();
+
+        // 程序退出析构后返回nullptr
+        static LogFlusher* GetInstance();
+
+        // 注册的Appender由后台线程持有，其他地方都不再引用并且数据写完后释放
+        uint32_t addAppender(LogAppender::ptr appender);
+        void delAppender(uint32_t id);
+
+        // 当前线程的环形缓冲区，线程第一次写异步日志时创建
+        LogRing* getThisRing();
+
+        void wakeup();
+        // 等待调用之前写入的日志都写出
+        void flush();
+
+    private:
+        void run();
+        void drain();
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_cond;             // 后台线程等待
+        std::condition_variable m_flushed;          // flush等待
+        std::atomic<bool> m_wakeup{ false };
+        bool m_stop = false;
+        uint64_t m_requested = 0;                   // flush请求的轮次
+        uint64_t m_completed = 0;                   // 已经完成的flush轮次
+        uint32_t m_nextId = 1;
+        std::vector<LogRing::ptr> m_rings;
+        std::map<uint32_t, LogAppender::ptr> m_appenders;
+        std::map<uint32_t, std::string> m_batches;  // 只在后台线程中使用，保留容量
+        Thread::ptr m_thread;
+    };
+
+    static std::atomic<bool> s_log_flusher_destroyed{ false };
+
+    struct ThreadLogRing
+    {
+        LogRing::ptr ring;
+        ~ThreadLogRing() {
+            if (ring) {
+                ring->closed = true;
+            }
+        }
+    };
+
+    static thread_local ThreadLogRing t_log_ring;
+
+    LogFlusher::LogFlusher() {
+        m_thread.reset(new Thread(std::bind(&LogFlusher::run, this), "log_flusher"));
+    }
+
+    LogFlusher::~LogFlusher() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_one();
+        m_thread->join();
+        s_log_flusher_destroyed = true;
+    }
+
+    LogFlusher* LogFlusher::GetInstance() {
+        if (s_log_flusher_destroyed) {
+            return nullptr;
+        }
+        static LogFlusher s_flusher;
+        return &s_flusher;
+    }
+
+    uint32_t LogFlusher::addAppender(LogAppender::ptr appender) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint32_t id = m_nextId++;
+        m_appenders[id] = appender;
+        return id;
+    }
+
+    void LogFlusher::delAppender(uint32_t id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_appenders.erase(id);
+    }
+
+    LogRing* LogFlusher::getThisRing() {
+        if (!t_log_ring.ring) {
+            LogRing::ptr ring = std::make_shared<LogRing>(s_log_async_buffer_size);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_rings.push_back(ring);
+            t_log_ring.ring = ring;
+        }
+        return t_log_ring.ring.get();
+    }
+
+    void LogFlusher::wakeup() {
+        if (!m_wakeup.exchange(true)) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cond.notify_one();
+        }
+    }
+
+    void LogFlusher::flush() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stop) {
+            return;
+        }
+        uint64_t request = ++m_requested;
+        m_wakeup = true;
+        m_cond.notify_one();
+        m_flushed.wait(lock, [this, request]() { return m_completed >= request || m_stop; });
+    }
+
+    void LogFlusher::run() {
+        while (true) {
+            bool stop;
+            uint64_t request;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (!m_stop && !m_wakeup) {
+                    m_cond.wait_for(lock, std::chrono::milliseconds(s_log_async_flush_interval));
+                }
+                m_wakeup = false;
+                stop = m_stop;
+                request = m_requested;
+            }
+            drain();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_completed = request;
+            }
+            m_flushed.notify_all();
+            if (stop) {
+                break;
+            }
+        }
+    }
+
+    void LogFlusher::drain() {
+        std::vector<LogRing::ptr> rings;
+        std::map<uint32_t, LogAppender::ptr> appenders;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            rings = m_rings;
+            appenders = m_appenders;
+        }
+        std::vector<LogRing*> finished;
+        for (auto& ring : rings) {
+            // 先看线程是否退出，之后取出的就是全部数据
+            if (ring->closed) {
+                finished.push_back(ring.get());
+            }
+            ring->pop([this](uint32_t id, const char* data, uint32_t len) {
+                m_batches[id].append(data, len);
+            });
+        }
+        for (auto it = m_batches.begin(); it != m_batches.end();) {
+            auto ait = appenders.find(it->first);
+            if (ait == appenders.end()) {
+                it = m_batches.erase(it);
+                continue;
+            }
+            if (!it->second.empty()) {
+                ait->second->write(it->second.c_str(), it->second.size());
+                it->second.clear();
+            }
+            ++it;
+        }
+        rings.clear();
+        appenders.clear();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_rings.begin(); it != m_rings.end();) {
+            if (std::find(finished.begin(), finished.end(), it->get()) != finished.end()) {
+                it = m_rings.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        // 只剩这里引用的Appender，它的数据已经在上面写完
+        for (auto it = m_appenders.begin(); it != m_appenders.end();) {
+            if (it->second.use_count() == 1) {
+                m_batches.erase(it->first);
+                it = m_appenders.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // --------------------------------- LogAppender
+    void LogAppender::setAsync(bool v) {
+        LogFlusher* flusher = LogFlusher::GetInstance();
+        if (!flusher || v == isAsync()) {
+            return;
+        }
+        if (v) {
+            m_asyncId = flusher->addAppender(shared_from_this());
+        } else {
+            // 先切回同步，之后的日志不再进入缓冲区；等已经取得id的线程放入缓冲区，
+            // 再写出缓冲区中的日志，最后注销
+            uint32_t id = m_asyncId.exchange(0);
+            while (m_asyncWriters) {
+                sched_yield();
+            }
+            flusher->flush();
+            flusher->delAppender(id);
+        }
+    }
+
+    void LogAppender::FlushAsync() {
+        LogFlusher* flusher = LogFlusher::GetInstance();
+        if (flusher) {
+            flusher->flush();
+        }
+    }
+
+    bool LogAppender::asyncLog(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+        if (m_asyncId == 0) {
+            return false;
+        }
+        // 先计数再取id，setAsync(false)清除id后看到计数为0时不会再有日志用旧id放入缓冲区
+        ++m_asyncWriters;
+        bool rt = pushAsync(logger, level, event);
+        --m_asyncWriters;
+        return rt;
+    }
+
+    bool LogAppender::pushAsync(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+        uint32_t id = m_asyncId;
+        if (id == 0) {
+            return false;
+        }
+        LogFlusher* flusher = LogFlusher::GetInstance();
+        if (!flusher) {
+            return false;
+        }
+        LogStream os(true);
+        std::atomic_load(&m_formatter)->format(os, logger, level, event);
+
+        LogRing* ring = flusher->getThisRing();
+        if (LogRing::RecordSize(os.size()) > ring->capacity() / 2) {
+            // 放不进缓冲区的日志等之前的写完后同步写出，保持顺序
+            flusher->flush();
+            return false;
+        }
+        while (!ring->push(id, os.data(), os.size())) {
+            if (m_overflow == DROP || (m_overflow == DROP_BELOW && level < m_overflowLevel)) {
+                ++m_dropped;
+                return true;
+            }
+            flusher->wakeup();
+            sched_yield();
+        }
+        if (level >= LogLevel::ERROR || ring->used() > ring->capacity() / 2) {
+            flusher->wakeup();
+        }
+        return true;
+    }
+
     // --------------------------------- StdoutLogAppender
 
     // void StdoutLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) {
@@ -261,10 +911,223 @@ namespace sylar
     // }
 
     void StdoutLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) {
-        if (level >= m_level) {
+        if (level >= m_level && !asyncLog(logger, level, event)) {
+            LogStream os(true);
+            std::atomic_load(&m_formatter)->format(os, logger, level, event);
             MutexType::Lock lock(m_mutex);
-            m_formatter->format(std::cout, logger, level, event);
+            std::cout.write(os.data(), os.size());
+            std::cout.flush();
+        }
+    }
+
+    void StdoutLogAppender::write(const char* data, size_t len) {
+        MutexType::Lock lock(m_mutex);
+        std::cout.write(data, len);
+        std::cout.flush();
+    }
+
+    // --------------------------------- LogRotator
+    // 日志文件切分的后台线程，改名、压缩和删除都在这里进行，写日志的线程不等待文件系统操作
+    class LogRotator
+    {
+    public:
+        LogRotator();
+        ~LogRotator();
+
+        // 程序退出析构后返回nullptr
+        static LogRotator* GetInstance();
+
+        void schedule(std::weak_ptr<FileLogAppender> appender);
+        // 等待已经提交的切分完成
+        void wait();
+
+    private:
+        void run();
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_cond;     // 后台线程等待
+        std::condition_variable m_idle;     // wait等待
+        bool m_stop = false;
+        bool m_busy = false;
+        std::deque<std::weak_ptr<FileLogAppender>> m_tasks;
+        Thread::ptr m_thread;
+    };
+
+    static std::atomic<bool> s_log_rotator_destroyed{ false };
+
+    LogRotator::LogRotator() {
+        m_thread.reset(new Thread(std::bind(&LogRotator::run, this), "log_rotate"));
+    }
+
+    LogRotator::~LogRotator() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_one();
+        m_thread->join();
+        s_log_rotator_destroyed = true;
+    }
+
+    LogRotator* LogRotator::GetInstance() {
+        if (s_log_rotator_destroyed) {
+            return nullptr;
+        }
+        static LogRotator s_rotator;
+        return &s_rotator;
+    }
+
+    void LogRotator::schedule(std::weak_ptr<FileLogAppender> appender) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(appender);
+        }
+        m_cond.notify_one();
+    }
+
+    void LogRotator::wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this]() { return (m_tasks.empty() && !m_busy) || m_stop; });
+    }
+
+    void LogRotator::run() {
+        while (true) {
+            std::weak_ptr<FileLogAppender> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+                // 退出前完成已经提交的切分
+                if (m_tasks.empty()) {
+                    break;
+                }
+                task = m_tasks.front();
+                m_tasks.pop_front();
+                m_busy = true;
+            }
+            FileLogAppender::ptr appender = task.lock();
+            if (appender) {
+                appender->doRotate();
+            }
+            appender.reset();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_busy = false;
+            }
+            m_idle.notify_all();
+        }
+    }
+
+    // 按本地时间对齐的下一个切分时间，例如interval为86400时在每天0点切分
+    static time_t NextRotateTime(time_t now, uint32_t interval) {
+        if (!interval) {
+            return 0;
+        }
+        struct tm tm;
+        localtime_r(&now, &tm);
+        time_t local = now + tm.tm_gmtoff;
+        return (local / interval + 1) * interval - tm.tm_gmtoff;
+    }
+
+    static uint64_t GetFileSize(const std::string& filename) {
+        struct stat st;
+        if (stat(filename.c_str(), &st) != 0) {
+            return 0;
         }
+        return st.st_size;
+    }
+
+    // 切分出的文件名为 prefix年月日-时分秒[.序号][.gz]，key用于按切分的先后排序
+    static bool ParseRotatedName(const std::string& name, const std::string& prefix
+                                , std::pair<std::string, uint32_t>& key) {
+        if (name.compare(0, prefix.size(), prefix) != 0) {
+            return false;
+        }
+        std::string rest = name.substr(prefix.size());
+        if (rest.size() > 3 && rest.compare(rest.size() - 3, 3, ".gz") == 0) {
+            rest.resize(rest.size() - 3);
+        }
+        if (rest.size() < 15 || rest[8] != '-') {
+            return false;
+        }
+        for (size_t i = 0; i < 15; ++i) {
+            if (i != 8 && !isdigit(rest[i])) {
+                return false;
+            }
+        }
+        key.first = rest.substr(0, 15);
+        key.second = 0;
+        if (rest.size() > 15) {
+            if (rest[15] != '.' || rest.size() == 16) {
+                return false;
+            }
+            for (size_t i = 16; i < rest.size(); ++i) {
+                if (!isdigit(rest[i])) {
+                    return false;
+                }
+            }
+            key.second = atoi(rest.c_str() + 16);
+        }
+        return true;
+    }
+
+    // 只保留最近切分出的max_files个文件
+    static void RemoveRotatedFiles(const std::string& filename, uint32_t max_files) {
+        size_t pos = filename.rfind('/');
+        std::string dir = pos == std::string::npos ? "." : (pos == 0 ? "/" : filename.substr(0, pos));
+        std::string prefix = (pos == std::string::npos ? filename : filename.substr(pos + 1)) + ".";
+        DIR* dp = opendir(dir.c_str());
+        if (!dp) {
+            return;
+        }
+        std::vector<std::pair<std::pair<std::string, uint32_t>, std::string>> files;
+        struct dirent* dirp = nullptr;
+        while ((dirp = readdir(dp)) != nullptr) {
+            std::pair<std::string, uint32_t> key;
+            if (ParseRotatedName(dirp->d_name, prefix, key)) {
+                files.push_back(std::make_pair(key, dirp->d_name));
+            }
+        }
+        closedir(dp);
+        if (files.size() <= max_files) {
+            return;
+        }
+        std::sort(files.begin(), files.end());
+        for (size_t i = 0; i < files.size() - max_files; ++i) {
+            unlink((dir + "/" + files[i].second).c_str());
+        }
+    }
+
+    static bool GzipFile(const std::string& src, const std::string& dst) {
+        FILE* in = fopen(src.c_str(), "rb");
+        if (!in) {
+            return false;
+        }
+        gzFile out = gzopen(dst.c_str(), "wb");
+        if (!out) {
+            fclose(in);
+            return false;
+        }
+        bool ok = true;
+        char buf[64 * 1024];
+        size_t n = 0;
+        while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+            if (gzwrite(out, buf, n) != (int)n) {
+                ok = false;
+                break;
+            }
+        }
+        if (ferror(in)) {
+            ok = false;
+        }
+        fclose(in);
+        if (gzclose(out) != Z_OK) {
+            ok = false;
+        }
+        if (!ok) {
+            unlink(dst.c_str());
+        }
+        return ok;
     }
 
     // --------------------------------- FileLogAppender
@@ -278,6 +1141,7 @@ namespace sylar
             m_filestream.close();
         }
         m_filestream.open(m_filename, std::ios::app);
+        m_fileSize = GetFileSize(m_filename);
         return !!m_filestream;
     }
 
@@ -288,13 +1152,124 @@ namespace sylar
     // }
 
     void FileLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) {
-        if (level >= m_level) {
+        if (level >= m_level && !asyncLog(logger, level, event)) {
+            LogStream os(true);
+            std::atomic_load(&m_formatter)->format(os, logger, level, event);
             MutexType::Lock lock(m_mutex);
-            m_formatter->format(m_filestream, logger, level, event);
+            m_filestream.write(os.data(), os.size());
+            m_filestream.flush();
+            checkRotate(os.size());
         }
     }
 
-    // --------------------------------------
+    void FileLogAppender::write(const char* data, size_t len) {
+        MutexType::Lock lock(m_mutex);
+        m_filestream.write(data, len);
+        m_filestream.flush();
+        checkRotate(len);
+    }
+
+    void FileLogAppender::setRotate(const RotateOption& option) {
+        MutexType::Lock lock(m_mutex);
+        m_rotate = option;
+        m_nextRotate = NextRotateTime(time(0), option.interval);
+    }
+
+    FileLogAppender::RotateOption FileLogAppender::getRotate() {
+        MutexType::Lock lock(m_mutex);
+        return m_rotate;
+    }
+
+    void FileLogAppender::rotate() {
+        LogRotator* rotator = LogRotator::GetInstance();
+        if (!rotator) {
+            return;
+        }
+        MutexType::Lock lock(m_mutex);
+        if (!m_rotating) {
+            m_rotating = true;
+            rotator->schedule(std::static_pointer_cast<FileLogAppender>(shared_from_this()));
+        }
+    }
+
+    void FileLogAppender::WaitRotate() {
+        LogRotator* rotator = LogRotator::GetInstance();
+        if (rotator) {
+            rotator->wait();
+        }
+    }
+
+    void FileLogAppender::checkRotate(size_t len) {
+        m_fileSize += len;
+        if (m_rotating || (!m_rotate.max_size && !m_rotate.interval)) {
+            return;
+        }
+        if ((m_rotate.max_size && m_fileSize >= m_rotate.max_size)
+            || (m_rotate.interval && time(0) >= m_nextRotate)) {
+            LogRotator* rotator = LogRotator::GetInstance();
+            if (rotator) {
+                m_rotating = true;
+                rotator->schedule(std::static_pointer_cast<FileLogAppender>(shared_from_this()));
+            }
+        }
+    }
+
+    void FileLogAppender::doRotate() {
+        RotateOption option;
+        {
+            MutexType::Lock lock(m_mutex);
+            option = m_rotate;
+        }
+        time_t now = time(0);
+        std::string base = m_filename + "." + Time2Str(now, "%Y%m%d-%H%M%S");
+        std::string rotated = base;
+        // 同一秒内多次切分时加序号
+        for (uint32_t i = 1; access(rotated.c_str(), F_OK) == 0
+                || access((rotated + ".gz").c_str(), F_OK) == 0; ++i) {
+            rotated = base + "." + std::to_string(i);
+        }
+        // 改名后写日志的线程继续写入同一个文件，直到下面切换到新文件
+        bool renamed = rename(m_filename.c_str(), rotated.c_str()) == 0;
+        if (!renamed && errno != ENOENT) {
+            std::cout << "log rotate err: rename " << m_filename << " to " << rotated
+                << " failed: " << strerror(errno) << std::endl;
+        }
+        std::ofstream ofs(m_filename, std::ios::app);
+        bool opened = !!ofs;
+        if (!opened) {
+            std::cout << "log rotate err: open " << m_filename << " failed: " << strerror(errno) << std::endl;
+            // 仍在写改名后的文件，改回原来的名字，不能压缩或删除它
+            if (renamed && rename(rotated.c_str(), m_filename.c_str()) != 0) {
+                std::cout << "log rotate err: rename " << rotated << " back to " << m_filename
+                    << " failed: " << strerror(errno) << std::endl;
+            }
+        }
+        {
+            MutexType::Lock lock(m_mutex);
+            if (opened) {
+                m_filestream.swap(ofs);
+            }
+            // 切分失败时也重新计数，避免每次写都触发切分
+            m_fileSize = 0;
+            m_nextRotate = NextRotateTime(now, m_rotate.interval);
+            m_rotating = false;
+        }
+        // 关闭旧文件
+        ofs.close();
+        if (!renamed || !opened) {
+            return;
+        }
+        if (option.compress) {
+            if (GzipFile(rotated, rotated + ".gz")) {
+                unlink(rotated.c_str());
+            } else {
+                std::cout << "log rotate err: compress " << rotated << " failed" << std::endl;
+            }
+        }
+        if (option.max_files) {
+            RemoveRotatedFiles(m_filename, option.max_files);
+        }
+    }
 
     struct LogAppenderDefine
     {
@@ -302,15 +1277,37 @@ namespace sylar
         LogLevel::Level level = LogLevel::UNKNOW;
         std::string formatter;
         std::string file;
+        bool async = false;
+        int overflow = LogAppender::BLOCK;
+        LogLevel::Level overflow_level = LogLevel::WARN;
+        FileLogAppender::RotateOption rotate;
 
         bool operator==(const LogAppenderDefine& rhs) const {
             return type == rhs.type
                 && level == rhs.level
                 && formatter == rhs.formatter
-                && file == rhs.file;
+                && file == rhs.file
+                && async == rhs.async
+                && overflow == rhs.overflow
+                && overflow_level == rhs.overflow_level
+                && rotate == rhs.rotate;
         }
     };
 
+    // 解析带单位的数值，例如 100M、1h，没有单位时为1
+    static uint64_t ParseWithUnit(const std::string& str, const std::map<char, uint64_t>& units) {
+        size_t pos = 0;
+        uint64_t v = std::stoull(str, &pos);
+        if (pos == str.size()) {
+            return v;
+        }
+        auto it = units.find(tolower(str[pos]));
+        if (it == units.end() || pos + 1 != str.size()) {
+            throw std::invalid_argument("invalid unit: " + str);
+        }
+        return v * it->second;
+    }
+
     struct LogDefine
     {
         std::string name;
@@ -365,6 +1362,28 @@ namespace sylar
                             continue;
                         }
                         logappenderdefine.file = appenderNode["file"].as<std::string>();
+                        static const std::map<char, uint64_t> s_size_units = {
+                            { 'k', 1024ull }, { 'm', 1024ull * 1024 }, { 'g', 1024ull * 1024 * 1024 }
+                        };
+                        static const std::map<char, uint64_t> s_time_units = {
+                            { 's', 1 }, { 'm', 60 }, { 'h', 3600 }, { 'd', 86400 }
+                        };
+                        try {
+                            if (appenderNode["max_size"].IsDefined()) {
+                                logappenderdefine.rotate.max_size = ParseWithUnit(appenderNode["max_size"].as<std::string>(), s_size_units);
+                            }
+                            if (appenderNode["rotate_interval"].IsDefined()) {
+                                logappenderdefine.rotate.interval = ParseWithUnit(appenderNode["rotate_interval"].as<std::string>(), s_time_units);
+                            }
+                        } catch (std::exception& e) {
+                            std::cout << "log config yml err: fileappender's max_size or rotate_interval is invalid! " << appenderNode << std::endl;
+                        }
+                        if (appenderNode["max_files"].IsDefined()) {
+                            logappenderdefine.rotate.max_files = appenderNode["max_files"].as<uint32_t>();
+                        }
+                        if (appenderNode["compress"].IsDefined()) {
+                            logappenderdefine.rotate.compress = appenderNode["compress"].as<bool>();
+                        }
                     } else {
                         std::cout << "log config yml err: appender type is invalid! " << appenderNode << std::endl;
                         continue;
@@ -375,6 +1394,24 @@ namespace sylar
                     if (appenderNode["level"].IsDefined()) {
                         logappenderdefine.level = LogLevel::FromString(appenderNode["level"].as<std::string>());
                     }
+                    if (appenderNode["async"].IsDefined()) {
+                        logappenderdefine.async = appenderNode["async"].as<bool>();
+                    }
+                    if (appenderNode["overflow"].IsDefined()) {
+                        std::string overflow = appenderNode["overflow"].as<std::string>();
+                        if (overflow == "block") {
+                            logappenderdefine.overflow = LogAppender::BLOCK;
+                        } else if (overflow == "drop") {
+                            logappenderdefine.overflow = LogAppender::DROP;
+                        } else if (overflow == "drop_below") {
+                            logappenderdefine.overflow = LogAppender::DROP_BELOW;
+                        } else {
+                            std::cout << "log config yml err: appender overflow is invalid! " << appenderNode << std::endl;
+                        }
+                    }
+                    if (appenderNode["overflow_level"].IsDefined()) {
+                        logappenderdefine.overflow_level = LogLevel::FromString(appenderNode["overflow_level"].as<std::string>());
+                    }
                     logdefine.appenders.push_back(logappenderdefine);
                 }
             }
@@ -406,9 +1443,27 @@ namespace sylar
                 if (appender.type == 1) {
                     appenderNode["type"] = "FileLogAppender";
                     appenderNode["file"] = appender.file;
+                    if (appender.rotate.max_size) {
+                        appenderNode["max_size"] = appender.rotate.max_size;
+                    }
+                    if (appender.rotate.interval) {
+                        appenderNode["rotate_interval"] = appender.rotate.interval;
+                    }
+                    if (appender.rotate.max_files) {
+                        appenderNode["max_files"] = appender.rotate.max_files;
+                    }
+                    if (appender.rotate.compress) {
+                        appenderNode["compress"] = true;
+                    }
                 } else if (appender.type == 0) {
                     appenderNode["type"] = "StdoutLogAppender";
                 }
+                if (appender.async) {
+                    appenderNode["async"] = true;
+                    static const char* s_overflows[] = { "block", "drop", "drop_below" };
+                    appenderNode["overflow"] = s_overflows[appender.overflow];
+                    appenderNode["overflow_level"] = LogLevel::ToString(appender.overflow_level);
+                }
                 node["appenders"].push_back(appenderNode);
             }
             std::stringstream ss;
@@ -443,7 +1498,9 @@ namespace sylar
                     for (auto& ap : val.appenders) {
                         sylar::LogAppender::ptr logAppender;
                         if (ap.type == 1) {
-                            logAppender = std::make_shared<FileLogAppender>(ap.file);
+                            FileLogAppender::ptr fileAppender = std::make_shared<FileLogAppender>(ap.file);
+                            fileAppender->setRotate(ap.rotate);
+                            logAppender = fileAppender;
                         } else if (ap.type == 0) {
                             logAppender = std::make_shared<StdoutLogAppender>();
                         }
@@ -451,6 +1508,8 @@ namespace sylar
                         if (!ap.formatter.empty()) {
                             logAppender->setFormatter(ap.formatter);
                         }
+                        logAppender->setOverflow((LogAppender::Overflow)ap.overflow, ap.overflow_level);
+                        logAppender->setAsync(ap.async);
                         logger->addAppender(logAppender);
                     }
                 }
@@ -10,15 +10,25 @@
 #include <vector>
 #include <stdarg.h>
 #include <map>
+#include <atomic>
+#include <type_traits>
 #include "util.h"
 #include "singleton.h"
 #include "mutex.h"
 #include "thread.h"
+#include "noncopyable.h"
 
+// 编译期的最低日志级别(LogLevel::Level的值)，低于它的SYLAR_LOG_*语句在编译时被去掉
+// 例如发布版本用 -DSYLAR_LOG_MIN_LEVEL=2 去掉所有DEBUG日志，只影响用这个宏编译的源文件
+#ifndef SYLAR_LOG_MIN_LEVEL
+#define SYLAR_LOG_MIN_LEVEL 0
+#endif
+
+// 日志事件构造在栈上，内容写入线程局部的缓冲区，不分配内存
 #define SYLAR_LOG_LEVEL(logger, level) \
-    if (level >= logger->getLevel())    \
-        sylar::LogEventWrap(sylar::LogEvent::ptr(std::make_shared<sylar::LogEvent>(logger, level, __FILE__, \
-            __LINE__, 0, sylar::GetThreadId(), sylar::GetFiberId(), time(0), sylar::Thread::GetName()))).getSS()
+    if (level >= SYLAR_LOG_MIN_LEVEL && level >= logger->getLevel())    \
+        sylar::LocalLogEventWrap(logger, level, __FILE__, __LINE__, sylar::GetThreadId(), \
+            sylar::GetFiberId(), sylar::GetCurrentUS(), sylar::Thread::GetName()).getSS()
 
 #define SYLAR_LOG_DEBUG(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::DEBUG)
 #define SYLAR_LOG_INFO(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::INFO)
@@ -27,9 +37,9 @@
 #define SYLAR_LOG_FATAL(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::FATAL)
 
 #define SYLAR_LOG_FMT_LEVEL(logger, level, fmt, ...)    \
-    if (level >= logger->getLevel()) \
-        sylar::LogEventWrap(std::make_shared<sylar::LogEvent>(logger, level, __FILE__, \
-            __LINE__, 0, sylar::GetThreadId(), sylar::GetFiberId(), time(0), sylar::Thread::GetName())).getEvent()->format(fmt, ##__VA_ARGS__)
+    if (level >= SYLAR_LOG_MIN_LEVEL && level >= logger->getLevel()) \
+        sylar::LocalLogEventWrap(logger, level, __FILE__, __LINE__, sylar::GetThreadId(), \
+            sylar::GetFiberId(), sylar::GetCurrentUS(), sylar::Thread::GetName()).getEvent().format(fmt, ##__VA_ARGS__)
 
 #define SYLAR_LOG_FMT_DEBUG(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::DEBUG, fmt,  ##__VA_ARGS__)
 #define SYLAR_LOG_FMT_INFO(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::INFO, fmt, ##__VA_ARGS__)
@@ -37,6 +47,34 @@
 #define SYLAR_LOG_FMT_ERROR(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::ERROR, fmt, ##__VA_ARGS__)
 #define SYLAR_LOG_FMT_FATAL(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::FATAL, fmt, ##__VA_ARGS__)
 
+// 按名字取Logger，每个调用点缓存查到的Logger和是否输出，日志级别变化后重新查找
+// 不输出时只比较一次版本号，不查找LoggerManager；name和level需要是常量
+#define SYLAR_LOG_SITE(name, level) \
+    ((level) >= SYLAR_LOG_MIN_LEVEL ? []() -> sylar::LogSite& { \
+        static sylar::LogSite s_site(name, level); return s_site; }().get() : nullptr)
+
+#define SYLAR_LOG_NAME_LEVEL(name, level) \
+    if (sylar::Logger* __sylar_logger = SYLAR_LOG_SITE(name, level)) \
+        sylar::LocalLogEventWrap(__sylar_logger->shared_from_this(), level, __FILE__, __LINE__, sylar::GetThreadId(), \
+            sylar::GetFiberId(), sylar::GetCurrentUS(), sylar::Thread::GetName()).getSS()
+
+#define SYLAR_LOG_NAME_DEBUG(name) SYLAR_LOG_NAME_LEVEL(name, sylar::LogLevel::DEBUG)
+#define SYLAR_LOG_NAME_INFO(name) SYLAR_LOG_NAME_LEVEL(name, sylar::LogLevel::INFO)
+#define SYLAR_LOG_NAME_WARN(name) SYLAR_LOG_NAME_LEVEL(name, sylar::LogLevel::WARN)
+#define SYLAR_LOG_NAME_ERROR(name) SYLAR_LOG_NAME_LEVEL(name, sylar::LogLevel::ERROR)
+#define SYLAR_LOG_NAME_FATAL(name) SYLAR_LOG_NAME_LEVEL(name, sylar::LogLevel::FATAL)
+
+#define SYLAR_LOG_NAME_FMT_LEVEL(name, level, fmt, ...)    \
+    if (sylar::Logger* __sylar_logger = SYLAR_LOG_SITE(name, level)) \
+        sylar::LocalLogEventWrap(__sylar_logger->shared_from_this(), level, __FILE__, __LINE__, sylar::GetThreadId(), \
+            sylar::GetFiberId(), sylar::GetCurrentUS(), sylar::Thread::GetName()).getEvent().format(fmt, ##__VA_ARGS__)
+
+#define SYLAR_LOG_NAME_FMT_DEBUG(name, fmt, ...) SYLAR_LOG_NAME_FMT_LEVEL(name, sylar::LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+#define SYLAR_LOG_NAME_FMT_INFO(name, fmt, ...) SYLAR_LOG_NAME_FMT_LEVEL(name, sylar::LogLevel::INFO, fmt, ##__VA_ARGS__)
+#define SYLAR_LOG_NAME_FMT_WARN(name, fmt, ...) SYLAR_LOG_NAME_FMT_LEVEL(name, sylar::LogLevel::WARN, fmt, ##__VA_ARGS__)
+#define SYLAR_LOG_NAME_FMT_ERROR(name, fmt, ...) SYLAR_LOG_NAME_FMT_LEVEL(name, sylar::LogLevel::ERROR, fmt, ##__VA_ARGS__)
+#define SYLAR_LOG_NAME_FMT_FATAL(name, fmt, ...) SYLAR_LOG_NAME_FMT_LEVEL(name, sylar::LogLevel::FATAL, fmt, ##__VA_ARGS__)
+
 #define SYLAR_LOG_ROOT() sylar::LoggerMgr::GetInstance()->getRoot()
 #define SYLAR_LOG_NAME(name) sylar::LoggerMgr::GetInstance()->getLogger(name)
 
@@ -63,14 +101,140 @@ namespace sylar
         static LogLevel::Level FromString(const std::string& str);
     };
 
+    // 日志调用点的缓存，由SYLAR_LOG_NAME_*使用
+    // Logger创建后不会被删除，缓存它的指针；是否输出带着版本号，任何Logger的级别变化后都重新判断
+    class LogSite
+    {
+    public:
+        // 常量初始化，作为局部静态变量时没有初始化检查
+        constexpr LogSite(const char* name, LogLevel::Level level)
+            : m_name(name), m_level(level), m_logger(nullptr), m_state(0) {}
+
+        // 这个调用点需要输出时返回Logger，否则返回nullptr
+        Logger* get() {
+            uint64_t state = m_state.load(std::memory_order_acquire);
+            if ((state >> 1) == s_version.load(std::memory_order_relaxed)) {
+                return (state & 1) ? m_logger.load(std::memory_order_relaxed) : nullptr;
+            }
+            return refresh();
+        }
+
+        // 日志级别变化后调用，所有调用点的缓存失效
+        static void Invalidate() { ++s_version; }
+
+    private:
+        Logger* refresh();
+
+    private:
+        const char* m_name;
+        LogLevel::Level m_level;
+        std::atomic<Logger*> m_logger;
+        std::atomic<uint64_t> m_state;                  // 版本号 << 1 | 是否输出
+        static std::atomic<uint64_t> s_version;
+    };
+
+    // 日志输出流，写入线程局部的定长缓冲区，常用类型直接格式化，不经过iostream
+    // 缓冲区写满后转到堆上继续写；其他类型和流操纵符交给std::ostream，之后的输出都经过它以保留格式状态
+    class LogStream : Noncopyable
+    {
+    public:
+        // local为true时使用线程局部的缓冲区，只用于在当前语句或函数内析构的栈上对象，
+        // 缓冲区都在使用中(嵌套日志或协程切换)时直接写到堆上
+        explicit LogStream(bool local = false);
+        ~LogStream();
+
+        LogStream& operator<<(bool v);
+        LogStream& operator<<(char v);
+        LogStream& operator<<(signed char v) { return *this << (char)v; }
+        LogStream& operator<<(unsigned char v) { return *this << (char)v; }
+        LogStream& operator<<(short v) { return appendInteger(v); }
+        LogStream& operator<<(unsigned short v) { return appendInteger(v); }
+        LogStream& operator<<(int v) { return appendInteger(v); }
+        LogStream& operator<<(unsigned int v) { return appendInteger(v); }
+        LogStream& operator<<(long v) { return appendInteger(v); }
+        LogStream& operator<<(unsigned long v) { return appendInteger(v); }
+        LogStream& operator<<(long long v) { return appendInteger(v); }
+        LogStream& operator<<(unsigned long long v) { return appendInteger(v); }
+        LogStream& operator<<(float v) { return *this << (double)v; }
+        LogStream& operator<<(double v);
+        LogStream& operator<<(const char* v);
+        LogStream& operator<<(const std::string& v);
+        LogStream& operator<<(const void* v);
+        LogStream& operator<<(std::ostream& (*pf)(std::ostream&)) { getOStream() << pf; return *this; }
+        LogStream& operator<<(std::ios_base& (*pf)(std::ios_base&)) { getOStream() << pf; return *this; }
+
+        template<typename T>
+        LogStream& operator<<(const T& v) {
+            getOStream() << v;
+            return *this;
+        }
+
+        void append(const char* data, size_t len);
+        void appendf(const char* fmt, va_list ap);
+
+        const char* data() const { return m_data; }
+        size_t size() const { return m_size; }
+        std::string str() const { return std::string(m_data, m_size); }
+        void clear() { m_size = 0; }
+
+        // 写入这个流的std::ostream
+        std::ostream& getOStream();
+
+    private:
+        template<typename T>
+        LogStream& appendInteger(T v);
+        // 保证还能写入len字节
+        void reserve(size_t len);
+
+    private:
+        class StreamBuf;
+        char* m_data;
+        size_t m_size = 0;
+        size_t m_cap;
+        void* m_buffer;                         // 线程局部的缓冲区，没有取到时为nullptr
+        std::string m_heap;
+        std::unique_ptr<StreamBuf> m_streambuf;
+        std::unique_ptr<std::ostream> m_ostream;
+    };
+
+    template<typename T>
+    LogStream& LogStream::appendInteger(T v) {
+        if (m_ostream) {
+            *m_ostream << v;
+            return *this;
+        }
+        using U = typename std::make_unsigned<T>::type;
+        char tmp[24];
+        char* end = tmp + sizeof(tmp);
+        char* p = end;
+        U u = (U)v;
+        bool neg = v < 0;
+        if (neg) {
+            u = 0 - u;
+        }
+        do {
+            *--p = '0' + u % 10;
+            u /= 10;
+        } while (u);
+        if (neg) {
+            *--p = '-';
+        }
+        append(p, end - p);
+        return *this;
+    }
+
     // 日志事件
     class LogEvent
     {
     public:
         using ptr = std::shared_ptr<LogEvent>;
 
-        LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, const char* file, int32_t line, uint32_t elapse, uint32_t thread_id, uint32_t fiber_id, uint64_t time, const std::string threadName)
-            : m_file(file), m_line(line), m_elapse(elapse), m_threadId(thread_id), m_fiberId(fiber_id), m_time(time), m_logger(logger), m_level(level), m_threadName(threadName) {}
+        // threadName只保存引用，需要在事件输出之前一直有效
+        // local_buffer为true时内容写到线程局部的缓冲区，只用于栈上的LocalLogEventWrap
+        LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, const char* file, int32_t line, uint32_t elapse, uint32_t thread_id, uint32_t fiber_id, uint64_t time, const std::string& threadName, bool local_buffer = false)
+            : m_file(file), m_line(line), m_elapse(elapse), m_threadId(thread_id), m_fiberId(fiber_id), m_time(time), m_ss(local_buffer), m_logger(logger), m_level(level), m_threadName(&threadName) {}
+        // 临时字符串在构造完就析构，不能作为线程名
+        LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, const char* file, int32_t line, uint32_t elapse, uint32_t thread_id, uint32_t fiber_id, uint64_t time, std::string&& threadName, bool local_buffer = false) = delete;
 
         const char* getFile() const { return m_file; }
         int32_t getLine() const { return m_line; }
@@ -78,11 +242,15 @@ namespace sylar
         int32_t getThreadId() const { return m_threadId; }
         int32_t getFiberId() const { return m_fiberId; }
         uint64_t getTime() const { return m_time; }
+        // 秒内的微秒数，SYLAR_LOG_*在记录时间时一起取得
+        uint32_t getMicrosecond() const { return m_usec; }
+        void setMicrosecond(uint32_t v) { m_usec = v; }
         const std::string getContent() const { return m_ss.str(); }
-        std::stringstream& getSS() { return m_ss; }
+        LogStream& getSS() { return m_ss; }
+        const LogStream& getSS() const { return m_ss; }
         std::shared_ptr<Logger> getLogger() const { return m_logger; }
         LogLevel::Level getLevel() const { return m_level; }
-        const std::string& getThreadName() const { return m_threadName; }
+        const std::string& getThreadName() const { return *m_threadName; }
 
         void format(const char* fmt, ...);
 
@@ -93,10 +261,11 @@ namespace sylar
         uint32_t m_threadId = 0;            // 线程id
         uint32_t m_fiberId = 0;             // 协程id
         uint64_t m_time = 0;                // 时间戳
-        std::stringstream m_ss;
+        uint32_t m_usec = 0;                // 时间戳的微秒部分
+        LogStream m_ss;
         std::shared_ptr<Logger> m_logger;
         LogLevel::Level m_level;
-        std::string m_threadName;
+        const std::string* m_threadName;
     };
 
     // 日志格式器
@@ -108,6 +277,8 @@ namespace sylar
         LogFormatter(const std::string& pattern);
         // std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
         std::ostream& format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+        // 不经过iostream的格式化，Appender使用
+        LogStream& format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event);
         void init();
         bool isError() const { return m_error; }
 
@@ -118,6 +289,10 @@ namespace sylar
             using ptr = std::shared_ptr<FormatItem>;
             virtual ~FormatItem() {}
             virtual void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
+            // 默认交给std::ostream版本
+            virtual void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+                format(os.getOStream(), logger, level, event);
+            }
         };
 
     private:
@@ -127,12 +302,21 @@ namespace sylar
     };
 
     // 日志输出地
-    class LogAppender
+    class LogAppender : public std::enable_shared_from_this<LogAppender>
     {
+        friend class LogFlusher;
     public:
         using ptr = std::shared_ptr<LogAppender>;
         using MutexType = Mutex;
 
+        // 异步模式下当前线程的环形缓冲区满时的处理
+        enum Overflow
+        {
+            BLOCK = 0,          // 等待后台线程写出
+            DROP = 1,           // 丢弃
+            DROP_BELOW = 2      // 低于overflow_level的丢弃，其余等待
+        };
+
         virtual ~LogAppender() {};
         virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
 
@@ -145,16 +329,48 @@ namespace sylar
         }
         void setFormatter(LogFormatter::ptr formatter) {
             MutexType::Lock lock(m_mutex);
-            m_formatter = formatter;
+            std::atomic_store(&m_formatter, formatter);
         }
         void setFormatter(const std::string& str) {
             MutexType::Lock lock(m_mutex);
-            m_formatter = std::make_shared<LogFormatter>(str);
+            std::atomic_store(&m_formatter, std::make_shared<LogFormatter>(str));
+        }
+
+        // 异步模式: 日志在调用线程格式化后放入该线程的环形缓冲区，由后台线程批量写出
+        void setAsync(bool v);
+        bool isAsync() const { return m_asyncId != 0; }
+
+        void setOverflow(Overflow overflow, LogLevel::Level level = LogLevel::WARN) {
+            m_overflow = overflow;
+            m_overflowLevel = level;
         }
+        Overflow getOverflow() const { return m_overflow; }
+        LogLevel::Level getOverflowLevel() const { return m_overflowLevel; }
+
+        // 异步模式下因缓冲区满丢弃的日志条数
+        uint64_t getDropped() const { return m_dropped; }
+
+        // 等待所有线程已经写入缓冲区的异步日志写出
+        static void FlushAsync();
+
+    protected:
+        // 异步模式下放入缓冲区后返回true，未开启异步时返回false，由调用者同步写出
+        bool asyncLog(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+        // 格式化后放入当前线程的缓冲区，调用期间计入m_asyncWriters
+        bool pushAsync(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event);
+
+        // 后台线程调用，data为多条格式化好的日志
+        virtual void write(const char* data, size_t len) = 0;
+
     protected:
         LogLevel::Level m_level = LogLevel::Level::UNKNOW;
         LogFormatter::ptr m_formatter;
         MutexType m_mutex;
+        std::atomic<uint32_t> m_asyncId{ 0 };           // 在后台线程中注册的id，0表示同步
+        std::atomic<uint32_t> m_asyncWriters{ 0 };      // 正在向缓冲区写入的线程数
+        Overflow m_overflow = BLOCK;
+        LogLevel::Level m_overflowLevel = LogLevel::WARN;
+        std::atomic<uint64_t> m_dropped{ 0 };
     };
 
     // 日志器
@@ -179,7 +395,10 @@ namespace sylar
         void clearAppends();
 
         const std::string& getName() const { return m_name; }
-        void setLevel(LogLevel::Level level) { m_level = level; }
+        void setLevel(LogLevel::Level level) {
+            m_level = level;
+            LogSite::Invalidate();
+        }
         LogLevel::Level getLevel() const { return m_level; }
 
         void setFormatter(LogFormatter::ptr formatter) {
@@ -206,23 +425,67 @@ namespace sylar
         using ptr = std::shared_ptr<StdoutLogAppender>;
 
         void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+
+    protected:
+        void write(const char* data, size_t len) override;
     };
 
     // 输出到文件的Appender
     class FileLogAppender : public LogAppender
     {
+        friend class LogRotator;
     public:
         using ptr = std::shared_ptr<FileLogAppender>;
 
+        // 日志文件切分，切分出的文件命名为 文件名.年月日-时分秒[.序号][.gz]
+        struct RotateOption
+        {
+            uint64_t max_size = 0;      // 文件超过该字节数时切分(每次写入后判断)，0为不按大小切分
+            uint32_t interval = 0;      // 按本地时间对齐每interval秒切分，0为不按时间切分
+            uint32_t max_files = 0;     // 保留最近切分出的文件个数，0为全部保留
+            bool compress = false;      // 切分出的文件用gzip压缩
+
+            bool operator==(const RotateOption& rhs) const {
+                return max_size == rhs.max_size
+                    && interval == rhs.interval
+                    && max_files == rhs.max_files
+                    && compress == rhs.compress;
+            }
+        };
+
         FileLogAppender(const std::string& filename);
 
         void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
 
         bool reopen();
 
+        const std::string& getFilename() const { return m_filename; }
+
+        void setRotate(const RotateOption& option);
+        RotateOption getRotate();
+
+        // 立即切分，由后台线程完成
+        void rotate();
+
+        // 等待已经提交的切分(包括压缩和清理)完成
+        static void WaitRotate();
+
+    protected:
+        void write(const char* data, size_t len) override;
+
+    private:
+        // 持有m_mutex时调用，写入len字节后判断是否需要切分
+        void checkRotate(size_t len);
+        // 在后台线程中执行: 改名、打开新文件、压缩和清理旧文件
+        void doRotate();
+
     private:
         std::string m_filename;
         std::ofstream m_filestream;
+        RotateOption m_rotate;
+        uint64_t m_fileSize = 0;        // 当前文件大小
+        time_t m_nextRotate = 0;        // 下次按时间切分的时间
+        bool m_rotating = false;        // 已经提交给后台线程，尚未完成
     };
 
     // 日志事件包装器
@@ -234,11 +497,29 @@ namespace sylar
             m_event->getLogger()->log(m_event->getLevel(), m_event);
         }
         LogEvent::ptr getEvent() const { return m_event; }
-        std::stringstream& getSS() { return m_event->getSS(); }
+        LogStream& getSS() { return m_event->getSS(); }
     private:
         LogEvent::ptr m_event;
     };
 
+    // 日志事件在栈上的包装器，析构时输出，传给Logger的是不持有所有权的LogEvent::ptr
+    // Appender不能在log返回后继续引用事件
+    class LocalLogEventWrap : Noncopyable
+    {
+    public:
+        // time_us为微秒时间戳
+        LocalLogEventWrap(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const char* file, int32_t line,
+            uint32_t thread_id, uint32_t fiber_id, uint64_t time_us, const std::string& thread_name)
+            : m_event(logger, level, file, line, 0, thread_id, fiber_id, time_us / 1000000, thread_name, true) {
+            m_event.setMicrosecond(time_us % 1000000);
+        }
+        ~LocalLogEventWrap();
+        LogEvent& getEvent() { return m_event; }
+        LogStream& getSS() { return m_event.getSS(); }
+    private:
+        LogEvent m_event;
+    };
+
     class LoggerManager
     {
     public:
@@ -287,6 +568,9 @@ namespace sylar
         void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
             os << event->getLogger()->getName();
         }
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+            os << event->getLogger()->getName();
+        }
     };
 
     class FilenameFormatItem : public LogFormatter::FormatItem
@@ -296,6 +580,9 @@ namespace sylar
         void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
             os << event->getFile();
         }
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+            os << event->getFile();
+        }
     };
 
     class LineFormatItem : public LogFormatter::FormatItem
@@ -305,6 +592,9 @@ namespace sylar
         void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
             os << event->getLine();
         }
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+            os << event->getLine();
+        }
     };
 
     class ElapseFormatItem : public LogFormatter::FormatItem
@@ -315,6 +605,9 @@ namespace sylar
         void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
             os << event->getElapse();
         }
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+            os << event->getElapse();
+        }
     };
 
     class ThreadIdFormatItem : public LogFormatter::FormatItem
@@ -325,6 +618,9 @@ namespace sylar
         void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
             os << event->getThreadId();
         }
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+            os << event->getThreadId();
+        }
     };
 
     class ThreadNameFormatItem : public LogFormatter::FormatItem
@@ -335,6 +631,9 @@ namespace sylar
         void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
             os << event->getThreadName();
         }
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+            os << event->getThreadName();
+        }
     };
 
     class FiberIdIdFormatItem : public LogFormatter::FormatItem
@@ -345,27 +644,35 @@ namespace sylar
         void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
             os << event->getFiberId();
         }
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+            os << event->getFiberId();
+        }
     };
 
+    // 时间，格式为strftime的格式，另外%L为毫秒(3位)，%f为微秒(6位)
+    // 格式在构造时预先解析，每个线程缓存当前秒格式化好的结果，秒数变化时才重新格式化
     class DateTimeFormatItem : public LogFormatter::FormatItem
     {
     public:
-        DateTimeFormatItem(const std::string& format = "%Y-%m-%d %H:%M:%S") : m_format(format) {
-            if (m_format.empty()) {
-                m_format = "%Y-%m-%d %H:%M:%S";
-            }
-        }
+        DateTimeFormatItem(const std::string& format = "%Y-%m-%d %H:%M:%S");
+
+        void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
+
+    private:
+        // 一段strftime格式，后面跟着subsecond位的秒的小数部分(0表示没有)
+        struct Part
+        {
+            std::string format;
+            int subsecond;
+        };
+
+        void format(LogStream& os, time_t sec, uint32_t usec);
 
-        void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-            struct tm tm;
-            time_t time = event->getTime();
-            localtime_r(&time, &tm);
-            char timeBuff[64];
-            strftime(timeBuff, sizeof(timeBuff), m_format.c_str(), &tm);
-            os << timeBuff;
-        }
     private:
         std::string m_format;
+        std::vector<Part> m_parts;
+        uint64_t m_id;              // 线程缓存中区分不同的格式
     };
 
     class MessageFormatItem : public LogFormatter::FormatItem
@@ -376,6 +683,9 @@ namespace sylar
         void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
             os << event->getContent();
         }
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+            os.append(event->getSS().data(), event->getSS().size());
+        }
     };
 
     class LevelFormatItem : public LogFormatter::FormatItem
@@ -386,6 +696,9 @@ namespace sylar
         void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
             os << LogLevel::ToString(level);
         }
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+            os << LogLevel::ToString(level);
+        }
     };
 
     class NewLineFormatItem : public LogFormatter::FormatItem
@@ -396,6 +709,9 @@ namespace sylar
         void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
             os << std::endl;
         }
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+            os << '\n';
+        }
     };
 
     class StringFormatItem : public LogFormatter::FormatItem
@@ -406,6 +722,9 @@ namespace sylar
         void format(std::ostream& os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
             os << m_string;
         }
+        void format(LogStream& os, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+            os << m_string;
+        }
     private:
         std::string m_string;
     };
@@ -0,0 +1,56 @@
+#ifndef __SYLAR_MPSC_QUEUE_H__
+#define __SYLAR_MPSC_QUEUE_H__
+
+#include <atomic>
+#include "noncopyable.h"
+
+namespace sylar
+{
+    // 侵入式无锁多生产者队列，T需要有 T* next 成员
+    // 生产者用CAS把节点(或一串节点)挂到链表头，消费者一次取走全部节点，
+    // 多个消费者同时popAll也是安全的(exchange不存在ABA问题)
+    template<typename T>
+    class MpscQueue : Noncopyable
+    {
+    public:
+        MpscQueue() : m_head(nullptr) {}
+
+        void push(T* node) {
+            push(node, node);
+        }
+
+        // 一次性放入一串节点，newest->...->oldest 已经通过next串好(从新到旧)
+        void push(T* newest, T* oldest) {
+            T* head = m_head.load(std::memory_order_relaxed);
+            do {
+                oldest->next = head;
+            } while (!m_head.compare_exchange_weak(head, newest,
+                std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        // 取出所有节点，按放入的先后顺序返回链表
+        T* popAll() {
+            if (!m_head.load(std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            T* node = m_head.exchange(nullptr, std::memory_order_acquire);
+            T* prev = nullptr;
+            while (node) {
+                T* next = node->next;
+                node->next = prev;
+                prev = node;
+                node = next;
+            }
+            return prev;
+        }
+
+        bool empty() const {
+            return m_head.load(std::memory_order_relaxed) == nullptr;
+        }
+
+    private:
+        std::atomic<T*> m_head;
+    };
+}
+
+#endif
@@ -1,6 +1,8 @@
 #include "scheduler.h"
 #include "macro.h"
+#include "config.h"
 #include <string>
+#include <sched.h>
 #include <hook.h>
 
 namespace sylar
@@ -11,6 +13,26 @@ namespace sylar
     static thread_local Scheduler* t_scheduler = nullptr;
     static thread_local Fiber::ptr t_scheduler_fiber = nullptr;         // 当前线程的调度协程
 
+    static ConfigVar<uint32_t>::ptr g_scheduler_max_free_fibers =
+        Config::Add<uint32_t>("scheduler.max_free_fibers", 64, "max finished fibers cached per thread for reuse");
+
+    static ConfigVar<uint32_t>::ptr g_scheduler_local_queue_size =
+        Config::Add<uint32_t>("scheduler.local_queue_size", 1024, "capacity of each worker thread's work stealing queue");
+
+    static uint32_t s_max_free_fibers = 0;
+
+    struct _SchedulerIniter
+    {
+        _SchedulerIniter() {
+            s_max_free_fibers = g_scheduler_max_free_fibers->getValue();
+            g_scheduler_max_free_fibers->addListener([](const uint32_t& old_value, const uint32_t& new_value) {
+                SYLAR_LOG_INFO(g_logger) << "scheduler max_free_fibers changed from " << old_value << " to " << new_value;
+                s_max_free_fibers = new_value;
+            });
+        }
+    };
+    static _SchedulerIniter s_scheduler_initer;
+
     Fiber::ptr Scheduler::GetSchedulerFiber() {
         return t_scheduler_fiber;
     }
@@ -20,6 +42,56 @@ namespace sylar
         return t_scheduler;
     }
 
+    template<typename T>
+    static void DeleteTasks(T* task) {
+        while (task) {
+            T* next = task->next;
+            delete task;
+            task = next;
+        }
+    }
+
+    // 放到线程私有链表的末尾
+    template<typename T>
+    static void AppendTask(T*& head, T* task) {
+        task->next = nullptr;
+        T** tail = &head;
+        while (*tail) {
+            tail = &(*tail)->next;
+        }
+        *tail = task;
+    }
+
+    // 当前线程作为工作线程时的任务队列
+    Scheduler::Worker*& Scheduler::GetThisWorker() {
+        static thread_local Worker* t_worker = nullptr;
+        return t_worker;
+    }
+
+    std::vector<int> Scheduler::getThreadIds() const {
+        std::vector<int> ids;
+        for (size_t i = 0; i < m_threadCount; ++i) {
+            ids.push_back(m_workers[i]->threadId);
+        }
+        return ids;
+    }
+
+    int Scheduler::getThisWorkerIndex() const {
+        Worker* worker = GetThisWorker();
+        return worker && worker->scheduler == this ? (int)worker->index : -1;
+    }
+
+    bool Scheduler::hasPendingTask() const {
+        if (!m_fibertasks.empty()) {
+            return true;
+        }
+        Worker* worker = GetThisWorker();
+        if (!worker || worker->scheduler != this) {
+            return false;
+        }
+        return worker->pinned || worker->overflow || !worker->inbox.empty() || !worker->queue.empty();
+    }
+
     // 在非caller线程中，调度协程就是线程的主协程
     // 在caller线程中，调度协程是caller线程的子协程
     Scheduler::Scheduler(size_t threadCount, bool usecaller, const std::string& name)
@@ -34,6 +106,14 @@ namespace sylar
             m_mainSchedulerFiber = t_scheduler_fiber;
             sylar::Thread::SetName(m_name);
         }
+        size_t capacity = g_scheduler_local_queue_size->getValue();
+        for (size_t i = 0; i < m_threadCount; ++i) {
+            m_workers.push_back(new Worker(this, m_workers.size(), capacity));
+        }
+        if (usecaller) {
+            m_workers.push_back(new Worker(this, m_workers.size(), capacity));
+            m_workers.back()->threadId = m_rootThreadId;
+        }
     }
 
     Scheduler::~Scheduler() {
@@ -42,6 +122,17 @@ namespace sylar
         if (t_scheduler == this) {
             t_scheduler = nullptr;
         }
+        DeleteTasks(m_fibertasks.popAll());
+        for (Worker* worker : m_workers) {
+            FiberTask* task = nullptr;
+            while (worker->queue.steal(task)) {
+                delete task;
+            }
+            DeleteTasks(worker->inbox.popAll());
+            DeleteTasks(worker->pinned);
+            DeleteTasks(worker->overflow);
+            delete worker;
+        }
     }
 
     void Scheduler::start() {
@@ -52,12 +143,17 @@ namespace sylar
         m_threadpool.resize(m_threadCount);
         for (size_t i = 0; i < m_threadCount; ++i) {
             m_threadpool[i].reset(new Thread(std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(i)));
+            m_workers[i]->threadId = m_threadpool[i]->getId();
         }
         // lock.unlock();
     }
 
     void Scheduler::stop() {
         m_stopping = true;
+        // 任务已经执行完时，没有人会唤醒空闲线程，要等到idle超时才能退出
+        for (size_t i = 0; i < m_threadCount; ++i) {
+            tickle();
+        }
         if (m_usecaller && !stopping()) {
             m_mainSchedulerFiber->call();
         }
@@ -74,66 +170,233 @@ namespace sylar
         if (sylar::GetThreadId() != m_rootThreadId) {               // 非caller线程，此时创建调度协程（即线程的主协程）
             t_scheduler_fiber = Fiber::GetMainFiber();
         }
+        Worker* worker = nullptr;
+        {
+            // 等待start()记录完所有线程的id
+            MutexType::Lock lock(m_mutex);
+            worker = getWorker(sylar::GetThreadId());
+        }
+        SYLAR_ASSERT(worker);
+        GetThisWorker() = worker;
         Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
+        std::vector<Fiber::ptr> free_fibers;                // 本线程已结束、可复用的协程
+        free_fibers.reserve(s_max_free_fibers);
 
         while (true) {
-            FiberTask fibertask;
-            bool tickle_me = false;
-            bool isactive = false;
-            {
-                MutexType::Lock lock(m_mutex);
-                auto it = m_fibertasks.begin();
-                while (it != m_fibertasks.end()) {
-                    if (it->target_thread_id != -1 && it->target_thread_id != sylar::GetThreadId()) {
-                        ++it;
-                        tickle_me = true;
-                        continue;
+            FiberTask* task = nextTask(worker);
+            if (task) {
+                // 还有任务时唤醒空闲线程来窃取
+                if (m_taskCount > 0) {
+                    tickle();
+                }
+                if (task->cb) {
+                    Fiber::ptr cb_fiber;
+                    if (free_fibers.empty()) {
+                        cb_fiber.reset(new Fiber(std::move(task->cb)));
+                    } else {
+                        cb_fiber.swap(free_fibers.back());
+                        free_fibers.pop_back();
+                        cb_fiber->reset(std::move(task->cb));
                     }
-                    SYLAR_ASSERT(it->fiber || it->cb);
-                    if (it->fiber && it->fiber->getState() == Fiber::State::EXEC) {
-                        ++it;
-                        continue;
+                    delete task;
+                    cb_fiber->swapIn();
+                    --m_activeThreadCount;
+                    recycleFiber(cb_fiber, free_fibers);
+                } else if (task->fiber->getState() == Fiber::State::READY
+                    || task->fiber->getState() == Fiber::State::HOLD) {
+                    Fiber::ptr fiber;
+                    fiber.swap(task->fiber);
+                    delete task;
+                    fiber->swapIn();
+                    --m_activeThreadCount;
+                    recycleFiber(fiber, free_fibers);
+                } else {
+                    delete task;
+                    --m_activeThreadCount;
+                }
+                // 停止时最后一个任务执行完，唤醒所有空闲线程退出
+                if (m_stopping && stopping()) {
+                    for (size_t i = m_idleThreadCount; i > 0; --i) {
+                        tickle();
                     }
-                    fibertask = *it;
-                    m_fibertasks.erase(it++);
-                    ++m_activeThreadCount;
-                    isactive = true;
-                    break;
                 }
-                tickle_me |= it != m_fibertasks.end();
+                continue;
             }
-            if (tickle_me) {
+            // 剩下的任务只能由其他线程执行(指定了线程)，唤醒它们
+            if (m_taskCount > 0) {
                 tickle();
             }
-            if (fibertask.cb) {
-                Fiber::ptr cb_fiber(new Fiber(fibertask.cb));
-                cb_fiber->swapIn();
-                --m_activeThreadCount;
-                if (cb_fiber->getState() == Fiber::State::READY) {
-                    schedule(cb_fiber);
-                }
-            } else if (fibertask.fiber &&
-                (fibertask.fiber->getState() == Fiber::State::READY
-                    || fibertask.fiber->getState() == Fiber::State::HOLD)) {
-                fibertask.fiber->swapIn();
-                --m_activeThreadCount;
-                if (fibertask.fiber->getState() == Fiber::State::READY) {
-                    schedule(fibertask.fiber);
+            if (idle_fiber->getState() == Fiber::State::TERM) {
+                SYLAR_LOG_INFO(g_logger) << "idle fiber term";
+                break;
+            }
+            ++m_idleThreadCount;
+            idle_fiber->swapIn();
+            --m_idleThreadCount;
+        }
+        GetThisWorker() = nullptr;
+    }
+
+    // 提交任务: 指定线程的放入该线程的inbox，本调度器的工作线程放入自己的队列，其他线程放入全局队列
+    bool Scheduler::scheduleNoTickle(FiberTask* task) {
+        ++m_taskCount;
+        if (task->target_thread_id != -1) {
+            Worker* target = getWorker(task->target_thread_id);
+            if (target) {
+                target->inbox.push(task);
+                return m_idleThreadCount > 0;
+            }
+        } else {
+            Worker* worker = GetThisWorker();
+            if (worker && worker->scheduler == this && worker->queue.push(task)) {
+                return m_idleThreadCount > 0;
+            }
+        }
+        m_fibertasks.push(task);
+        return m_idleThreadCount > 0;
+    }
+
+    // 批量提交: newest->...->oldest 一次性放入目标线程的inbox或全局队列
+    bool Scheduler::scheduleNoTickle(FiberTask* newest, FiberTask* oldest, size_t count) {
+        m_taskCount += count;
+        Worker* target = nullptr;
+        if (oldest->target_thread_id != -1) {
+            target = getWorker(oldest->target_thread_id);
+        }
+        if (target) {
+            target->inbox.push(newest, oldest);
+        } else {
+            m_fibertasks.push(newest, oldest);
+        }
+        return m_idleThreadCount > 0;
+    }
+
+    // 放回任务: 指定线程的放回本线程的私有链表，其他的放回本线程队列或全局队列
+    void Scheduler::requeue(Worker* worker, FiberTask* task) {
+        if (task->target_thread_id != -1) {
+            AppendTask(worker->pinned, task);
+        } else if (!worker->queue.push(task)) {
+            m_fibertasks.push(task);
+        }
+    }
+
+    // 依次从inbox、本线程队列、全局队列、其他线程队列中取任务
+    Scheduler::FiberTask* Scheduler::nextTask(Worker* worker) {
+        static const int MAX_EXEC_RETRY = 16;
+        for (int retry = 1; ; ++retry) {
+            FiberTask* task = nullptr;
+            if (!worker->pinned) {
+                worker->pinned = worker->inbox.popAll();
+            }
+            if (worker->pinned) {
+                task = worker->pinned;
+                worker->pinned = task->next;
+                task->next = nullptr;
+            }
+            // 本线程也从top端取任务，保持先进先出，避免重新调度自己的协程饿死其他任务
+            while (!task && !worker->queue.empty()) {
+                worker->queue.steal(task);
+            }
+            if (!task) {
+                task = takeGlobal(worker);
+            }
+            if (!task) {
+                task = steal(worker);
+            }
+            if (!task) {
+                return nullptr;
+            }
+            // 协程还在其他线程上执行(刚把自己加入调度，还未切出)，放回去稍后再执行
+            // 不能就此进入idle，否则任务留在本线程队列里要等到epoll超时
+            if (task->fiber && task->fiber->getState() == Fiber::State::EXEC) {
+                requeue(worker, task);
+                if (retry % MAX_EXEC_RETRY == 0) {
+                    sched_yield();                  // 让出CPU，等对方线程完成切换
                 }
-            } else {
-                if (isactive) {
-                    --m_activeThreadCount;
+                continue;
+            }
+            ++m_activeThreadCount;
+            --m_taskCount;
+            return task;
+        }
+    }
+
+    // 取出全局队列的所有任务，返回第一个，其余的放入本线程队列，放不下的留在overflow中
+    Scheduler::FiberTask* Scheduler::takeGlobal(Worker* worker) {
+        FiberTask* tasks = worker->overflow;
+        worker->overflow = nullptr;
+        if (!tasks) {
+            tasks = m_fibertasks.popAll();
+        }
+        FiberTask* first = nullptr;
+        int thread_id = worker->threadId;
+        while (tasks) {
+            FiberTask* task = tasks;
+            tasks = task->next;
+            task->next = nullptr;
+            // start()之前提交的指定线程任务
+            if (task->target_thread_id != -1 && task->target_thread_id != thread_id) {
+                Worker* target = getWorker(task->target_thread_id);
+                if (target) {
+                    target->inbox.push(task);
                     continue;
                 }
-                if (idle_fiber->getState() == Fiber::State::TERM) {
-                    SYLAR_LOG_INFO(g_logger) << "idle fiber term";
-                    break;
+            }
+            if (!first) {
+                first = task;
+            } else if (!worker->queue.push(task)) {
+                task->next = tasks;
+                worker->overflow = task;
+                break;
+            }
+        }
+        return first;
+    }
+
+    // 从随机的一个线程开始，尝试窃取其他线程队列中的任务
+    Scheduler::FiberTask* Scheduler::steal(Worker* worker) {
+        static thread_local uint32_t s_seed = sylar::GetThreadId();
+        size_t count = m_workers.size();
+        s_seed ^= s_seed << 13;
+        s_seed ^= s_seed >> 17;
+        s_seed ^= s_seed << 5;
+        size_t begin = s_seed % count;
+        FiberTask* task = nullptr;
+        for (size_t i = 0; i < count; ++i) {
+            Worker* victim = m_workers[(begin + i) % count];
+            if (victim == worker) {
+                continue;
+            }
+            while (!victim->queue.empty()) {
+                if (victim->queue.steal(task)) {
+                    return task;
                 }
-                ++m_idleThreadCount;
-                idle_fiber->swapIn();
-                --m_idleThreadCount;
             }
         }
+        return nullptr;
+    }
+
+    Scheduler::Worker* Scheduler::getWorker(int thread_id) {
+        for (Worker* worker : m_workers) {
+            if (worker->threadId == thread_id) {
+                return worker;
+            }
+        }
+        return nullptr;
+    }
+
+    // 协程切出后的处理: READY的重新调度，已结束且只被调度器持有的协程放回空闲列表复用
+    void Scheduler::recycleFiber(Fiber::ptr& fiber, std::vector<Fiber::ptr>& free_fibers) {
+        Fiber::State state = fiber->getState();
+        if (state == Fiber::State::READY) {
+            schedule(fiber);
+        } else if ((state == Fiber::State::TERM || state == Fiber::State::EXCEPT)
+            && fiber.use_count() == 1
+            && free_fibers.size() < s_max_free_fibers
+            && fiber->getStackSize() >= Fiber::GetDefaultStackSize()) {
+            free_fibers.push_back(nullptr);
+            free_fibers.back().swap(fiber);
+        }
     }
 
     void Scheduler::idle() {
@@ -148,8 +411,7 @@ namespace sylar
     }
 
     bool Scheduler::stopping() {
-        MutexType::Lock lock(m_mutex);
-        return m_stopping && m_fibertasks.empty() && m_activeThreadCount == 0;
+        return m_stopping && m_taskCount == 0 && m_activeThreadCount == 0;
     }
 
 }
\ No newline at end of file
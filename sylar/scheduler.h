@@ -4,6 +4,8 @@
 #include "thread.h"
 #include "mutex.h"
 #include "fiber.h"
+#include "work_steal_queue.h"
+#include "mpsc_queue.h"
 #include <vector>
 #include <list>
 #include <memory>
@@ -21,6 +23,8 @@ namespace sylar
         Scheduler(size_t threadCount = 1, bool usecaller = true, const std::string& name = "");
         virtual ~Scheduler();
         const std::string& getName() const { return m_name; }
+        // 线程池中各线程的id，不包括usecaller时的caller线程，start()之后有效
+        std::vector<int> getThreadIds() const;
 
         void start();
         void stop();
@@ -28,7 +32,17 @@ namespace sylar
         void run();
         virtual void idle();
         virtual void tickle();
+        // 唤醒指定的线程来执行指定线程的任务，thread_id为-1时等同于tickle
+        virtual void tickleThread(int thread_id) { tickle(); }
         virtual bool stopping();
+
+        // 工作线程按创建顺序编号，usecaller时caller线程在最后
+        size_t getWorkerCount() const { return m_workers.size(); }
+        int getWorkerThreadId(size_t index) const { return m_workers[index]->threadId; }
+        // 当前线程在本调度器中的编号，不是本调度器的工作线程时返回-1
+        int getThisWorkerIndex() const;
+        // 当前线程还有可以执行的任务(全局队列、本线程的inbox和队列)
+        bool hasPendingTask() const;
     
     public:
         static Fiber::ptr GetSchedulerFiber();
@@ -37,56 +51,81 @@ namespace sylar
 
         template<typename FiberOrCb>
         void schedule(FiberOrCb fc, int target_thread_id = -1) {
-            bool need_tickle = false;
-            {
-                MutexType::Lock lock(m_mutex);
-                need_tickle = scheduleNoLock(fc, target_thread_id);
-            }
-            if (need_tickle) {
-                tickle();
+            if (fc) {
+                if (scheduleNoTickle(new FiberTask(fc, target_thread_id))) {
+                    tickleThread(target_thread_id);
+                }
             }
         }
 
+        // 先把任务串成链表(从新到旧)，再一次性放入队列
         template<typename InputIterator>
         void schedule(InputIterator begin, InputIterator end, int target_thread_id = -1) {
-            bool need_tickle = false;
-            {
-                MutexType::Lock lock(m_mutex);
-                while (begin != end) {
-                    need_tickle |= scheduleNoLock(*begin, target_thread_id);
-                    ++begin;
+            FiberTask* newest = nullptr;
+            FiberTask* oldest = nullptr;
+            size_t count = 0;
+            while (begin != end) {
+                if (*begin) {
+                    FiberTask* task = new FiberTask(*begin, target_thread_id);
+                    task->next = newest;
+                    newest = task;
+                    if (!oldest) {
+                        oldest = task;
+                    }
+                    ++count;
                 }
+                ++begin;
             }
-            if (need_tickle) {
-                tickle();
+            if (count && scheduleNoTickle(newest, oldest, count)) {
+                tickleThread(target_thread_id);
             }
         }
 
     private:
-        template<class FiberOrCb>
-        bool scheduleNoLock(FiberOrCb fc, int target_thread_id) {
-            bool need_tickle = m_fibertasks.empty();
-            if (fc) {
-                m_fibertasks.emplace_back(fc, target_thread_id);
-            }
-            return need_tickle;
-        }
-
         struct FiberTask
         {
             Fiber::ptr fiber;
             std::function<void()> cb;
             int target_thread_id;
 
-            FiberTask() : fiber(nullptr), cb(nullptr), target_thread_id(-1) {}
-            FiberTask(Fiber::ptr f, int thr) : fiber(f), cb(nullptr), target_thread_id(thr) {}
-            FiberTask(std::function<void()> c, int thr) : fiber(nullptr), cb(c), target_thread_id(thr) {}
+            FiberTask* next;                                // 在MpscQueue和线程私有链表中使用
+
+            FiberTask() : fiber(nullptr), cb(nullptr), target_thread_id(-1), next(nullptr) {}
+            FiberTask(Fiber::ptr f, int thr) : fiber(f), cb(nullptr), target_thread_id(thr), next(nullptr) {}
+            FiberTask(std::function<void()> c, int thr) : fiber(nullptr), cb(c), target_thread_id(thr), next(nullptr) {}
         };
 
+        // 每个工作线程的任务队列
+        struct Worker
+        {
+            Worker(Scheduler* s, size_t i, size_t capacity) : scheduler(s), index(i), queue(capacity) {}
+
+            Scheduler* scheduler;
+            size_t index;                                   // 在m_workers中的下标
+            WorkStealQueue<FiberTask*> queue;               // 本线程产生的任务，其他线程可以窃取
+            MpscQueue<FiberTask> inbox;                     // 指定在本线程执行的任务
+            FiberTask* pinned = nullptr;                    // 从inbox取出还未执行的任务，只有本线程访问
+            FiberTask* overflow = nullptr;                  // 从全局队列取出但queue放不下的任务，只有本线程访问
+            std::atomic<int> threadId{ -1 };
+        };
+
+        static Worker*& GetThisWorker();
+
+        bool scheduleNoTickle(FiberTask* task);
+        bool scheduleNoTickle(FiberTask* newest, FiberTask* oldest, size_t count);
+        void requeue(Worker* worker, FiberTask* task);
+        FiberTask* nextTask(Worker* worker);
+        FiberTask* takeGlobal(Worker* worker);
+        FiberTask* steal(Worker* worker);
+        Worker* getWorker(int thread_id);
+        void recycleFiber(Fiber::ptr& fiber, std::vector<Fiber::ptr>& free_fibers);
+
     private:
         MutexType m_mutex;
         std::vector<Thread::ptr> m_threadpool;         // 线程池
-        std::list<FiberTask> m_fibertasks;             // 待执行的协程任务
+        std::vector<Worker*> m_workers;                // 每个工作线程的任务队列，caller线程在最后
+        MpscQueue<FiberTask> m_fibertasks;             // 非工作线程提交的任务以及批量提交的任务
+        std::atomic<size_t> m_taskCount{ 0 };          // 所有队列中待执行的任务数量
         bool m_usecaller;
         Fiber::ptr m_mainSchedulerFiber;                // usecaller时，main线程的调度协程
         std::string m_name;
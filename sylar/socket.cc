@@ -103,8 +103,11 @@ namespace sylar
         Socket::ptr newSock = std::make_shared<Socket>(m_family, m_type, m_protocol);
         int newfd = ::accept(m_sockfd, nullptr, nullptr);
         if (newfd == -1) {
-            SYLAR_LOG_ERROR(g_logger) << "accept(" << m_sockfd << ") errno=" << errno
-                << " errstr=" << strerror(errno);
+            // 监听Socket被关闭后accept失败是正常的，不输出错误
+            if (isValidSock()) {
+                SYLAR_LOG_ERROR(g_logger) << "accept(" << m_sockfd << ") errno=" << errno
+                    << " errstr=" << strerror(errno);
+            }
             return nullptr;
         }
         if (newSock->init(newfd)) {
@@ -187,6 +190,28 @@ namespace sylar
         return ::recvfrom(m_sockfd, buf, length, flags, addr->getAddr(), &len);
     }
 
+    int Socket::send(const iovec* buffers, size_t length, int flags) {
+        if (isConnected()) {
+            msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = (iovec*)buffers;
+            msg.msg_iovlen = length;
+            return ::sendmsg(m_sockfd, &msg, flags);
+        }
+        return -1;
+    }
+
+    int Socket::recv(iovec* buffers, size_t length, int flags) {
+        if (isConnected()) {
+            msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = buffers;
+            msg.msg_iovlen = length;
+            return ::recvmsg(m_sockfd, &msg, flags);
+        }
+        return -1;
+    }
+
     std::ostream& Socket::dump(std::ostream& os) const {
         os << "[Socket sockfd=" << m_sockfd
             << " family=" << m_family
@@ -253,6 +278,17 @@ namespace sylar
         return -1;
     }
 
+    bool Socket::setReusePort(bool v) {
+        if (!isValidSock()) {
+            createSock();
+            if (!isValidSock()) {
+                return false;
+            }
+        }
+        int val = v ? 1 : 0;
+        return setOption(SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val));
+    }
+
     bool Socket::isValidSock() const {
         return m_sockfd != -1;
     }
@@ -5,6 +5,7 @@
 #include <netinet/tcp.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "address.h"
 #include "noncopyable.h"
@@ -43,6 +44,9 @@ namespace sylar
         virtual int sendTo(const void* buf, size_t length, const Address::ptr addr, int flags = 0);
         virtual int recv(void* buf, size_t length, int flags = 0);
         virtual int recvFrom(void* buf, size_t length, Address::ptr addr, int flags = 0);
+        // 分散/聚集IO，length为iovec的个数
+        virtual int send(const iovec* buffers, size_t length, int flags = 0);
+        virtual int recv(iovec* buffers, size_t length, int flags = 0);
 
         virtual std::ostream& dump(std::ostream& os) const;
         virtual std::string toString() const;
@@ -54,6 +58,8 @@ namespace sylar
         int64_t getSendTimeout();
         void setRecvTimeout(int64_t t);
         int64_t getRecvTimeout();
+        // 设置SO_REUSEPORT，需在bind之前调用，句柄还未创建时先创建
+        bool setReusePort(bool v);
 
         int getSocketfd() const { return m_sockfd; }
         int getFamily() const { return m_family; }
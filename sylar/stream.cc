@@ -1,4 +1,7 @@
 #include "stream.h"
+#include <vector>
+#include <algorithm>
+#include <limits.h>
 
 namespace sylar
 {
@@ -29,4 +32,55 @@ namespace sylar
         }
         return length;
     }
+
+    int Stream::write(const iovec* buffers, size_t count) {
+        // 返回值是int，一次最多写INT_MAX字节，剩下的由调用者继续写
+        size_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (buffers[i].iov_len == 0) {
+                continue;
+            }
+            size_t length = std::min(buffers[i].iov_len, (size_t)INT_MAX - total);
+            if (length == 0) {
+                break;
+            }
+            int len = write(buffers[i].iov_base, length);
+            if (len <= 0) {
+                return total ? total : len;
+            }
+            total += len;
+            if ((size_t)len < buffers[i].iov_len) {
+                break;
+            }
+        }
+        return total;
+    }
+
+    int Stream::writeFixSize(const iovec* buffers, size_t count) {
+        // 部分写入时要调整iovec，复制一份
+        std::vector<iovec> iovs(buffers, buffers + count);
+        size_t index = 0;
+        uint64_t total = 0;
+        while (index < count) {
+            if (iovs[index].iov_len == 0) {
+                ++index;
+                continue;
+            }
+            int len = write(&iovs[index], count - index);
+            if (len <= 0) {
+                return len;
+            }
+            total += len;
+            size_t left = len;
+            while (index < count && left >= iovs[index].iov_len) {
+                left -= iovs[index].iov_len;
+                ++index;
+            }
+            if (left > 0) {
+                iovs[index].iov_base = (char*)iovs[index].iov_base + left;
+                iovs[index].iov_len -= left;
+            }
+        }
+        return std::min(total, (uint64_t)INT_MAX);
+    }
 }
\ No newline at end of file
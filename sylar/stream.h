@@ -2,6 +2,7 @@
 #define __SYLAR_STREAM_H__
 
 #include <memory>
+#include <sys/uio.h>
 
 namespace sylar
 {
@@ -25,6 +26,12 @@ namespace sylar
         // 写固定长度的数据
         virtual int writeFixSize(const void* buffer, size_t length);
 
+        // 聚集写，count为iovec的个数，默认逐块调用write，一次最多写INT_MAX字节
+        virtual int write(const iovec* buffers, size_t count);
+
+        // 写完所有iovec中的数据，成功时返回写入的字节数，超过INT_MAX时返回INT_MAX
+        virtual int writeFixSize(const iovec* buffers, size_t count);
+
         // 关闭流
         virtual void close() = 0;
     };
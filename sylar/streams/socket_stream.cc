@@ -1,4 +1,6 @@
 #include "socket_stream.h"
+#include <limits.h>
+#include <algorithm>
 
 namespace sylar
 {
@@ -26,6 +28,58 @@ namespace sylar
         return m_socket->send(buffer, length);
     }
 
+    int SocketStream::write(const iovec* buffers, size_t count) {
+        if (!isConnected()) {
+            return -1;
+        }
+        // 超过IOV_MAX时sendmsg失败，只写前面一部分
+        return m_socket->send(buffers, std::min(count, (size_t)IOV_MAX));
+    }
+
+    int SocketStream::read(ByteArray::ptr ba, size_t length) {
+        if (!isConnected()) {
+            return -1;
+        }
+        std::vector<iovec> iovs;
+        ba->getWriteBuffer(iovs, length);
+        if (iovs.empty()) {
+            return 0;
+        }
+        int rt = m_socket->recv(&iovs[0], std::min(iovs.size(), (size_t)IOV_MAX));
+        if (rt > 0) {
+            ba->commit(rt);
+        }
+        return rt;
+    }
+
+    int SocketStream::write(ByteArray::ptr ba, size_t length) {
+        if (!isConnected()) {
+            return -1;
+        }
+        std::vector<iovec> iovs;
+        ba->getReadBuffer(iovs, length);
+        if (iovs.empty()) {
+            return 0;
+        }
+        int rt = m_socket->send(&iovs[0], std::min(iovs.size(), (size_t)IOV_MAX));
+        if (rt > 0) {
+            ba->commit(rt);
+        }
+        return rt;
+    }
+
+    int SocketStream::writeSlice(const ByteSlice& slice) {
+        if (!isConnected()) {
+            return -1;
+        }
+        std::vector<iovec> iovs;
+        slice.getIovec(iovs);
+        if (iovs.empty()) {
+            return 0;
+        }
+        return writeFixSize(&iovs[0], iovs.size());
+    }
+
     void SocketStream::close() {
         if (m_socket) {
             m_socket->close();
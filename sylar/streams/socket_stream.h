@@ -3,6 +3,7 @@
 
 #include "sylar/stream.h"
 #include "sylar/socket.h"
+#include "sylar/bytearray.h"
 
 namespace sylar
 {
@@ -17,6 +18,14 @@ namespace sylar
 
         int read(void* buffer, size_t length) override;
         int write(const void* buffer, size_t length) override;
+        // 一次sendmsg写出所有iovec，不用先拼接成一块
+        int write(const iovec* buffers, size_t count) override;
+        // 直接读到ByteArray的内存块中，读到的数据从当前位置开始写入，位置随之后移
+        int read(ByteArray::ptr ba, size_t length);
+        // 直接从ByteArray的内存块发送当前位置开始的数据，位置随之后移
+        int write(ByteArray::ptr ba, size_t length);
+        // 写出切片的全部数据，引用的内存块直接交给sendmsg，不复制
+        int writeSlice(const ByteSlice& slice);
         void close() override;
         Socket::ptr getSocket() const { return m_socket; }
         bool isConnected() const;
@@ -9,13 +9,17 @@ namespace sylar
     static sylar::ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout =
         sylar::Config::Add("tcp_server.read_timeout", (uint64_t)(60 * 1000 * 2), "tcp server read timeout");
 
+    static sylar::ConfigVar<bool>::ptr g_tcp_server_reuse_port =
+        sylar::Config::Add("tcp_server.reuse_port", false, "one SO_REUSEPORT listener per io worker thread");
+
     TcpServer::TcpServer(IOManager* worker, IOManager* ioWorker, IOManager* acceptWorker)
         : m_worker(worker)
         , m_ioWorker(ioWorker)
         , m_acceptWorker(acceptWorker)
         , m_recvTimeout(g_tcp_server_read_timeout->getValue())
         , m_name("sylar/1.0.0")
-        , m_isStop(true) {}
+        , m_isStop(true)
+        , m_reusePort(g_tcp_server_reuse_port->getValue()) {}
 
     TcpServer::~TcpServer() {}
 
@@ -28,24 +32,42 @@ namespace sylar
 
     bool TcpServer::bind(const std::vector<Address::ptr>& addrs, std::vector<Address::ptr>& fails, bool ssl) {
         m_ssl = ssl;
+        std::vector<int> threads;
+        if (m_reusePort) {
+            threads = m_ioWorker->getThreadIds();
+        }
+        if (threads.empty()) {
+            threads.push_back(-1);
+        }
         for (auto& addr : addrs) {
-            Socket::ptr sock = Socket::CreateTCP(addr);
-            if (!sock->bind(addr)) {
-                SYLAR_LOG_ERROR(g_logger) << "bind fail errno=" << errno << " errstr="
-                    << strerror(errno) << " addr=[" << addr->toString() << "]";
-                fails.push_back(addr);
-                continue;
-            }
-            if (!sock->listen()) {
-                SYLAR_LOG_ERROR(g_logger) << "listen fail errno=" << errno << " errstr="
-                    << strerror(errno) << " addr=[" << addr->toString() << "]";
-                fails.push_back(addr);
-                continue;
+            // 端口为0时第一个Socket绑定后其余的使用它实际分配的端口
+            Address::ptr bindAddr = addr;
+            for (int thread : threads) {
+                Socket::ptr sock = Socket::CreateTCP(addr);
+                if (m_reusePort && !sock->setReusePort(true)) {
+                    fails.push_back(addr);
+                    break;
+                }
+                if (!sock->bind(bindAddr)) {
+                    SYLAR_LOG_ERROR(g_logger) << "bind fail errno=" << errno << " errstr="
+                        << strerror(errno) << " addr=[" << addr->toString() << "]";
+                    fails.push_back(addr);
+                    break;
+                }
+                if (!sock->listen()) {
+                    SYLAR_LOG_ERROR(g_logger) << "listen fail errno=" << errno << " errstr="
+                        << strerror(errno) << " addr=[" << addr->toString() << "]";
+                    fails.push_back(addr);
+                    break;
+                }
+                bindAddr = sock->getLocalAddress();
+                m_socks.push_back(sock);
+                m_sockThreads.push_back(thread);
             }
-            m_socks.push_back(sock);
         }
         if (!fails.empty()) {
             m_socks.clear();
+            m_sockThreads.clear();
             return false;
         }
         for (auto& sock : m_socks) {
@@ -59,10 +81,16 @@ namespace sylar
 
     void TcpServer::stop() {
         m_isStop = true;
-        auto self = shared_from_this();
-        m_acceptWorker->schedule((std::function<void()>)[this, self]() {
-            for (auto& sock : m_socks) {
+        // 立即取走监听Socket，之后start()需要重新bind
+        std::vector<Socket::ptr> socks;
+        socks.swap(m_socks);
+        m_sockThreads.clear();
+        IOManager* acceptWorker = m_reusePort ? m_ioWorker : m_acceptWorker;
+        acceptWorker->schedule((std::function<void()>)[socks]() {
+            // 只cancelAll时被唤醒的accept会重新等待，关闭后accept失败，accept协程才会退出
+            for (auto& sock : socks) {
                 sock->cancelAll();
+                sock->close();
             }
         });
     }
@@ -71,10 +99,16 @@ namespace sylar
         if (!m_isStop) {
             return true;
         }
+        if (m_socks.empty()) {
+            SYLAR_LOG_ERROR(g_logger) << "start without listening socket, bind first name=" << m_name;
+            return false;
+        }
         m_isStop = false;
-        for (auto& sock : m_socks) {
-            m_acceptWorker->schedule((std::function<void()>)std::bind(&TcpServer::startAccept,
-                shared_from_this(), sock));
+        // 分片监听时accept协程在ioWorker的对应线程上
+        IOManager* acceptWorker = m_reusePort ? m_ioWorker : m_acceptWorker;
+        for (size_t i = 0; i < m_socks.size(); ++i) {
+            acceptWorker->schedule((std::function<void()>)std::bind(&TcpServer::startAccept,
+                shared_from_this(), m_socks[i]), m_sockThreads[i]);
         }
         return true;
     }
@@ -84,9 +118,16 @@ namespace sylar
             Socket::ptr client = sock->accept();
             if (client) {
                 client->setRecvTimeout(m_recvTimeout);
+                // 分片监听时在本线程处理，不再跨线程转交
+                // 多reactor模式下连接固定在一个线程上处理，返回-1时由任意线程处理
+                int thread = m_reusePort ? sylar::GetThreadId() : m_ioWorker->pickReactorThread();
                 m_ioWorker->schedule((std::function<void()>)std::bind(&TcpServer::handleClient,
-                    shared_from_this(), client));
+                    shared_from_this(), client), thread);
             } else {
+                // stop()关闭监听Socket后accept失败，正常退出
+                if (m_isStop) {
+                    break;
+                }
                 SYLAR_LOG_ERROR(g_logger) << "accept errno=" << errno
                     << "errstr=" << strerror(errno);
             }
@@ -102,6 +143,7 @@ namespace sylar
         ss << prefix << "[type=" << m_type
             << " name=" << m_name
             << " ssl=" << m_ssl
+            << " reuse_port=" << m_reusePort
             << " worker=" << (m_worker ? m_worker->getName() : "")
             << " ioWorker=" << (m_ioWorker ? m_ioWorker->getName() : "")
             << " acceptWorker=" << (m_acceptWorker ? m_acceptWorker->getName() : "")
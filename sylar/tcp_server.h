@@ -25,12 +25,17 @@ namespace sylar
         virtual bool bind(Address::ptr addr, bool ssl = false);
         virtual bool bind(const std::vector<Address::ptr>& addrs, std::vector<Address::ptr>& fails, bool ssl = false);
 
-        // 启动服务
+        // 启动服务，没有监听Socket(未bind或已经stop)时返回false
         virtual bool start();
 
-        // 停止服务
+        // 停止服务并关闭监听Socket，再次start之前需要重新bind
         virtual void stop();
 
+        // SO_REUSEPORT分片监听: bind时为ioWorker的每个线程打开一个监听Socket，
+        // 每个线程自己accept并在本线程处理连接，需在bind之前设置
+        bool isReusePort() const { return m_reusePort; }
+        void setReusePort(bool v) { m_reusePort = v; }
+
         uint64_t getRecvTimeout() const { return m_recvTimeout; }
         std::string getName()const { return m_name; }
         bool isStop() const { return m_isStop; }
@@ -50,6 +55,7 @@ namespace sylar
 
     protected:
         std::vector<Socket::ptr> m_socks;   // 监听Socket数组
+        std::vector<int> m_sockThreads;     // 监听Socket执行accept的线程，-1表示不指定
         IOManager* m_worker;                // 新连接的Socket工作的调度器
         IOManager* m_ioWorker;              // 新连接的Socket工作的调度器
         IOManager* m_acceptWorker;          // 服务器Socket接收连接的调度器
@@ -58,6 +64,7 @@ namespace sylar
         std::string m_type = "tcp";         // 服务器类型
         bool m_isStop;                      // 服务是否停止
         bool m_ssl = false;
+        bool m_reusePort;                   // 是否使用SO_REUSEPORT分片监听
     };
 }
 
@@ -1,8 +1,32 @@
 #include "timer.h"
 #include "util.h"
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+#include <algorithm>
 
 namespace sylar
 {
+    static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+    static ConfigVar<bool>::ptr g_timer_wheel =
+        Config::Add("timer.wheel", true, "use hierarchical timing wheel instead of std::set in TimerManager");
+
+    static bool s_timer_wheel = true;
+
+    struct _TimerIniter
+    {
+        _TimerIniter() {
+            s_timer_wheel = g_timer_wheel->getValue();
+            g_timer_wheel->addListener([](const bool& old_value, const bool& new_value) {
+                SYLAR_LOG_INFO(g_logger) << "timer wheel changed from " << old_value << " to " << new_value;
+                s_timer_wheel = new_value;
+            });
+        }
+    };
+
+    static _TimerIniter s_timer_initer;
+
     bool Timer::Comparator::operator() (const Timer::ptr& lhs, const Timer::ptr& rhs) const {
         if (!lhs && !rhs) {
             return false;
@@ -19,8 +43,6 @@ namespace sylar
         return lhs.get() < rhs.get();
     }
 
-    Timer::Timer(uint64_t next) : m_next(next) {}
-
     Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager)
         : m_recurring(recurring), m_ms(ms), m_cb(cb), m_manager(manager) {
         m_next = sylar::GetCurrentMS() + m_ms;
@@ -30,7 +52,7 @@ namespace sylar
         TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
         if (m_cb) {
             m_cb = nullptr;
-            m_manager->m_timers.erase(shared_from_this());
+            m_manager->removeTimer(shared_from_this());
             return true;
         }
         return false;
@@ -41,13 +63,12 @@ namespace sylar
         if (!m_cb) {
             return false;
         }
-        auto it = m_manager->m_timers.find(shared_from_this());
-        if (it == m_manager->m_timers.end()) {
+        Timer::ptr self = shared_from_this();
+        if (!m_manager->removeTimer(self)) {
             return false;
         }
-        m_manager->m_timers.erase(it);
         m_next = sylar::GetCurrentMS() + m_ms;
-        m_manager->m_timers.insert(shared_from_this());
+        m_manager->insertTimer(self);
         return true;
     }
 
@@ -59,24 +80,29 @@ namespace sylar
         if (!m_cb) {
             return false;
         }
-        auto it = m_manager->m_timers.find(shared_from_this());
-        if (it == m_manager->m_timers.end()) {
+        Timer::ptr self = shared_from_this();
+        if (!m_manager->removeTimer(self)) {
             return false;
         }
-        m_manager->m_timers.erase(it);
         if (from_now) {
             m_next = sylar::GetCurrentMS() + ms;
         } else {
             m_next = m_next - m_ms + ms;
         }
         m_ms = ms;
-        m_manager->addTimer(shared_from_this(), lock);
+        m_manager->addTimer(self, lock);
         return true;
     }
 
     // ------------------------------------------------------------------------
-    TimerManager::TimerManager() {
+    TimerManager::TimerManager() : m_useWheel(s_timer_wheel) {
         m_previousTime = sylar::GetCurrentMS();
+        m_wheelTime = m_previousTime;
+    }
+
+    TimerManager::~TimerManager() {
+        // 逐个断开槽中的链表，避免长链表析构时递归过深
+        wheelDrain(nullptr);
     }
 
     Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool recurring) {
@@ -87,8 +113,7 @@ namespace sylar
     }
 
     void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock& lock) {
-        auto it = m_timers.insert(val).first;
-        if (it == m_timers.begin() && m_tickled == false) {
+        if (insertTimer(val) && m_tickled == false) {
             m_tickled = true;
             lock.unlock();
             onTimerInsertedAtFront();
@@ -108,15 +133,20 @@ namespace sylar
     }
 
     uint64_t TimerManager::getNextTimer() {
-        RWMutexType::ReadLock lock(m_mutex);
+        RWMutexType::WriteLock lock(m_mutex);
         m_tickled = false;
-        if (m_timers.empty()) {
+        uint64_t next = ~0ull;
+        if (m_useWheel) {
+            next = m_nextExpire = wheelNextExpire();
+        } else if (!m_timers.empty()) {
+            next = (*m_timers.begin())->m_next;
+        }
+        if (next == ~0ull) {
             return ~0ull;
         }
-        Timer::ptr first = *m_timers.begin();
         uint64_t cur_ms = sylar::GetCurrentMS();
-        if (first->m_next > cur_ms) {
-            return first->m_next - cur_ms;
+        if (next > cur_ms) {
+            return next - cur_ms;
         }
         return 0;
     }
@@ -124,29 +154,217 @@ namespace sylar
     void TimerManager::listExpiredCb(std::vector<std::function<void()>>& vec) {
         {
             RWMutexType::ReadLock lock(m_mutex);
-            if (m_timers.empty()) {
+            if (empty()) {
                 return;
             }
         }
         RWMutexType::WriteLock lock(m_mutex);
-        if (m_timers.empty()) {
+        if (empty()) {
             return;
         }
         uint64_t cur_ms = sylar::GetCurrentMS();
         m_previousTime = cur_ms;
         std::vector<Timer::ptr> expired;
-        Timer::ptr curTimer(new Timer(cur_ms));
-        auto it = m_timers.upper_bound(curTimer);
-        expired.insert(expired.begin(), m_timers.begin(), it);
-        m_timers.erase(m_timers.begin(), it);
-        vec.reserve(expired.size());
+        if (m_useWheel) {
+            wheelAdvance(cur_ms, expired);
+        } else {
+            auto it = m_timers.begin();
+            while (it != m_timers.end() && (*it)->m_next <= cur_ms) {
+                ++it;
+            }
+            expired.insert(expired.begin(), m_timers.begin(), it);
+            m_timers.erase(m_timers.begin(), it);
+        }
+        vec.reserve(vec.size() + expired.size());
         for (Timer::ptr& timer : expired) {
             vec.push_back(timer->m_cb);
             if (timer->m_recurring) {
                 timer->m_next = cur_ms + timer->m_ms;
-                m_timers.insert(timer);
+                insertTimer(timer);
+            }
+        }
+        if (m_useWheel) {
+            m_nextExpire = wheelNextExpire();
+        }
+    }
+
+    bool TimerManager::insertTimer(const Timer::ptr& timer) {
+        if (!m_useWheel) {
+            return m_timers.insert(timer).first == m_timers.begin();
+        }
+        wheelAdd(timer);
+        if (timer->m_next < m_nextExpire) {
+            m_nextExpire = timer->m_next;
+            return true;
+        }
+        return false;
+    }
+
+    bool TimerManager::removeTimer(const Timer::ptr& timer) {
+        if (!m_useWheel) {
+            return m_timers.erase(timer) > 0;
+        }
+        if (!timer->m_slot) {
+            return false;
+        }
+        wheelRemove(timer.get());
+        return true;
+    }
+
+    // ------------------------------------------------------------------------
+    Timer::ptr* TimerManager::wheelSlot(uint64_t expire) {
+        if (expire < m_wheelTime) {
+            // 已经过期，放到下一个要处理的槽
+            return &m_wheelRoot[m_wheelTime & (WHEEL_ROOT_SIZE - 1)];
+        }
+        uint64_t delta = expire - m_wheelTime;
+        if (delta < WHEEL_ROOT_SIZE) {
+            return &m_wheelRoot[expire & (WHEEL_ROOT_SIZE - 1)];
+        }
+        for (int level = 0; level < WHEEL_LEVELS; ++level) {
+            int shift = WHEEL_ROOT_BITS + level * WHEEL_LEVEL_BITS;
+            if (level == WHEEL_LEVELS - 1 && delta >> (shift + WHEEL_LEVEL_BITS)) {
+                // 超出时间轮范围，先放在最远的槽，降级时会按真实到期时间重新放置
+                expire = m_wheelTime + (1ull << (shift + WHEEL_LEVEL_BITS)) - 1;
+            }
+            if (level == WHEEL_LEVELS - 1 || (delta >> (shift + WHEEL_LEVEL_BITS)) == 0) {
+                return &m_wheelLevels[level][(expire >> shift) & (WHEEL_LEVEL_SIZE - 1)];
             }
         }
+        SYLAR_ASSERT(false);
+        return nullptr;
     }
 
-}
\ No newline at end of file
+    void TimerManager::wheelAdd(const Timer::ptr& timer) {
+        Timer::ptr* slot = wheelSlot(timer->m_next);
+        timer->m_slot = slot;
+        timer->m_wheelPrev = nullptr;
+        timer->m_wheelNext = *slot;
+        if (*slot) {
+            (*slot)->m_wheelPrev = timer.get();
+        }
+        *slot = timer;
+        ++m_wheelCount;
+    }
+
+    void TimerManager::wheelRemove(Timer* timer) {
+        // 调用者持有timer的引用，断开链表时不会被析构
+        if (timer->m_wheelNext) {
+            timer->m_wheelNext->m_wheelPrev = timer->m_wheelPrev;
+        }
+        if (timer->m_wheelPrev) {
+            timer->m_wheelPrev->m_wheelNext = std::move(timer->m_wheelNext);
+        } else {
+            *timer->m_slot = std::move(timer->m_wheelNext);
+        }
+        timer->m_wheelNext.reset();
+        timer->m_wheelPrev = nullptr;
+        timer->m_slot = nullptr;
+        --m_wheelCount;
+    }
+
+    Timer::ptr TimerManager::wheelTake(Timer::ptr& slot) {
+        Timer::ptr list;
+        list.swap(slot);
+        for (Timer* t = list.get(); t; t = t->m_wheelNext.get()) {
+            t->m_slot = nullptr;
+            --m_wheelCount;
+        }
+        return list;
+    }
+
+    void TimerManager::wheelDrain(std::vector<Timer::ptr>* out) {
+        for (size_t i = 0; i < WHEEL_ROOT_SIZE + WHEEL_LEVELS * WHEEL_LEVEL_SIZE; ++i) {
+            Timer::ptr& slot = i < WHEEL_ROOT_SIZE ? m_wheelRoot[i]
+                : m_wheelLevels[(i - WHEEL_ROOT_SIZE) / WHEEL_LEVEL_SIZE][(i - WHEEL_ROOT_SIZE) % WHEEL_LEVEL_SIZE];
+            Timer::ptr list = wheelTake(slot);
+            while (list) {
+                Timer::ptr next;
+                next.swap(list->m_wheelNext);
+                list->m_wheelPrev = nullptr;
+                if (out) {
+                    out->push_back(std::move(list));
+                }
+                list.swap(next);
+            }
+        }
+    }
+
+    void TimerManager::wheelCascade(int level, size_t index) {
+        Timer::ptr list = wheelTake(m_wheelLevels[level][index]);
+        while (list) {
+            Timer::ptr next;
+            next.swap(list->m_wheelNext);
+            wheelAdd(list);
+            list.swap(next);
+        }
+    }
+
+    void TimerManager::wheelAdvance(uint64_t now, std::vector<Timer::ptr>& expired) {
+        if (m_wheelCount == 0) {
+            m_wheelTime = std::max(m_wheelTime, now + 1);
+            return;
+        }
+        if (now > m_wheelTime + WHEEL_ROOT_SIZE * WHEEL_LEVEL_SIZE) {
+            // 很久没有处理(或时钟跳变)，不逐毫秒前进，直接按当前时间重建
+            std::vector<Timer::ptr> all;
+            all.reserve(m_wheelCount);
+            wheelDrain(&all);
+            m_wheelTime = now;
+            for (auto& timer : all) {
+                wheelAdd(timer);
+            }
+        }
+        while (m_wheelTime <= now) {
+            size_t index = m_wheelTime & (WHEEL_ROOT_SIZE - 1);
+            if (index == 0) {
+                // 第0层转完一圈，逐层把上一层当前槽的定时器降级
+                for (int level = 0; level < WHEEL_LEVELS; ++level) {
+                    size_t i = (m_wheelTime >> (WHEEL_ROOT_BITS + level * WHEEL_LEVEL_BITS)) & (WHEEL_LEVEL_SIZE - 1);
+                    wheelCascade(level, i);
+                    if (i != 0) {
+                        break;
+                    }
+                }
+            }
+            Timer::ptr list = wheelTake(m_wheelRoot[index]);
+            ++m_wheelTime;
+            while (list) {
+                Timer::ptr next;
+                next.swap(list->m_wheelNext);
+                list->m_wheelPrev = nullptr;
+                expired.push_back(std::move(list));
+                list.swap(next);
+            }
+            if (m_wheelCount == 0) {
+                m_wheelTime = std::max(m_wheelTime, now + 1);
+                break;
+            }
+        }
+    }
+
+    uint64_t TimerManager::wheelNextExpire() const {
+        if (m_wheelCount == 0) {
+            return ~0ull;
+        }
+        uint64_t next = ~0ull;
+        for (size_t k = 0; k < WHEEL_ROOT_SIZE; ++k) {
+            if (m_wheelRoot[(m_wheelTime + k) & (WHEEL_ROOT_SIZE - 1)]) {
+                next = m_wheelTime + k;
+                break;
+            }
+        }
+        // 上层的槽只能知道降级的时间，作为下界返回，到时再重新计算
+        for (int level = 0; level < WHEEL_LEVELS; ++level) {
+            int shift = WHEEL_ROOT_BITS + level * WHEEL_LEVEL_BITS;
+            uint64_t pos = m_wheelTime >> shift;
+            for (size_t k = 1; k <= WHEEL_LEVEL_SIZE; ++k) {
+                if (m_wheelLevels[level][(pos + k) & (WHEEL_LEVEL_SIZE - 1)]) {
+                    next = std::min(next, (pos + k) << shift);
+                    break;
+                }
+            }
+        }
+        return next;
+    }
+}
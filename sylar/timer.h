@@ -23,7 +23,6 @@ namespace sylar
         bool reset(uint64_t ms, bool from_now);     // 重置定时器时间
 
     private:
-        Timer(uint64_t next);   // 查找时使用
         Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager* manager);
 
         struct Comparator
@@ -37,6 +36,10 @@ namespace sylar
         uint64_t m_next = 0;                        // 下次执行的具体时间
         std::function<void()> m_cb;                 // 回调函数
         TimerManager* m_manager = nullptr;          // 定时器管理器
+        // 时间轮模式下所在槽的双向链表
+        Timer::ptr m_wheelNext;                     // 同一槽中的下一个定时器
+        Timer* m_wheelPrev = nullptr;
+        Timer::ptr* m_slot = nullptr;               // 所在槽的链表头，不在时间轮中时为空
     };
 
     class TimerManager
@@ -46,7 +49,7 @@ namespace sylar
         using RWMutexType = RWMutex;
 
         TimerManager();
-        virtual ~TimerManager() {}
+        virtual ~TimerManager();
         Timer::ptr addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
         // 添加条件定时器
         Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool recurring = false);
@@ -56,15 +59,54 @@ namespace sylar
 
         void listExpiredCb(std::vector<std::function<void()>>& vec);
 
+        // 是否使用时间轮(由配置timer.wheel在构造时决定)
+        bool isWheel() const { return m_useWheel; }
+
     protected:
         virtual void onTimerInsertedAtFront() = 0;
         void addTimer(Timer::ptr val, RWMutexType::WriteLock& lock);
 
     private:
+        // 以下函数需持有写锁
+        // 放入定时器，返回是否成为最早到期的定时器
+        bool insertTimer(const Timer::ptr& timer);
+        // 取出定时器，不在管理器中时返回false
+        bool removeTimer(const Timer::ptr& timer);
+        bool empty() const { return m_useWheel ? m_wheelCount == 0 : m_timers.empty(); }
+
+        // 分层时间轮: 第0层256个槽，每槽1ms；之后4层各64个槽，每槽是下一层的一圈
+        // 插入和删除O(1)，每前进1ms处理一个槽，第0层转完一圈时把上一层的一个槽降级下来
+        Timer::ptr* wheelSlot(uint64_t expire);
+        void wheelAdd(const Timer::ptr& timer);
+        void wheelRemove(Timer* timer);
+        // 取下整个槽的链表
+        Timer::ptr wheelTake(Timer::ptr& slot);
+        // 取出时间轮中的所有定时器，out为空时直接丢弃
+        void wheelDrain(std::vector<Timer::ptr>* out);
+        void wheelCascade(int level, size_t index);
+        // 处理到now为止的所有槽，到期的定时器放入expired
+        void wheelAdvance(uint64_t now, std::vector<Timer::ptr>& expired);
+        // 最早到期时间的下界(第0层内是准确值)
+        uint64_t wheelNextExpire() const;
+
+    private:
+        static const int WHEEL_ROOT_BITS = 8;
+        static const int WHEEL_LEVEL_BITS = 6;
+        static const int WHEEL_LEVELS = 4;
+        static const size_t WHEEL_ROOT_SIZE = 1 << WHEEL_ROOT_BITS;
+        static const size_t WHEEL_LEVEL_SIZE = 1 << WHEEL_LEVEL_BITS;
+
         RWMutexType m_mutex;
         std::set<Timer::ptr, Timer::Comparator> m_timers;
         bool m_tickled = false;                    // 是否触发onTimerInsertedAtFront
         uint64_t m_previousTime = 0;               // 上次执行时间
+
+        bool m_useWheel;
+        uint64_t m_wheelTime;                      // 时间轮下一个要处理的毫秒
+        size_t m_wheelCount = 0;                   // 时间轮中的定时器数量
+        uint64_t m_nextExpire = ~0ull;             // 上次计算的最早到期时间，用于判断新定时器是否在最前面
+        Timer::ptr m_wheelRoot[WHEEL_ROOT_SIZE];
+        Timer::ptr m_wheelLevels[WHEEL_LEVELS][WHEEL_LEVEL_SIZE];
     };
 }
 
@@ -44,6 +44,12 @@ namespace sylar
         return (uint64_t)tv.tv_sec * 1000  + (tv.tv_usec) / 1000;
     }
 
+    uint64_t GetCurrentUS() {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return (uint64_t)tv.tv_sec * 1000 * 1000 + tv.tv_usec;
+    }
+
     void Backtrack(std::vector<std::string>& bt, int size, int skip) {
         void** array = (void**)malloc(sizeof(void*) * size);
         size_t s = ::backtrace(array, size);
@@ -12,6 +12,7 @@ namespace sylar
     pid_t GetThreadId();
     uint32_t GetFiberId();
     uint64_t GetCurrentMS();
+    uint64_t GetCurrentUS();
 
     void Backtrack(std::vector<std::string>& bt, int size = 64, int skip = 1);
     std::string BacktraceToString(int size = 64, int skip = 2, const std::string& prefix = "");
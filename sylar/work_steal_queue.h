@@ -0,0 +1,80 @@
+#ifndef __SYLAR_WORK_STEAL_QUEUE_H__
+#define __SYLAR_WORK_STEAL_QUEUE_H__
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include "noncopyable.h"
+
+namespace sylar
+{
+    // 有界的Chase-Lev任务队列
+    // 只有所属线程可以push(bottom端)，任意线程(包括所属线程)都可以从top端steal
+    // T需要是指针之类可以原子读写的类型
+    template<typename T>
+    class WorkStealQueue : Noncopyable
+    {
+    public:
+        // capacity向上取整为2的幂
+        WorkStealQueue(size_t capacity = 1024)
+            : m_top(0), m_bottom(0), m_mask(RoundUp(capacity) - 1), m_buffer(m_mask + 1) {
+        }
+
+        // 只能由所属线程调用，队列满时返回false
+        bool push(T value) {
+            int64_t b = m_bottom.load(std::memory_order_relaxed);
+            int64_t t = m_top.load(std::memory_order_acquire);
+            if (b - t > (int64_t)m_mask) {
+                return false;
+            }
+            m_buffer[b & m_mask].store(value, std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_release);
+            return true;
+        }
+
+        // 从top端取出最早放入的元素，竞争失败或队列为空时返回false
+        bool steal(T& value) {
+            int64_t t = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = m_bottom.load(std::memory_order_acquire);
+            if (t >= b) {
+                return false;
+            }
+            T v = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+            if (!m_top.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return false;
+            }
+            value = v;
+            return true;
+        }
+
+        size_t size() const {
+            int64_t b = m_bottom.load(std::memory_order_relaxed);
+            int64_t t = m_top.load(std::memory_order_relaxed);
+            return b > t ? b - t : 0;
+        }
+
+        bool empty() const { return size() == 0; }
+        size_t capacity() const { return m_mask + 1; }
+
+    private:
+        static size_t RoundUp(size_t capacity) {
+            size_t cap = 1;
+            while (cap < capacity) {
+                cap <<= 1;
+            }
+            return cap;
+        }
+
+    private:
+        std::atomic<int64_t> m_top;                 // 窃取端
+        char m_pad[64];                             // 避免top/bottom伪共享
+        std::atomic<int64_t> m_bottom;              // 所属线程写入端
+        size_t m_mask;
+        std::vector<std::atomic<T>> m_buffer;
+    };
+}
+
+#endif
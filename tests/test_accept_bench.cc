@@ -0,0 +1,117 @@
+#include "tcp_server.h"
+#include "iomanager.h"
+#include "socket.h"
+#include "address.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+#include "config.h"
+#include <atomic>
+#include <stdlib.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+// 接受连接后立即关闭，只衡量建立连接的速度
+class BenchServer : public sylar::TcpServer
+{
+public:
+    using ptr = std::shared_ptr<BenchServer>;
+
+    BenchServer(sylar::IOManager* worker) : sylar::TcpServer(worker, worker, worker) {}
+
+    std::atomic<uint64_t> accepted{ 0 };
+
+protected:
+    void handleClient(sylar::Socket::ptr client) override {
+        ++accepted;
+        client->close();
+    }
+};
+
+// 统计system日志中的错误，正常关闭时不应该有
+class ErrorCountAppender : public sylar::LogAppender
+{
+public:
+    using ptr = std::shared_ptr<ErrorCountAppender>;
+
+    void log(sylar::Logger::ptr logger, sylar::LogLevel::Level level, sylar::LogEvent::ptr event) override {
+        if (level >= sylar::LogLevel::ERROR) {
+            ++errors;
+        }
+    }
+
+    std::atomic<uint64_t> errors{ 0 };
+
+protected:
+    void write(const char* data, size_t len) override {}
+};
+
+static ErrorCountAppender::ptr s_errors = std::make_shared<ErrorCountAppender>();
+
+// 客户端concurrency个协程不断建立连接，等服务器关闭后再建立下一个
+void bench_accept(bool reuse_port, bool multi_reactor, size_t threads, size_t conns, size_t concurrency) {
+    sylar::Config::Lookup<bool>("iomanager.multi_reactor")->setValue(multi_reactor);
+    uint64_t used = 0;
+    size_t listeners = 0;
+    BenchServer::ptr server;
+    std::atomic<int64_t> remain(conns);
+    std::atomic<size_t> running(concurrency);
+    sylar::Semaphore started;
+    {
+        sylar::IOManager server_iom(threads, false, "server");
+        sylar::IOManager client_iom(1, false, "client");
+        // 监听Socket要在hook开启的线程中创建，accept才会挂起协程而不是阻塞线程
+        server_iom.schedule(std::function<void()>([&]() {
+            server.reset(new BenchServer(&server_iom));
+            server->setReusePort(reuse_port);
+            SYLAR_ASSERT(server->bind(sylar::IPv4Address::Create("127.0.0.1", 0)));
+            listeners = server->getSocks().size();
+            sylar::Address::ptr addr = server->getSocks()[0]->getLocalAddress();
+            server->start();
+
+            uint64_t begin = sylar::GetCurrentMS();
+            for (size_t i = 0; i < concurrency; ++i) {
+                client_iom.schedule(std::function<void()>([&, addr, begin]() {
+                    char buf[1];
+                    while (remain.fetch_sub(1) > 0) {
+                        sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+                        SYLAR_ASSERT(sock->connect(addr));
+                        SYLAR_ASSERT(sock->recv(buf, sizeof(buf)) == 0);
+                        sock->close();
+                    }
+                    if (--running == 0) {
+                        used = sylar::GetCurrentMS() - begin;
+                        server->stop();
+                    }
+                }));
+            }
+            started.notify();
+        }));
+        // 客户端协程提交之前client_iom不能析构
+        started.wait();
+    }
+    SYLAR_ASSERT(server->accepted == conns);
+    // stop关闭了监听Socket，accept失败不输出错误，没有重新bind不能再启动
+    SYLAR_ASSERT2(s_errors->errors == 0, std::to_string(s_errors->errors));
+    SYLAR_ASSERT(!server->start());
+    s_errors->errors = 0;
+    SYLAR_LOG_INFO(g_logger) << "bench_accept " << (reuse_port ? "reuse_port" : "single")
+        << (multi_reactor ? "(multi_reactor)" : "")
+        << " listeners=" << listeners << " threads=" << threads << " conns=" << conns
+        << " used=" << used << "ms conn/s=" << (used ? conns * 1000 / used : 0);
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    sylar::Logger::ptr system = SYLAR_LOG_NAME("system");
+    system->setLevel(sylar::LogLevel::ERROR);
+    system->addAppender(s_errors);
+    size_t threads = argc > 1 ? atoi(argv[1]) : 4;
+    size_t conns = argc > 2 ? atoi(argv[2]) : 10000;
+    size_t concurrency = argc > 3 ? atoi(argv[3]) : 64;
+    bench_accept(false, false, threads, conns, concurrency);
+    bench_accept(true, false, threads, conns, concurrency);
+    bench_accept(false, true, threads, conns, concurrency);
+    bench_accept(true, true, threads, conns, concurrency);
+    return 0;
+}
@@ -1,6 +1,14 @@
 #include "bytearray.h"
 #include "log.h"
 #include "macro.h"
+#include "iomanager.h"
+#include "socket.h"
+#include "streams/socket_stream.h"
+#include "config.h"
+#include "util.h"
+#include <string.h>
+#include <fstream>
+#include <sstream>
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 void test() {
@@ -84,7 +92,445 @@ void test() {
 #undef XX
 }
 
+// 随机长度的varint: 各种字节数的值都有
+template<typename T>
+static T rand_varint() {
+    int bits = rand() % (sizeof(T) * 8 + 1);
+    uint64_t v = ((uint64_t)rand() << 32) ^ ((uint64_t)rand() << 16) ^ rand();
+    return (T)(bits == 64 ? v : v & ((1ull << bits) - 1));
+}
+
+// 批量接口与逐个接口的编码相同，可以互相读取
+void test_varint_array() {
+#define XX(type, write_fun, read_fun, write_array, read_array) \
+    for (size_t base_len : { 1, 7, 64, 4096 }) { \
+        std::vector<type> vec(5000); \
+        for (auto& v : vec) { \
+            v = rand() % 4 ? (type)(rand() % 100) : rand_varint<type>(); \
+        } \
+        sylar::ByteArray::ptr ba(new sylar::ByteArray(base_len)); \
+        ba->write_array(&vec[0], vec.size()); \
+        sylar::ByteArray::ptr single(new sylar::ByteArray(base_len)); \
+        for (auto& v : vec) { \
+            single->write_fun(v); \
+        } \
+        ba->setPosition(0); \
+        single->setPosition(0); \
+        SYLAR_ASSERT(ba->toString() == single->toString()); \
+        std::vector<type> out(vec.size()); \
+        ba->read_array(&out[0], 1); \
+        ba->read_array(&out[1], out.size() - 1); \
+        SYLAR_ASSERT(out == vec); \
+        SYLAR_ASSERT(ba->getReadSize() == 0); \
+        for (auto& v : vec) { \
+            SYLAR_ASSERT(single->read_fun() == v); \
+        } \
+    } \
+    SYLAR_LOG_INFO(g_logger) << "test_varint_array " #write_array "/" #read_array " ok";
+
+    XX(uint32_t, writeUint32, readUint32, writeUint32Array, readUint32Array);
+    XX(int32_t, writeInt32, readInt32, writeInt32Array, readInt32Array);
+    XX(uint64_t, writeUint64, readUint64, writeUint64Array, readUint64Array);
+    XX(int64_t, writeInt64, readInt64, writeInt64Array, readInt64Array);
+#undef XX
+
+    // 读到末尾之后抛出异常
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(4096));
+    uint32_t values[100] = { 0 };
+    ba->writeUint32Array(values, 50);
+    ba->setPosition(0);
+    bool thrown = false;
+    try {
+        ba->readUint32Array(values, 100);
+    } catch (std::out_of_range&) {
+        thrown = true;
+    }
+    SYLAR_ASSERT(thrown);
+}
+
+// 逐个调用与批量接口的对比，small时全是单字节的值
+void bench_varint(size_t count, bool small) {
+    std::vector<uint32_t> vec32(count);
+    std::vector<uint64_t> vec64(count);
+    for (size_t i = 0; i < count; ++i) {
+        vec32[i] = small ? rand() % 128 : rand_varint<uint32_t>();
+        vec64[i] = small ? rand() % 128 : rand_varint<uint64_t>();
+    }
+    std::vector<uint32_t> out32(count);
+    std::vector<uint64_t> out64(count);
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(4096));
+
+#define XX(name, vec, out, write_expr, read_expr) { \
+        ba->clear(); \
+        uint64_t begin = sylar::GetCurrentMS(); \
+        write_expr; \
+        uint64_t write_used = sylar::GetCurrentMS() - begin; \
+        ba->setPosition(0); \
+        begin = sylar::GetCurrentMS(); \
+        read_expr; \
+        uint64_t read_used = sylar::GetCurrentMS() - begin; \
+        SYLAR_ASSERT(out == vec); \
+        SYLAR_LOG_INFO(g_logger) << "bench_varint " name " small=" << small << " count=" << count \
+            << " bytes=" << ba->getSize() << " write=" << write_used << "ms read=" << read_used << "ms"; \
+    }
+
+    XX("uint32 single", vec32, out32,
+        for (auto& v : vec32) { ba->writeUint32(v); },
+        for (auto& v : out32) { v = ba->readUint32(); });
+    XX("uint32 array", vec32, out32,
+        ba->writeUint32Array(&vec32[0], count),
+        ba->readUint32Array(&out32[0], count));
+    XX("uint64 single", vec64, out64,
+        for (auto& v : vec64) { ba->writeUint64(v); },
+        for (auto& v : out64) { v = ba->readUint64(); });
+    XX("uint64 array", vec64, out64,
+        ba->writeUint64Array(&vec64[0], count),
+        ba->readUint64Array(&out64[0], count));
+#undef XX
+}
+
+// 通过iovec直接读写内存块，跨越多个内存块并支持部分提交
+void test_iovec() {
+    const size_t base_len = 7;
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(base_len));
+    std::string data;
+    for (int i = 0; i < 100; ++i) {
+        data.push_back('a' + i % 26);
+    }
+    // 分两次写入，第二次从内存块中间开始
+    size_t offset = 0;
+    for (size_t part : { (size_t)10, data.size() - 10 }) {
+        std::vector<iovec> iovs;
+        SYLAR_ASSERT(ba->getWriteBuffer(iovs, part) == part);
+        SYLAR_ASSERT(iovs.size() > 1);
+        for (auto& iov : iovs) {
+            memcpy(iov.iov_base, &data[offset], iov.iov_len);
+            offset += iov.iov_len;
+        }
+        ba->commit(part);
+    }
+    SYLAR_ASSERT(ba->getSize() == data.size());
+    SYLAR_ASSERT(ba->getPosition() == data.size());
+
+    std::vector<iovec> iovs;
+    SYLAR_ASSERT(ba->getReadBuffer(iovs, 20, 33) == 20);
+    std::string str;
+    for (auto& iov : iovs) {
+        str.append((const char*)iov.iov_base, iov.iov_len);
+    }
+    SYLAR_ASSERT(str == data.substr(33, 20));
+
+    ba->setPosition(0);
+    str.clear();
+    while (ba->getReadSize() > 0) {
+        iovs.clear();
+        // 每次只取走第一个iovec的数据，模拟部分发送
+        SYLAR_ASSERT(ba->getReadBuffer(iovs) == ba->getReadSize());
+        str.append((const char*)iovs[0].iov_base, iovs[0].iov_len);
+        ba->commit(iovs[0].iov_len);
+    }
+    SYLAR_ASSERT(str == data);
+    SYLAR_LOG_INFO(g_logger) << "test_iovec ok";
+}
+
+// 切片引用内存块，ByteArray之后的修改和释放不影响切片
+void test_slice() {
+    std::string data;
+    for (int i = 0; i < 1000; ++i) {
+        data.push_back('a' + i % 26);
+    }
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(64));
+    ba->write(data.c_str(), data.size());
+    ba->setPosition(100);
+    sylar::ByteSlice slice = ba->slice(500);
+    SYLAR_ASSERT(slice.size() == 500);
+    SYLAR_ASSERT(slice.toString() == data.substr(100, 500));
+    // 直接指向内存块
+    std::vector<iovec> slice_iovs;
+    std::vector<iovec> ba_iovs;
+    slice.getIovec(slice_iovs);
+    ba->getReadBuffer(ba_iovs, 500);
+    SYLAR_ASSERT(slice_iovs.size() == ba_iovs.size());
+    for (size_t i = 0; i < ba_iovs.size(); ++i) {
+        SYLAR_ASSERT(slice_iovs[i].iov_base == ba_iovs[i].iov_base);
+        SYLAR_ASSERT(slice_iovs[i].iov_len == ba_iovs[i].iov_len);
+    }
+
+    // 覆盖写入、清空后重用、释放都不改变切片
+    ba->setPosition(0);
+    std::string other(data.size(), 'z');
+    ba->write(other.c_str(), other.size());
+    SYLAR_ASSERT(slice.toString() == data.substr(100, 500));
+    ba->setPosition(0);
+    SYLAR_ASSERT(ba->toString() == other);
+    ba->clear();
+    ba->write(other.c_str(), other.size());
+    SYLAR_ASSERT(slice.toString() == data.substr(100, 500));
+    ba.reset();
+    SYLAR_ASSERT(slice.toString() == data.substr(100, 500));
+
+    // 子切片与拼接
+    sylar::ByteSlice sub = slice.slice(60, 100);
+    SYLAR_ASSERT(sub.toString() == data.substr(160, 100));
+    sylar::ByteSlice joined;
+    joined.append("head:");
+    joined.append(sub);
+    joined.append(slice.slice(0, 10));
+    joined.append(joined);
+    std::string expect = "head:" + data.substr(160, 100) + data.substr(100, 10);
+    SYLAR_ASSERT(joined.toString() == expect + expect);
+    SYLAR_ASSERT(joined.size() == expect.size() * 2);
+    SYLAR_LOG_INFO(g_logger) << "test_slice ok segments=" << joined.getSegmentCount();
+}
+
+static std::string read_file(const std::string& name) {
+    std::ifstream ifs(name, std::ios::binary);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+// 只读映射写入时复制，不改变文件；可写映射直接修改文件，超出映射的部分释放时写回
+void test_map_file() {
+    const std::string name = "/tmp/test_bytearray_map.dat";
+    std::string data;
+    for (int i = 0; i < 5000; ++i) {
+        data.push_back('a' + i % 26);
+    }
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(4096));
+    ba->write(data.c_str(), data.size());
+    ba->setPosition(0);
+    SYLAR_ASSERT(ba->writeToFile(name));
+
+    sylar::ByteArray::ptr ro = sylar::ByteArray::MapFile(name, false, 1024);
+    SYLAR_ASSERT(ro && ro->isMapped());
+    SYLAR_ASSERT(ro->getSize() == data.size());
+    SYLAR_ASSERT(ro->toString() == data);
+    sylar::ByteSlice slice = ro->slice(100, 2000);
+    ro->setPosition(1000);
+    ro->write("0123456789", 10);
+    ro->setPosition(0);
+    SYLAR_ASSERT(ro->toString() == data.substr(0, 1000) + "0123456789" + data.substr(1010));
+    SYLAR_ASSERT(read_file(name) == data);
+    ro.reset();
+    SYLAR_ASSERT(slice.toString() == data.substr(100, 2000));
+
+    sylar::ByteArray::ptr rw = sylar::ByteArray::MapFile(name, true, 1024);
+    SYLAR_ASSERT(rw && rw->toString() == data);
+    rw->setPosition(1000);
+    rw->write("0123456789", 10);
+    // 超出映射容量的部分在普通内存块中
+    std::string more(3000, 'm');
+    rw->setPosition(rw->getSize());
+    rw->write(more.c_str(), more.size());
+    rw.reset();
+    std::string expect = data.substr(0, 1000) + "0123456789" + data.substr(1010) + more;
+    SYLAR_ASSERT(read_file(name) == expect);
+
+    // 预留容量创建新文件
+    unlink(name.c_str());
+    rw = sylar::ByteArray::MapFile(name, true, 4096, 100000);
+    SYLAR_ASSERT(rw && rw->getSize() == 0);
+    for (int i = 0; i < 10000; ++i) {
+        rw->writeFuint32(i);
+    }
+    SYLAR_ASSERT(rw->sync());
+    rw.reset();
+    ba.reset(new sylar::ByteArray(4096));
+    SYLAR_ASSERT(ba->readFromFile(name));
+    ba->setPosition(0);
+    SYLAR_ASSERT(ba->getSize() == 40000);
+    for (int i = 0; i < 10000; ++i) {
+        SYLAR_ASSERT(ba->readFuint32() == (uint32_t)i);
+    }
+
+    // 切片引用的映射在ByteArray释放后仍可访问，切片释放后才截断文件
+    unlink(name.c_str());
+    rw = sylar::ByteArray::MapFile(name, true, 4096, 1 << 20);
+    std::string big(100000, 'x');
+    for (size_t i = 0; i < big.size(); ++i) {
+        big[i] = 'a' + i % 26;
+    }
+    rw->write(big.c_str(), big.size());
+    sylar::ByteSlice mapped = rw->slice(50000, 1000);
+    rw->clear();
+    rw.reset();
+    SYLAR_ASSERT(mapped.toString() == big.substr(50000, 1000));
+    SYLAR_ASSERT(read_file(name).size() >= big.size());
+    mapped = sylar::ByteSlice();
+    SYLAR_ASSERT(read_file(name).empty());
+    unlink(name.c_str());
+    SYLAR_LOG_INFO(g_logger) << "test_map_file ok";
+}
+
+static uint64_t checksum(sylar::ByteArray::ptr ba) {
+    std::vector<iovec> iovs;
+    ba->getReadBuffer(iovs, ba->getReadSize(), 0);
+    uint64_t sum = 0;
+    for (auto& iov : iovs) {
+        const uint64_t* p = (const uint64_t*)iov.iov_base;
+        for (size_t i = 0; i < iov.iov_len / sizeof(uint64_t); ++i) {
+            sum += p[i];
+        }
+    }
+    return sum;
+}
+
+// readFromFile与MapFile打开大文件的时间，以及第一次遍历数据的时间
+void bench_map_file(size_t mb) {
+    const std::string name = "/tmp/bench_bytearray_map.dat";
+    {
+        std::string block(1024 * 1024, '\0');
+        for (size_t i = 0; i < block.size(); ++i) {
+            block[i] = rand();
+        }
+        std::ofstream ofs(name, std::ios::trunc | std::ios::binary);
+        for (size_t i = 0; i < mb; ++i) {
+            ofs.write(block.c_str(), block.size());
+        }
+    }
+    uint64_t begin = sylar::GetCurrentUS();
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(4096));
+    SYLAR_ASSERT(ba->readFromFile(name));
+    ba->setPosition(0);
+    uint64_t open_used = sylar::GetCurrentUS() - begin;
+    begin = sylar::GetCurrentUS();
+    uint64_t sum = checksum(ba);
+    uint64_t scan_used = sylar::GetCurrentUS() - begin;
+    ba.reset();
+    SYLAR_LOG_INFO(g_logger) << "bench_map_file readFromFile size=" << mb << "MB open="
+        << open_used << "us scan=" << scan_used << "us";
+
+    begin = sylar::GetCurrentUS();
+    ba = sylar::ByteArray::MapFile(name);
+    SYLAR_ASSERT(ba);
+    open_used = sylar::GetCurrentUS() - begin;
+    begin = sylar::GetCurrentUS();
+    SYLAR_ASSERT(checksum(ba) == sum);
+    scan_used = sylar::GetCurrentUS() - begin;
+    ba.reset();
+    SYLAR_LOG_INFO(g_logger) << "bench_map_file MapFile size=" << mb << "MB open="
+        << open_used << "us scan=" << scan_used << "us";
+
+    // 写文件: writeToFile与可写映射
+    std::string block(1024 * 1024, 'w');
+    ba.reset(new sylar::ByteArray(1024 * 1024));
+    for (size_t i = 0; i < mb; ++i) {
+        ba->write(block.c_str(), block.size());
+    }
+    ba->setPosition(0);
+    begin = sylar::GetCurrentUS();
+    SYLAR_ASSERT(ba->writeToFile(name));
+    uint64_t write_used = sylar::GetCurrentUS() - begin;
+    ba.reset();
+    unlink(name.c_str());
+    begin = sylar::GetCurrentUS();
+    ba = sylar::ByteArray::MapFile(name, true, 1024 * 1024, mb * 1024 * 1024);
+    SYLAR_ASSERT(ba);
+    for (size_t i = 0; i < mb; ++i) {
+        ba->write(block.c_str(), block.size());
+    }
+    ba.reset();
+    uint64_t map_used = sylar::GetCurrentUS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "bench_map_file write size=" << mb << "MB writeToFile="
+        << write_used << "us MapFile(writable)=" << map_used << "us";
+    unlink(name.c_str());
+}
+
+// SocketStream直接在ByteArray的内存块上收发
+void test_socket_stream() {
+    sylar::IOManager iom(1, false, "bytearray");
+    iom.schedule([]() {
+        sylar::Socket::ptr listener = sylar::Socket::CreateTCPSocket();
+        SYLAR_ASSERT(listener->bind(sylar::IPv4Address::Create("127.0.0.1", 0)));
+        SYLAR_ASSERT(listener->listen());
+        sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+        SYLAR_ASSERT(sock->connect(listener->getLocalAddress()));
+        sylar::SocketStream out(sock);
+        sylar::SocketStream in(listener->accept());
+
+        sylar::ByteArray::ptr src(new sylar::ByteArray(1000));
+        for (int i = 0; i < 100000; ++i) {
+            src->writeUint32(i);
+        }
+        src->setPosition(0);
+        size_t total = src->getSize();
+        sylar::ByteArray::ptr dst(new sylar::ByteArray(333));
+        while (src->getReadSize() > 0 || dst->getSize() < total) {
+            if (src->getReadSize() > 0) {
+                SYLAR_ASSERT(out.write(src, src->getReadSize()) > 0);
+            }
+            SYLAR_ASSERT(in.read(dst, 4096) > 0);
+        }
+        dst->setPosition(0);
+        for (int i = 0; i < 100000; ++i) {
+            SYLAR_ASSERT(dst->readUint32() == (uint32_t)i);
+        }
+
+        // 收到的数据加上协议头原样转发，全程不复制数据
+        dst->setPosition(0);
+        sylar::ByteSlice forward;
+        forward.append("header");
+        forward.append(dst->slice());
+        sylar::IOManager::GetThisIOManager()->schedule(std::function<void()>([&out, forward]() {
+            SYLAR_ASSERT(out.writeSlice(forward) == (int)forward.size());
+        }));
+        sylar::ByteArray::ptr fwd(new sylar::ByteArray(4096));
+        while (fwd->getSize() < forward.size()) {
+            SYLAR_ASSERT(in.read(fwd, 65536) > 0);
+        }
+        fwd->setPosition(0);
+        SYLAR_ASSERT(fwd->toString() == forward.toString());
+        SYLAR_LOG_INFO(g_logger) << "test_socket_stream ok size=" << total;
+    });
+}
+
+// 每条消息写入msg_size字节再读出，reuse时同一个ByteArray用clear复用，否则每条消息新建
+void bench_node_pool(bool pool, bool reuse, size_t msgs, size_t msg_size, size_t base_len) {
+    sylar::Config::Lookup<uint64_t>("bytearray.node_pool.max_bytes")->setValue(pool ? 4 * 1024 * 1024 : 0);
+    std::string data(msg_size, 'x');
+    std::string out(msg_size, '\0');
+    sylar::ByteArray::NodePoolStats before = sylar::ByteArray::GetNodePoolStats();
+    uint64_t begin = sylar::GetCurrentMS();
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(base_len));
+    for (size_t i = 0; i < msgs; ++i) {
+        if (reuse) {
+            ba->clear();
+        } else {
+            ba.reset(new sylar::ByteArray(base_len));
+        }
+        ba->write(data.c_str(), data.size());
+        ba->setPosition(0);
+        ba->read(&out[0], out.size());
+    }
+    ba.reset();
+    uint64_t used = sylar::GetCurrentMS() - begin;
+    sylar::ByteArray::NodePoolStats after = sylar::ByteArray::GetNodePoolStats();
+    SYLAR_ASSERT(out == data);
+    SYLAR_LOG_INFO(g_logger) << "bench_node_pool pool=" << pool << " reuse=" << reuse
+        << " msgs=" << msgs << " msg_size=" << msg_size << " base_len=" << base_len
+        << " allocs=" << after.misses - before.misses
+        << " pool_hits=" << after.hits - before.hits
+        << " used=" << used << "ms msg/s=" << (used ? msgs * 1000 / used : 0);
+}
+
 int main(int argc, char** argv) {
     test();
+    test_iovec();
+    test_slice();
+    test_map_file();
+    test_socket_stream();
+    test_varint_array();
+
+    size_t msgs = argc > 1 ? atoi(argv[1]) : 200000;
+    size_t msg_size = argc > 2 ? atoi(argv[2]) : 16 * 1024;
+    for (bool reuse : { true, false }) {
+        bench_node_pool(false, reuse, msgs, msg_size, 4096);
+        bench_node_pool(true, reuse, msgs, msg_size, 4096);
+    }
+    size_t varints = argc > 3 ? atoi(argv[3]) : 5000000;
+    bench_varint(varints, true);
+    bench_varint(varints, false);
+    bench_map_file(argc > 4 ? atoi(argv[4]) : 128);
     return 0;
 }
@@ -0,0 +1,138 @@
+#include "channel.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+#include <atomic>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+// 有界通道: 多个生产者、多个消费者，关闭后消费者取完剩余数据退出
+void test_bounded() {
+    sylar::Channel<int> chan(8);
+    std::atomic<int64_t> sum(0);
+    std::atomic<int> producers(4);
+    {
+        sylar::IOManager iom(2, false, "bounded");
+        for (int i = 0; i < 4; ++i) {
+            iom.schedule(std::function<void()>([&]() {
+                for (int j = 1; j <= 1000; ++j) {
+                    SYLAR_ASSERT(chan.send(j));
+                }
+                if (--producers == 0) {
+                    chan.close();
+                }
+            }));
+        }
+        for (int i = 0; i < 3; ++i) {
+            iom.schedule(std::function<void()>([&]() {
+                int v = 0;
+                while (chan.recv(v)) {
+                    sum += v;
+                }
+            }));
+        }
+    }
+    SYLAR_ASSERT(sum == 4 * 500500);
+    SYLAR_ASSERT(!chan.send(1));
+    SYLAR_LOG_INFO(g_logger) << "test_bounded sum=" << sum;
+}
+
+// 元素只移动不拷贝
+void test_move_only() {
+    sylar::Channel<std::unique_ptr<std::string>> chan;
+    std::unique_ptr<std::string> msg(new std::string(1024 * 1024, 'x'));
+    const std::string* raw = msg.get();
+    SYLAR_ASSERT(chan.trySend(std::move(msg)));
+    std::unique_ptr<std::string> out;
+    SYLAR_ASSERT(chan.tryRecv(out));
+    SYLAR_ASSERT(out.get() == raw);
+    SYLAR_ASSERT(!chan.tryRecv(out));
+    SYLAR_LOG_INFO(g_logger) << "test_move_only ok";
+}
+
+void test_select() {
+    sylar::Channel<int> ints(1);
+    sylar::Channel<std::string> strs(1);
+    std::atomic<int> got_int(0);
+    std::atomic<int> got_str(0);
+    std::atomic<int> timeouts(0);
+    {
+        sylar::IOManager iom(2, false, "select");
+        iom.schedule(std::function<void()>([&]() {
+            while (true) {
+                int i = 0;
+                std::string s;
+                bool ok = true;
+                sylar::ChannelSelect sel;
+                sel.recv(ints, i, &ok).recv(strs, s);
+                int idx = sel.wait(50);
+                if (idx == -1) {
+                    ++timeouts;
+                } else if (idx == 0) {
+                    if (!ok) {
+                        break;
+                    }
+                    ++got_int;
+                } else {
+                    ++got_str;
+                }
+            }
+        }));
+        iom.schedule(std::function<void()>([&]() {
+            for (int i = 0; i < 100; ++i) {
+                ints.send(i);
+                strs.send(std::to_string(i));
+            }
+            // 让接收方超时一次再关闭
+            usleep(120 * 1000);
+            ints.close();
+        }));
+    }
+    SYLAR_ASSERT(got_int == 100 && got_str == 100);
+    SYLAR_ASSERT(timeouts >= 1);
+    SYLAR_LOG_INFO(g_logger) << "test_select int=" << got_int
+        << " str=" << got_str << " timeouts=" << timeouts;
+
+    // 发送分支: 通道满时超时，value不会被放入
+    sylar::Channel<int> full(1);
+    SYLAR_ASSERT(full.trySend(1));
+    {
+        sylar::IOManager iom(1, false, "select_send");
+        iom.schedule(std::function<void()>([&full]() {
+            sylar::ChannelSelect sel;
+            sel.send(full, 2);
+            SYLAR_ASSERT(sel.wait(10) == -1);
+        }));
+    }
+    SYLAR_ASSERT(full.size() == 1);
+}
+
+// 不在调度器中时阻塞线程
+void test_thread() {
+    sylar::Channel<int> chan;
+    sylar::Thread thr([&chan]() {
+        for (int i = 0; i < 100; ++i) {
+            chan.send(i);
+        }
+        chan.close();
+    }, "sender");
+    int v = 0, count = 0;
+    while (chan.recv(v)) {
+        SYLAR_ASSERT(v == count);
+        ++count;
+    }
+    thr.join();
+    SYLAR_ASSERT(count == 100);
+    SYLAR_LOG_INFO(g_logger) << "test_thread count=" << count;
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+    test_bounded();
+    test_move_only();
+    test_select();
+    test_thread();
+    return 0;
+}
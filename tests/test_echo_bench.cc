@@ -0,0 +1,187 @@
+#include "iomanager.h"
+#include "socket.h"
+#include "address.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+#include "config.h"
+#include <atomic>
+#include <string.h>
+#include <stdlib.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+struct Mode
+{
+    sylar::IOManager::Backend backend;
+    bool persistent;
+    bool multi;
+
+    std::string name() const {
+        std::string str = backend == sylar::IOManager::IO_URING ? "io_uring" : "epoll";
+        if (persistent) {
+            str += "(persistent)";
+        }
+        if (multi) {
+            str += "(multi_reactor)";
+        }
+        return str;
+    }
+
+    // 在创建IOManager之前调用
+    void apply() const {
+        sylar::Config::Lookup<bool>("iomanager.persistent_epoll")->setValue(persistent);
+        sylar::Config::Lookup<bool>("iomanager.multi_reactor")->setValue(multi);
+    }
+};
+
+static bool recv_all(sylar::Socket::ptr sock, char* buf, size_t len) {
+    size_t offset = 0;
+    while (offset < len) {
+        int rt = sock->recv(buf + offset, len - offset);
+        if (rt <= 0) {
+            return false;
+        }
+        offset += rt;
+    }
+    return true;
+}
+
+// 回显服务器和客户端在同一个IOManager中，每个连接请求-响应rounds次
+// 多reactor模式下服务端连接协程固定在一个线程上，统计换线程的次数
+void bench_echo(const Mode& mode, size_t threads, size_t conns, size_t rounds) {
+    mode.apply();
+    std::atomic<uint64_t> requests(0);
+    std::atomic<uint64_t> migrations(0);
+    uint64_t begin = 0;
+    uint64_t used = 0;
+    {
+        sylar::IOManager iom(threads, false, "echo", mode.backend);
+        if (iom.getBackend() != mode.backend) {
+            SYLAR_LOG_WARN(g_logger) << "bench_echo " << mode.name() << " not supported, skip";
+            return;
+        }
+        sylar::Socket::ptr listener = sylar::Socket::CreateTCPSocket();
+        SYLAR_ASSERT(listener->bind(sylar::IPv4Address::Create("127.0.0.1", 0)));
+        SYLAR_ASSERT(listener->listen());
+        sylar::Address::ptr addr = listener->getLocalAddress();
+
+        iom.schedule(std::function<void()>([&iom, &migrations, listener, conns]() {
+            for (size_t i = 0; i < conns; ++i) {
+                sylar::Socket::ptr client = listener->accept();
+                SYLAR_ASSERT(client);
+                iom.schedule(std::function<void()>([client, &migrations]() {
+                    char buf[256];
+                    int thread = sylar::GetThreadId();
+                    while (true) {
+                        int rt = client->recv(buf, sizeof(buf));
+                        if (thread != sylar::GetThreadId()) {
+                            ++migrations;
+                            thread = sylar::GetThreadId();
+                        }
+                        if (rt <= 0 || client->send(buf, rt) != rt) {
+                            break;
+                        }
+                    }
+                    client->close();
+                }), iom.pickReactorThread());
+            }
+            listener->close();
+        }));
+
+        begin = sylar::GetCurrentMS();
+        std::atomic<size_t> running(conns);
+        for (size_t i = 0; i < conns; ++i) {
+            iom.schedule(std::function<void()>([&, i]() {
+                sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+                SYLAR_ASSERT(sock->connect(addr));
+                char out[64];
+                char in[64];
+                for (size_t r = 0; r < rounds; ++r) {
+                    snprintf(out, sizeof(out), "conn=%zu round=%zu", i, r);
+                    SYLAR_ASSERT(sock->send(out, sizeof(out)) == (int)sizeof(out));
+                    SYLAR_ASSERT(recv_all(sock, in, sizeof(in)));
+                    SYLAR_ASSERT(memcmp(in, out, sizeof(out)) == 0);
+                    ++requests;
+                }
+                sock->close();
+                if (--running == 0) {
+                    used = sylar::GetCurrentMS() - begin;
+                }
+            }));
+        }
+    }
+    SYLAR_ASSERT(requests == conns * rounds);
+    if (mode.multi && mode.backend == sylar::IOManager::EPOLL) {
+        SYLAR_ASSERT(migrations == 0);
+    }
+    SYLAR_LOG_INFO(g_logger) << "bench_echo " << mode.name() << " migrations=" << migrations << " threads=" << threads << " conns=" << conns << " requests=" << requests
+        << " used=" << used << "ms req/s=" << (used ? requests * 1000 / used : 0);
+}
+
+// 读超时返回ETIMEDOUT，另一个协程close后等待的recv返回
+void test_timeout_close(const Mode& mode) {
+    mode.apply();
+    sylar::IOManager iom(2, false, "timeout_close", mode.backend);
+    sylar::Socket::ptr listener = sylar::Socket::CreateTCPSocket();
+    SYLAR_ASSERT(listener->bind(sylar::IPv4Address::Create("127.0.0.1", 0)));
+    SYLAR_ASSERT(listener->listen());
+    sylar::Address::ptr addr = listener->getLocalAddress();
+
+    iom.schedule(std::function<void()>([listener, addr, mode, &iom]() {
+        sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+        SYLAR_ASSERT(sock->connect(addr));
+        sylar::Socket::ptr peer = listener->accept();
+        SYLAR_ASSERT(peer);
+
+        char buf[16];
+        sock->setRecvTimeout(50);
+        uint64_t begin = sylar::GetCurrentMS();
+        SYLAR_ASSERT(sock->recv(buf, sizeof(buf)) == -1);
+        SYLAR_ASSERT(errno == ETIMEDOUT);
+        uint64_t used = sylar::GetCurrentMS() - begin;
+        SYLAR_ASSERT2(used >= 45 && used < 500, std::to_string(used));
+
+        sock->setRecvTimeout(10 * 1000);
+        iom.addTimer(20, [sock]() {
+            sock->close();
+        });
+        SYLAR_ASSERT(sock->recv(buf, sizeof(buf)) <= 0);
+
+        // 直接使用io_uring接口时，等待中fd被关闭返回EBADF而不是ETIMEDOUT
+        if (iom.getBackend() == sylar::IOManager::IO_URING) {
+            sylar::Socket::ptr sock2 = sylar::Socket::CreateTCPSocket();
+            SYLAR_ASSERT(sock2->connect(addr));
+            sylar::Socket::ptr peer2 = listener->accept();
+            SYLAR_ASSERT(peer2);
+            iom.addTimer(20, [sock2]() {
+                sock2->close();
+            });
+            SYLAR_ASSERT(iom.uringRecv(sock2->getSocketfd(), buf, sizeof(buf), 0, 10 * 1000) == -1);
+            SYLAR_ASSERT2(errno == EBADF, std::to_string(errno));
+        }
+        SYLAR_LOG_INFO(g_logger) << "test_timeout_close " << mode.name() << " ok";
+    }));
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+    size_t threads = argc > 1 ? atoi(argv[1]) : 2;
+    size_t conns = argc > 2 ? atoi(argv[2]) : 100;
+    size_t rounds = argc > 3 ? atoi(argv[3]) : 1000;
+    const Mode modes[] = {
+        { sylar::IOManager::EPOLL, false, false },
+        { sylar::IOManager::EPOLL, true, false },
+        { sylar::IOManager::EPOLL, false, true },
+        { sylar::IOManager::EPOLL, true, true },
+        { sylar::IOManager::IO_URING, false, false },
+    };
+    for (auto& mode : modes) {
+        test_timeout_close(mode);
+    }
+    for (auto& mode : modes) {
+        bench_echo(mode, threads, conns, rounds);
+    }
+    return 0;
+}
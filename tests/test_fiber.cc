@@ -3,6 +3,8 @@
 #include "thread.h"
 #include "thread.h"
 #include <vector>
+#include <ucontext.h>
+#include <sys/time.h>
 
 sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
@@ -29,9 +31,84 @@ void test_fiber() {
     SYLAR_LOG_INFO(g_logger) << "main end 2";
 }
 
+// 协程切换耗时: FiberContext(编译时选择的实现) 对比 ucontext swapcontext
+static const uint64_t s_switch_count = 1000000;
+static const size_t s_bench_stack_size = 64 * 1024;
+
+static uint64_t GetCurrentUS() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 * 1000 + tv.tv_usec;
+}
+
+static sylar::FiberContext s_main_ctx;
+static sylar::FiberContext s_bench_ctx;
+
+static void bench_context_func() {
+    while (true) {
+        sylar::FiberContext::Swap(s_bench_ctx, s_main_ctx);
+    }
+}
+
+static ucontext_t s_main_uctx;
+static ucontext_t s_bench_uctx;
+
+static void bench_ucontext_func() {
+    while (true) {
+        swapcontext(&s_bench_uctx, &s_main_uctx);
+    }
+}
+
+void bench_switch() {
+    std::vector<char> stack(s_bench_stack_size);
+    s_main_ctx.init();
+    s_bench_ctx.make(&stack[0], stack.size(), &bench_context_func);
+    uint64_t begin = GetCurrentUS();
+    for (uint64_t i = 0; i < s_switch_count; ++i) {
+        sylar::FiberContext::Swap(s_main_ctx, s_bench_ctx);
+    }
+    uint64_t ctx_us = GetCurrentUS() - begin;
+
+    std::vector<char> ustack(s_bench_stack_size);
+    getcontext(&s_bench_uctx);
+    s_bench_uctx.uc_stack.ss_sp = &ustack[0];
+    s_bench_uctx.uc_stack.ss_size = ustack.size();
+    s_bench_uctx.uc_link = nullptr;
+    makecontext(&s_bench_uctx, &bench_ucontext_func, 0);
+    begin = GetCurrentUS();
+    for (uint64_t i = 0; i < s_switch_count; ++i) {
+        swapcontext(&s_main_uctx, &s_bench_uctx);
+    }
+    uint64_t uctx_us = GetCurrentUS() - begin;
+
+    // 每轮包含切入、切出两次切换
+    SYLAR_LOG_INFO(g_logger) << "bench_switch rounds=" << s_switch_count
+        << " " << sylar::FiberContext::GetBackendName() << "=" << ctx_us << "us ("
+        << ctx_us * 1000.0 / (s_switch_count * 2) << "ns/switch)"
+        << " ucontext=" << uctx_us << "us ("
+        << uctx_us * 1000.0 / (s_switch_count * 2) << "ns/switch)";
+}
+
+void test_stack_pool() {
+    uint64_t begin = GetCurrentUS();
+    for (int i = 0; i < 10000; ++i) {
+        sylar::Fiber::ptr fiber(new sylar::Fiber([]() {}, 0, true));
+        fiber->call();
+    }
+    uint64_t used = GetCurrentUS() - begin;
+    sylar::Fiber::StackStats stats = sylar::Fiber::GetStackStats();
+    SYLAR_LOG_INFO(g_logger) << "test_stack_pool used=" << used << "us"
+        << " hits=" << stats.hits
+        << " misses=" << stats.misses
+        << " resident=" << stats.resident
+        << " active=" << stats.active;
+}
+
 int main() {
     sylar::Thread::SetName("main");
     SYLAR_LOG_INFO(g_logger) << "main";
+    bench_switch();
+    test_stack_pool();
     // test_fiber();
 
     std::vector<sylar::Thread::ptr> thrs;
@@ -0,0 +1,110 @@
+#include "fiber_sync.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include <atomic>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int s_fibers = 100;
+static const int s_loops = 1000;
+
+static int64_t s_counter = 0;
+
+// 临界区中让出协程，只有FiberMutex可以这样用，pthread Mutex会导致同一线程上的协程死锁
+template<typename MutexType, bool YieldInside>
+void bench_mutex(const char* name, size_t threads) {
+    MutexType mutex;
+    s_counter = 0;
+    uint64_t begin = sylar::GetCurrentMS();
+    {
+        sylar::IOManager iom(threads, false, "bench");
+        for (int i = 0; i < s_fibers; ++i) {
+            iom.schedule(std::function<void()>([&mutex]() {
+                for (int j = 0; j < s_loops; ++j) {
+                    typename MutexType::Lock lock(mutex);
+                    ++s_counter;
+                    if (YieldInside && j % 100 == 0) {
+                        usleep(1000);
+                    }
+                }
+            }));
+        }
+    }
+    uint64_t used = sylar::GetCurrentMS() - begin;
+    SYLAR_ASSERT(s_counter == s_fibers * s_loops);
+    SYLAR_LOG_INFO(g_logger) << name << " threads=" << threads
+        << " used=" << used << "ms"
+        << " lock/s=" << (used ? s_counter * 1000 / used : 0);
+}
+
+void test_condition() {
+    sylar::FiberMutex mutex;
+    sylar::FiberCondition cond;
+    std::list<int> queue;
+    std::atomic<int> consumed(0);
+    {
+        sylar::IOManager iom(2, false, "cond");
+        for (int i = 0; i < 10; ++i) {
+            iom.schedule(std::function<void()>([&]() {
+                for (int j = 0; j < 100; ++j) {
+                    sylar::FiberMutex::Lock lock(mutex);
+                    while (queue.empty()) {
+                        cond.wait(lock);
+                    }
+                    queue.pop_front();
+                    ++consumed;
+                }
+            }));
+        }
+        for (int i = 0; i < 10; ++i) {
+            iom.schedule(std::function<void()>([&]() {
+                for (int j = 0; j < 100; ++j) {
+                    sylar::FiberMutex::Lock lock(mutex);
+                    queue.push_back(j);
+                    cond.notify();
+                }
+            }));
+        }
+    }
+    SYLAR_ASSERT(consumed == 1000);
+    SYLAR_LOG_INFO(g_logger) << "test_condition consumed=" << consumed;
+}
+
+void test_semaphore() {
+    sylar::FiberSemaphore sem(2);
+    std::atomic<int> running(0);
+    std::atomic<int> done(0);
+    {
+        sylar::IOManager iom(2, false, "sem");
+        for (int i = 0; i < 20; ++i) {
+            iom.schedule(std::function<void()>([&]() {
+                sem.wait();
+                SYLAR_ASSERT(++running <= 2);
+                usleep(1000);
+                --running;
+                sem.notify();
+                ++done;
+            }));
+        }
+    }
+    // 不在调度器中时阻塞线程
+    sem.wait();
+    sem.notify();
+    SYLAR_ASSERT(done == 20);
+    SYLAR_LOG_INFO(g_logger) << "test_semaphore done=" << done;
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+    test_condition();
+    test_semaphore();
+    for (size_t threads = 1; threads <= 4; threads *= 2) {
+        bench_mutex<sylar::Mutex, false>("Mutex", threads);
+        bench_mutex<sylar::SpinLock, false>("SpinLock", threads);
+        bench_mutex<sylar::FiberMutex, false>("FiberMutex", threads);
+        bench_mutex<sylar::FiberMutex, true>("FiberMutex(yield inside)", threads);
+    }
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include "hash.h"
+#include "bytearray.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+#include <string.h>
+#include <stdlib.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+// 已知结果，以及分段计算和一次计算的结果相同
+void test_known() {
+    const char* check = "123456789";
+    SYLAR_ASSERT(sylar::Crc32c(check, 9) == 0xE3069283);
+    SYLAR_ASSERT(sylar::Crc32cExtendSoftware(0, check, 9) == 0xE3069283);
+    char zeros[32] = { 0 };
+    SYLAR_ASSERT(sylar::Crc32c(zeros, sizeof(zeros)) == 0x8A9136AA);
+    SYLAR_ASSERT(sylar::Crc32c("", 0) == 0);
+
+    SYLAR_ASSERT(sylar::XXH64("", 0) == 0xEF46DB3751D8E999ull);
+    SYLAR_ASSERT(sylar::XXH64("a", 1) == 0xD24EC4F1A98C6E5Bull);
+    SYLAR_ASSERT(sylar::XXH64("abc", 3) == 0x44BC2CF5AD770999ull);
+    const char* text = "Nobody inspects the spammish repetition";
+    SYLAR_ASSERT(sylar::XXH64(text, strlen(text)) == 0xFBCEA83C8A378BF1ull);
+
+    std::string data;
+    srand(1);
+    for (int i = 0; i < 10000; ++i) {
+        data.push_back(rand());
+    }
+    uint32_t crc = sylar::Crc32c(data.c_str(), data.size());
+    uint64_t hash = sylar::XXH64(data.c_str(), data.size(), 7);
+    SYLAR_ASSERT(sylar::Crc32cExtendSoftware(0, data.c_str(), data.size()) == crc);
+    // 不同的切分方式和起始对齐
+    for (size_t step = 1; step < 100; step += 7) {
+        uint32_t c = 0;
+        uint32_t sc = 0;
+        sylar::XXHash64 h(7);
+        for (size_t i = 0; i < data.size(); i += step) {
+            size_t n = std::min(step, data.size() - i);
+            c = sylar::Crc32cExtend(c, data.c_str() + i, n);
+            sc = sylar::Crc32cExtendSoftware(sc, data.c_str() + i, n);
+            h.update(data.c_str() + i, n);
+        }
+        SYLAR_ASSERT(c == crc);
+        SYLAR_ASSERT(sc == crc);
+        SYLAR_ASSERT(h.digest() == hash);
+    }
+    SYLAR_LOG_INFO(g_logger) << "test_known ok hardware=" << sylar::Crc32cHardwareEnabled();
+}
+
+// ByteArray跨内存块原地计算的结果与连续内存相同，帧尾可以按readFuint32读出校验
+void test_bytearray() {
+    std::string data;
+    for (int i = 0; i < 5000; ++i) {
+        data.push_back(rand());
+    }
+    size_t base_sizes[] = { 1, 7, 64, 1000, 8192 };
+    for (size_t base_size : base_sizes) {
+        sylar::ByteArray::ptr ba(new sylar::ByteArray(base_size));
+        ba->write(data.c_str(), data.size());
+        for (size_t pos = 0; pos < data.size(); pos += 333) {
+            for (size_t len = 0; pos + len <= data.size(); len += 777) {
+                SYLAR_ASSERT(ba->crc32c(pos, len) == sylar::Crc32c(data.c_str() + pos, len));
+                SYLAR_ASSERT(ba->xxhash64(pos, len, 3) == sylar::XXH64(data.c_str() + pos, len, 3));
+            }
+        }
+        // len超出数据末尾时截断
+        SYLAR_ASSERT(ba->crc32c(100, ~0ull) == sylar::Crc32c(data.c_str() + 100, data.size() - 100));
+        SYLAR_ASSERT(ba->crc32c(data.size(), 10) == 0);
+
+        // 帧: 长度 + 数据 + crc32c
+        ba->clear();
+        ba->writeFuint32(data.size());
+        size_t payload = ba->getPosition();
+        ba->write(data.c_str(), data.size());
+        uint32_t crc = ba->appendCrc32c(payload);
+        SYLAR_ASSERT(crc == sylar::Crc32c(data.c_str(), data.size()));
+
+        ba->setPosition(0);
+        uint32_t len = ba->readFuint32();
+        SYLAR_ASSERT(ba->crc32c(ba->getPosition(), len) == crc);
+        ba->setPosition(ba->getPosition() + len);
+        SYLAR_ASSERT(ba->readFuint32() == crc);
+
+        // 帧: 数据 + xxhash64
+        ba->clear();
+        ba->write(data.c_str(), data.size());
+        uint64_t hash = ba->appendXXHash64(0, 5);
+        SYLAR_ASSERT(hash == sylar::XXH64(data.c_str(), data.size(), 5));
+        ba->setPosition(data.size());
+        SYLAR_ASSERT(ba->readFuint64() == hash);
+    }
+    SYLAR_LOG_INFO(g_logger) << "test_bytearray ok";
+}
+
+// 先toString再计算与原地计算的对比，以及查表和SSE4.2的对比
+void bench(size_t mb, size_t loops) {
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(4096));
+    std::string block(1024 * 1024, '\0');
+    for (size_t i = 0; i < block.size(); ++i) {
+        block[i] = rand();
+    }
+    for (size_t i = 0; i < mb; ++i) {
+        ba->write(block.c_str(), block.size());
+    }
+    ba->setPosition(0);
+    size_t size = ba->getSize();
+
+    uint32_t expect = 0;
+    uint64_t begin = sylar::GetCurrentUS();
+    for (size_t i = 0; i < loops; ++i) {
+        std::string str = ba->toString();
+        expect = sylar::Crc32c(str.c_str(), str.size());
+    }
+    uint64_t copy_used = sylar::GetCurrentUS() - begin;
+
+    begin = sylar::GetCurrentUS();
+    for (size_t i = 0; i < loops; ++i) {
+        SYLAR_ASSERT(ba->crc32c(0, size) == expect);
+    }
+    uint64_t crc_used = sylar::GetCurrentUS() - begin;
+
+    begin = sylar::GetCurrentUS();
+    for (size_t i = 0; i < loops; ++i) {
+        std::vector<iovec> iovs;
+        ba->getReadBuffer(iovs, size, 0);
+        uint32_t crc = 0;
+        for (auto& iov : iovs) {
+            crc = sylar::Crc32cExtendSoftware(crc, iov.iov_base, iov.iov_len);
+        }
+        SYLAR_ASSERT(crc == expect);
+    }
+    uint64_t soft_used = sylar::GetCurrentUS() - begin;
+
+    begin = sylar::GetCurrentUS();
+    for (size_t i = 0; i < loops; ++i) {
+        ba->xxhash64(0, size);
+    }
+    uint64_t xxh_used = sylar::GetCurrentUS() - begin;
+
+    uint64_t bytes = size * loops;
+    auto mbps = [bytes](uint64_t us) { return us ? bytes / us : 0; };
+    SYLAR_LOG_INFO(g_logger) << "bench size=" << mb << "MB loops=" << loops
+        << " toString+crc32c=" << copy_used << "us(" << mbps(copy_used) << "MB/s)"
+        << " crc32c=" << crc_used << "us(" << mbps(crc_used) << "MB/s)"
+        << " crc32c(software)=" << soft_used << "us(" << mbps(soft_used) << "MB/s)"
+        << " xxhash64=" << xxh_used << "us(" << mbps(xxh_used) << "MB/s)";
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    test_known();
+    test_bytearray();
+    size_t mb = argc > 1 ? atoi(argv[1]) : 64;
+    size_t loops = argc > 2 ? atoi(argv[2]) : 10;
+    bench(mb, loops);
+    return 0;
+}
@@ -2,11 +2,16 @@
 #include "log.h"
 #include "iomanager.h"
 #include "fd_manager.h"
+#include "socket.h"
+#include "macro.h"
+#include "streams/socket_stream.h"
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/uio.h>
+#include <limits.h>
 
 sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
@@ -58,8 +63,102 @@ void test_sock() {
     SYLAR_LOG_INFO(g_logger) << buff;
 }
 
+// 单线程IOManager中收发双方都是协程，writev/readv等不被hook时会直接返回EAGAIN
+void test_iovec() {
+    sylar::IOManager iom(1, false, "iovec");
+    iom.schedule([]() {
+        sylar::Socket::ptr listener = sylar::Socket::CreateTCPSocket();
+        SYLAR_ASSERT(listener->bind(sylar::IPv4Address::Create("127.0.0.1", 0)));
+        SYLAR_ASSERT(listener->listen());
+        sylar::Address::ptr addr = listener->getLocalAddress();
+
+        // 远大于socket缓冲区，写端一定会挂起等待
+        const size_t N = 8 * 1024 * 1024;
+        std::string head(100, 'h');
+        std::string body(N, 'b');
+        std::string tail(3, 't');
+        sylar::IOManager::GetThisIOManager()->schedule(std::function<void()>([addr, head, body, tail]() {
+            sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+            SYLAR_ASSERT(sock->connect(addr));
+            sylar::SocketStream stream(sock);
+            iovec iov[3];
+            iov[0].iov_base = (void*)head.data();
+            iov[0].iov_len = head.size();
+            iov[1].iov_base = (void*)body.data();
+            iov[1].iov_len = body.size();
+            iov[2].iov_base = (void*)tail.data();
+            iov[2].iov_len = tail.size();
+            int rt = stream.writeFixSize(iov, 3);
+            SYLAR_ASSERT2(rt == (int)(head.size() + body.size() + tail.size()), std::to_string(rt));
+
+            // 裸的writev也要挂起等待
+            const char* msg = "writev";
+            iov[0].iov_base = (void*)msg;
+            iov[0].iov_len = strlen(msg);
+            SYLAR_ASSERT(writev(sock->getSocketfd(), iov, 1) == (ssize_t)strlen(msg));
+        }));
+
+        sylar::Socket::ptr client = listener->accept();
+        SYLAR_ASSERT(client);
+        std::string data(head.size() + body.size() + tail.size() + strlen("writev"), '\0');
+        size_t offset = 0;
+        while (offset < data.size()) {
+            // 每次分两段接收
+            size_t left = data.size() - offset;
+            iovec iov[2];
+            iov[0].iov_base = &data[offset];
+            iov[0].iov_len = left / 2;
+            iov[1].iov_base = &data[offset + left / 2];
+            iov[1].iov_len = left - left / 2;
+            int rt = client->recv(iov, 2);
+            SYLAR_ASSERT(rt > 0);
+            offset += rt;
+        }
+        SYLAR_ASSERT(data == head + body + tail + "writev");
+        SYLAR_LOG_INFO(g_logger) << "test_iovec ok bytes=" << data.size();
+    });
+}
+
+// 只统计字节数的流，不访问数据，每次最多写256MB
+class CountStream : public sylar::Stream
+{
+public:
+    int read(void* buffer, size_t length) override { return -1; }
+    int write(const void* buffer, size_t length) override {
+        int len = std::min(length, (size_t)256 * 1024 * 1024);
+        bytes += len;
+        return len;
+    }
+    void close() override {}
+
+    uint64_t bytes = 0;
+};
+
+// iovec总长度超过2GB时返回值不溢出
+void test_iovec_large() {
+    char buf[1];
+    const size_t N = 1536ull * 1024 * 1024;
+    iovec iov[2];
+    iov[0].iov_base = buf;
+    iov[0].iov_len = N;
+    iov[1].iov_base = buf;
+    iov[1].iov_len = N;
+
+    CountStream stream;
+    int rt = stream.write(iov, 2);
+    SYLAR_ASSERT2(rt > 0 && (uint64_t)rt == stream.bytes, std::to_string(rt));
+
+    stream.bytes = 0;
+    rt = stream.writeFixSize(iov, 2);
+    SYLAR_ASSERT2(rt == INT_MAX, std::to_string(rt));
+    SYLAR_ASSERT(stream.bytes == 2 * N);
+    SYLAR_LOG_INFO(g_logger) << "test_iovec_large ok bytes=" << stream.bytes;
+}
+
 int main() {
     // test_sleep();
+    test_iovec();
+    test_iovec_large();
     sylar::IOManager iom;
     iom.schedule(test_sock);
 
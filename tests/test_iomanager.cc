@@ -1,5 +1,11 @@
 #include "iomanager.h"
 #include "log.h"
+#include "macro.h"
+#include "config.h"
+#include "util.h"
+#include <atomic>
+#include <unistd.h>
+#include <sys/resource.h>
 
 sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("root");
 
@@ -35,7 +41,59 @@ void test_timer() {
     }, true);
 }
 
+// fd表按需分配: 很大的fd也能注册，多个线程同时注册不同fd
+void test_fd_table() {
+    SYLAR_LOG_INFO(g_logger) << "test_fd_table";
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    int high = std::min<rlim_t>(limit.rlim_cur - 1, 200000);
+    int fds[2];
+    SYLAR_ASSERT(pipe(fds) == 0);
+    SYLAR_ASSERT(dup2(fds[0], high) == high);
+    std::atomic<int> fired(0);
+    {
+        sylar::IOManager iom(2, false, "fd_table");
+        SYLAR_ASSERT(iom.addEvent(fds[0], sylar::IOManager::READ, [&fired]() { ++fired; }) == 0);
+        SYLAR_ASSERT(iom.addEvent(high, sylar::IOManager::READ, [&fired]() { ++fired; }) == 0);
+        SYLAR_ASSERT(!iom.cancelEvent(high + 1, sylar::IOManager::READ));
+        SYLAR_ASSERT(write(fds[1], "x", 1) == 1);
+    }
+    SYLAR_ASSERT(fired == 2);
+    close(high);
+    close(fds[0]);
+    close(fds[1]);
+    SYLAR_LOG_INFO(g_logger) << "test_fd_table high=" << high << " ok";
+}
+
+// 非工作线程逐个提交任务，每个任务都在工作线程准备进入idle时到达，不能等到epoll超时才执行
+void test_schedule_latency(bool multi_reactor, size_t count) {
+    SYLAR_LOG_INFO(g_logger) << "test_schedule_latency multi_reactor=" << multi_reactor;
+    sylar::ConfigVar<bool>::ptr var = sylar::Config::Lookup<bool>("iomanager.multi_reactor");
+    var->setValue(multi_reactor);
+    uint64_t max_us = 0;
+    {
+        sylar::IOManager iom(1, false, "latency");
+        std::atomic<bool> done(false);
+        for (size_t i = 0; i < count; ++i) {
+            done = false;
+            uint64_t begin = sylar::GetCurrentUS();
+            iom.schedule(std::function<void()>([&done]() { done = true; }));
+            while (!done) {
+                sched_yield();
+            }
+            max_us = std::max(max_us, sylar::GetCurrentUS() - begin);
+        }
+    }
+    var->setValue(false);
+    SYLAR_ASSERT2(max_us < 1000 * 1000, std::to_string(max_us));
+    SYLAR_LOG_INFO(g_logger) << "test_schedule_latency count=" << count << " max=" << max_us << "us ok";
+}
+
 int main() {
     // test1();
+    test_fd_table();
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+    test_schedule_latency(false, 200000);
+    test_schedule_latency(true, 200000);
     test_timer();
 }
\ No newline at end of file
@@ -0,0 +1,294 @@
+#include "log.h"
+#include "config.h"
+#include "thread.h"
+#include "macro.h"
+#include "util.h"
+#include <yaml-cpp/yaml.h>
+#include <fstream>
+#include <stdlib.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+// 收到的日志放在内存中，open为false时write一直等待，模拟很慢的磁盘
+class SlowLogAppender : public sylar::LogAppender
+{
+public:
+    using ptr = std::shared_ptr<SlowLogAppender>;
+
+    void log(sylar::Logger::ptr logger, sylar::LogLevel::Level level, sylar::LogEvent::ptr event) override {
+        if (level >= m_level && !asyncLog(logger, level, event)) {
+            std::stringstream ss;
+            m_formatter->format(ss, logger, level, event);
+            write(ss.str().c_str(), ss.str().size());
+        }
+    }
+
+    size_t lines() {
+        MutexType::Lock lock(m_mutex);
+        size_t count = 0;
+        for (char c : m_data) {
+            count += c == '\n';
+        }
+        return count;
+    }
+
+    std::atomic<bool> open{ true };
+
+protected:
+    void write(const char* data, size_t len) override {
+        while (!open) {
+            usleep(1000);
+        }
+        MutexType::Lock lock(m_mutex);
+        m_data.append(data, len);
+    }
+
+private:
+    std::string m_data;
+};
+
+static std::vector<std::string> read_lines(const std::string& name) {
+    std::vector<std::string> lines;
+    std::ifstream ifs(name);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// 多个线程写同一个异步文件Appender，每个线程的日志完整且有序
+void test_order(size_t threads, size_t count) {
+    const std::string name = "/tmp/test_log_async_order.txt";
+    unlink(name.c_str());
+    sylar::Logger::ptr logger(new sylar::Logger("async_order"));
+    sylar::FileLogAppender::ptr appender = std::make_shared<sylar::FileLogAppender>(name);
+    appender->setFormatter("%m%n");
+    logger->addAppender(appender);
+    appender->setAsync(true);
+    SYLAR_ASSERT(appender->isAsync());
+
+    std::vector<sylar::Thread::ptr> ths;
+    for (size_t t = 0; t < threads; ++t) {
+        ths.push_back(std::make_shared<sylar::Thread>([logger, t, count]() {
+            for (size_t i = 0; i < count; ++i) {
+                SYLAR_LOG_INFO(logger) << t << " " << i;
+            }
+        }, "order_" + std::to_string(t)));
+    }
+    for (auto& th : ths) {
+        th->join();
+    }
+    sylar::LogAppender::FlushAsync();
+
+    std::vector<std::string> lines = read_lines(name);
+    SYLAR_ASSERT2(lines.size() == threads * count, std::to_string(lines.size()));
+    std::vector<size_t> next(threads, 0);
+    for (auto& line : lines) {
+        size_t t = 0;
+        size_t i = 0;
+        SYLAR_ASSERT(sscanf(line.c_str(), "%zu %zu", &t, &i) == 2);
+        SYLAR_ASSERT(t < threads && next[t] == i);
+        ++next[t];
+    }
+    appender->setAsync(false);
+    SYLAR_LOG_INFO(logger) << "sync";
+    SYLAR_ASSERT(!appender->isAsync());
+    unlink(name.c_str());
+    SYLAR_LOG_INFO(g_logger) << "test_order ok lines=" << lines.size();
+}
+
+// 写日志的同时反复切换同步和异步，切换时缓冲区中的日志不丢失
+void test_switch(size_t count) {
+    const std::string name = "/tmp/test_log_async_switch.txt";
+    unlink(name.c_str());
+    sylar::Logger::ptr logger(new sylar::Logger("async_switch"));
+    sylar::FileLogAppender::ptr appender = std::make_shared<sylar::FileLogAppender>(name);
+    appender->setFormatter("%m%n");
+    logger->addAppender(appender);
+
+    std::atomic<bool> done{ false };
+    sylar::Thread::ptr th = std::make_shared<sylar::Thread>([logger, count, &done]() {
+        for (size_t i = 0; i < count; ++i) {
+            SYLAR_LOG_INFO(logger) << i;
+        }
+        done = true;
+    }, "switch");
+    size_t switches = 0;
+    while (!done) {
+        appender->setAsync(switches % 2 == 0);
+        ++switches;
+    }
+    th->join();
+    appender->setAsync(false);
+
+    std::vector<std::string> lines = read_lines(name);
+    SYLAR_ASSERT2(lines.size() == count, std::to_string(lines.size()));
+    unlink(name.c_str());
+    SYLAR_LOG_INFO(g_logger) << "test_switch ok switches=" << switches;
+}
+
+// 切回同步时有线程已经取得id、还没放入缓冲区: 缓冲区满并且后台线程卡在write中，
+// 写日志的线程在block等待，setAsync(false)要等它放入后再写出，这条日志不丢失
+void test_switch_inflight() {
+    sylar::Config::Lookup<uint32_t>("log.async.buffer_size")->setValue(4096);
+    const size_t count = 1000;
+    sylar::Logger::ptr logger(new sylar::Logger("async_switch_inflight"));
+    SlowLogAppender::ptr appender = std::make_shared<SlowLogAppender>();
+    appender->setFormatter("%m%n");
+    logger->addAppender(appender);
+    appender->setAsync(true);
+    appender->open = false;
+
+    std::atomic<bool> done{ false };
+    sylar::Thread::ptr th = std::make_shared<sylar::Thread>([logger, count, &done]() {
+        for (size_t i = 0; i < count; ++i) {
+            SYLAR_LOG_INFO(logger) << "inflight " << i;
+        }
+        done = true;
+    }, "inflight");
+    usleep(100 * 1000);
+    SYLAR_ASSERT(!done);
+
+    // 切换开始后才恢复写出
+    sylar::Thread::ptr opener = std::make_shared<sylar::Thread>([appender]() {
+        usleep(100 * 1000);
+        appender->open = true;
+    }, "opener");
+    appender->setAsync(false);
+    opener->join();
+    th->join();
+    sylar::LogAppender::FlushAsync();
+
+    SYLAR_ASSERT2(appender->lines() == count, std::to_string(appender->lines()));
+    SYLAR_ASSERT(appender->getDropped() == 0);
+    sylar::Config::Lookup<uint32_t>("log.async.buffer_size")->setValue(1024 * 1024);
+    SYLAR_LOG_INFO(g_logger) << "test_switch_inflight ok";
+}
+
+// 写出很慢时缓冲区写满: drop丢弃并计数，drop_below只丢弃低级别日志，block等待写出
+void test_overflow() {
+    sylar::Config::Lookup<uint32_t>("log.async.buffer_size")->setValue(4096);
+    const size_t count = 1000;
+    const sylar::LogAppender::Overflow overflows[] = {
+        sylar::LogAppender::DROP, sylar::LogAppender::DROP_BELOW, sylar::LogAppender::BLOCK
+    };
+    for (auto overflow : overflows) {
+        sylar::Logger::ptr logger(new sylar::Logger("async_overflow"));
+        SlowLogAppender::ptr appender = std::make_shared<SlowLogAppender>();
+        appender->setFormatter("%p %m%n");
+        appender->setOverflow(overflow, sylar::LogLevel::ERROR);
+        logger->addAppender(appender);
+        appender->setAsync(true);
+        appender->open = false;
+
+        std::atomic<bool> done{ false };
+        // 新线程使用上面设置的缓冲区大小
+        sylar::Thread::ptr th = std::make_shared<sylar::Thread>([logger, count, &done]() {
+            for (size_t i = 0; i < count; ++i) {
+                if (i % 2) {
+                    SYLAR_LOG_ERROR(logger) << "error " << i;
+                } else {
+                    SYLAR_LOG_INFO(logger) << "info " << i;
+                }
+            }
+            done = true;
+        }, "overflow");
+        usleep(100 * 1000);
+        // drop不会等待写出
+        SYLAR_ASSERT(overflow == sylar::LogAppender::BLOCK ? !done : true);
+        if (overflow == sylar::LogAppender::DROP) {
+            SYLAR_ASSERT(done);
+        }
+        appender->open = true;
+        th->join();
+        sylar::LogAppender::FlushAsync();
+
+        size_t lines = appender->lines();
+        uint64_t dropped = appender->getDropped();
+        SYLAR_ASSERT(lines + dropped == count);
+        if (overflow == sylar::LogAppender::BLOCK) {
+            SYLAR_ASSERT(dropped == 0);
+        } else {
+            SYLAR_ASSERT(dropped > 0);
+        }
+        if (overflow == sylar::LogAppender::DROP_BELOW) {
+            SYLAR_ASSERT(dropped <= count / 2);
+        }
+        SYLAR_LOG_INFO(g_logger) << "test_overflow overflow=" << overflow << " lines=" << lines << " dropped=" << dropped;
+    }
+    sylar::Config::Lookup<uint32_t>("log.async.buffer_size")->setValue(1024 * 1024);
+}
+
+// 通过logs配置开启异步
+void test_config() {
+    const std::string name = "/tmp/test_log_async_config.txt";
+    unlink(name.c_str());
+    YAML::Node root = YAML::Load(
+        "logs:\n"
+        "  - name: async_config\n"
+        "    level: info\n"
+        "    appenders:\n"
+        "      - type: FileLogAppender\n"
+        "        file: " + name + "\n"
+        "        formatter: \"%m%n\"\n"
+        "        async: true\n"
+        "        overflow: drop_below\n"
+        "        overflow_level: error\n");
+    sylar::Config::LoadFromYaml(root);
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME("async_config");
+    for (int i = 0; i < 100; ++i) {
+        SYLAR_LOG_INFO(logger) << "config " << i;
+    }
+    sylar::LogAppender::FlushAsync();
+    SYLAR_ASSERT(read_lines(name).size() == 100);
+    unlink(name.c_str());
+    SYLAR_LOG_INFO(g_logger) << "test_config ok";
+}
+
+// 每个线程写count条日志，统计写日志线程花费的时间
+void bench(bool async, size_t threads, size_t count) {
+    const std::string name = "/tmp/bench_log_async.txt";
+    unlink(name.c_str());
+    sylar::Logger::ptr logger(new sylar::Logger("bench_async"));
+    sylar::FileLogAppender::ptr appender = std::make_shared<sylar::FileLogAppender>(name);
+    logger->addAppender(appender);
+    appender->setAsync(async);
+
+    uint64_t begin = sylar::GetCurrentUS();
+    std::vector<sylar::Thread::ptr> ths;
+    for (size_t t = 0; t < threads; ++t) {
+        ths.push_back(std::make_shared<sylar::Thread>([logger, count]() {
+            for (size_t i = 0; i < count; ++i) {
+                SYLAR_LOG_INFO(logger) << "bench async log line " << i;
+            }
+        }, "bench_" + std::to_string(t)));
+    }
+    for (auto& th : ths) {
+        th->join();
+    }
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    sylar::LogAppender::FlushAsync();
+    uint64_t total = sylar::GetCurrentUS() - begin;
+    appender->setAsync(false);
+    unlink(name.c_str());
+    size_t lines = threads * count;
+    SYLAR_LOG_INFO(g_logger) << "bench " << (async ? "async" : "sync") << " threads=" << threads
+        << " lines=" << lines << " writers=" << used << "us(" << (used ? lines * 1000000 / used : 0)
+        << " lines/s) total=" << total << "us";
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    size_t threads = argc > 1 ? atoi(argv[1]) : 4;
+    size_t count = argc > 2 ? atoi(argv[2]) : 100000;
+    test_order(threads, 10000);
+    test_switch(200000);
+    test_switch_inflight();
+    test_overflow();
+    test_config();
+    bench(false, threads, count);
+    bench(true, threads, count);
+    return 0;
+}
@@ -0,0 +1,235 @@
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+#include <atomic>
+#include <iomanip>
+#include <new>
+#include <type_traits>
+#include <stdlib.h>
+
+// 统计堆分配次数
+static std::atomic<uint64_t> s_allocs{ 0 };
+
+void* operator new(size_t size) {
+    ++s_allocs;
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+// 格式化后丢弃，只衡量日志本身的开销
+class NullLogAppender : public sylar::LogAppender
+{
+public:
+    using ptr = std::shared_ptr<NullLogAppender>;
+
+    // legacy为true时按原来的方式经过std::ostream格式化
+    NullLogAppender(bool legacy) : m_legacy(legacy) {}
+
+    void log(sylar::Logger::ptr logger, sylar::LogLevel::Level level, sylar::LogEvent::ptr event) override {
+        if (m_legacy) {
+            std::stringstream ss;
+            m_formatter->format(ss, logger, level, event);
+            bytes += ss.str().size();
+        } else {
+            sylar::LogStream os(true);
+            m_formatter->format(os, logger, level, event);
+            bytes += os.size();
+        }
+    }
+
+    uint64_t bytes = 0;
+
+protected:
+    void write(const char* data, size_t len) override {}
+
+private:
+    bool m_legacy;
+};
+
+static const char* s_pattern = "%d{%Y-%m-%d %H:%M:%S} %t %N %F [%p] [%c] %f:%l %m%n";
+
+// 原来的路径: 堆上的LogEvent，内容和格式化都经过std::stringstream，复制线程名
+static void legacy_log(sylar::Logger::ptr logger, size_t i) {
+    std::string thread_name = sylar::Thread::GetName();
+    sylar::LogEvent::ptr event = std::make_shared<sylar::LogEvent>(logger, sylar::LogLevel::INFO, __FILE__, __LINE__,
+        0, sylar::GetThreadId(), sylar::GetFiberId(), time(0), thread_name);
+    std::stringstream ss;
+    ss << "request id=" << i << " path=" << "/api/v1/items" << " latency=" << 1.25 << "ms ok=" << true;
+    event->getSS() << ss.str();
+    logger->log(sylar::LogLevel::INFO, event);
+}
+
+static void fast_log(sylar::Logger::ptr logger, size_t i) {
+    SYLAR_LOG_INFO(logger) << "request id=" << i << " path=" << "/api/v1/items" << " latency=" << 1.25 << "ms ok=" << true;
+}
+
+// 线程名只保存引用，传入临时字符串时编译失败
+static_assert(!std::is_constructible<sylar::LogEvent, sylar::Logger::ptr, sylar::LogLevel::Level, const char*, int32_t,
+    uint32_t, uint32_t, uint32_t, uint64_t, std::string>::value, "LogEvent must not bind a temporary thread name");
+static_assert(!std::is_constructible<sylar::LogEvent, sylar::Logger::ptr, sylar::LogLevel::Level, const char*, int32_t,
+    uint32_t, uint32_t, uint32_t, uint64_t, const char*>::value, "LogEvent must not bind a temporary thread name");
+static_assert(std::is_constructible<sylar::LogEvent, sylar::Logger::ptr, sylar::LogLevel::Level, const char*, int32_t,
+    uint32_t, uint32_t, uint32_t, uint64_t, const std::string&>::value, "LogEvent takes a thread name that outlives it");
+
+// 两条路径输出相同的内容
+void test_same_output() {
+    sylar::Logger::ptr logger(new sylar::Logger("bench"));
+    logger->setFormatter(s_pattern);
+    sylar::LogEvent::ptr event = std::make_shared<sylar::LogEvent>(logger, sylar::LogLevel::INFO, "a.cc", 10,
+        0, 1, 2, time(0), sylar::Thread::GetName());
+    event->getSS() << "int=" << -123 << " u64=" << 18446744073709551615ull << " d=" << 3.5 << " c=" << 'x'
+        << " s=" << std::string("str") << " b=" << false << " enum=" << sylar::LogLevel::WARN
+        << " hex=" << std::hex << 255 << " after=" << 16
+        << " w=[" << std::setw(6) << std::string("ab") << "][" << 5 << "] ba=" << std::boolalpha << true;
+    std::stringstream expect;
+    expect << "int=" << -123 << " u64=" << 18446744073709551615ull << " d=" << 3.5 << " c=" << 'x'
+        << " s=" << std::string("str") << " b=" << false << " enum=" << sylar::LogLevel::WARN
+        << " hex=" << std::hex << 255 << " after=" << 16
+        << " w=[" << std::setw(6) << std::string("ab") << "][" << 5 << "] ba=" << std::boolalpha << true;
+    SYLAR_ASSERT2(event->getContent() == expect.str(), event->getContent());
+
+    sylar::LogFormatter::ptr formatter = std::make_shared<sylar::LogFormatter>(s_pattern);
+    std::stringstream ss;
+    formatter->format(ss, logger, sylar::LogLevel::INFO, event);
+    sylar::LogStream os;
+    formatter->format(os, logger, sylar::LogLevel::INFO, event);
+    SYLAR_ASSERT2(os.str() == ss.str(), os.str());
+
+    // 超过缓冲区的内容转到堆上
+    sylar::LogStream big;
+    std::string line(10000, 'x');
+    big << line << 1;
+    SYLAR_ASSERT(big.str() == line + "1");
+
+    // printf风格
+    event = std::make_shared<sylar::LogEvent>(logger, sylar::LogLevel::INFO, "a.cc", 10,
+        0, 1, 2, time(0), sylar::Thread::GetName());
+    event->format("%s-%d", line.c_str(), 7);
+    SYLAR_ASSERT(event->getContent() == line + "-7");
+    SYLAR_LOG_INFO(g_logger) << "test_same_output ok";
+}
+
+static std::string format_event(sylar::LogFormatter::ptr formatter, sylar::Logger::ptr logger, time_t sec, uint32_t usec) {
+    sylar::LogEvent::ptr event = std::make_shared<sylar::LogEvent>(logger, sylar::LogLevel::INFO, "a.cc", 10,
+        0, 1, 2, sec, sylar::Thread::GetName());
+    event->setMicrosecond(usec);
+    sylar::LogStream os;
+    formatter->format(os, logger, sylar::LogLevel::INFO, event);
+    std::stringstream ss;
+    formatter->format(ss, logger, sylar::LogLevel::INFO, event);
+    SYLAR_ASSERT(ss.str() == os.str());
+    return os.str();
+}
+
+static std::string strftime_str(const char* fmt, time_t sec) {
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    char buf[128];
+    size_t len = strftime(buf, sizeof(buf), fmt, &tm);
+    return std::string(buf, len);
+}
+
+// 缓存的时间与strftime相同，秒数变化或多个格式交替使用时重新格式化，%L/%f输出毫秒/微秒
+void test_datetime() {
+    sylar::Logger::ptr logger(new sylar::Logger("datetime"));
+    sylar::LogFormatter::ptr ms = std::make_shared<sylar::LogFormatter>("%d{%Y-%m-%d %H:%M:%S.%L}");
+    sylar::LogFormatter::ptr us = std::make_shared<sylar::LogFormatter>("%d{%H:%M:%S.%f %%L}");
+    sylar::LogFormatter::ptr def = std::make_shared<sylar::LogFormatter>("%d");
+    time_t sec = 1700000000;
+    for (int i = 0; i < 3; ++i) {
+        for (uint32_t usec : { 5u, 123456u, 999999u }) {
+            char buf[16];
+            snprintf(buf, sizeof(buf), ".%03u", usec / 1000);
+            SYLAR_ASSERT(format_event(ms, logger, sec + i, usec) == strftime_str("%Y-%m-%d %H:%M:%S", sec + i) + buf);
+            snprintf(buf, sizeof(buf), ".%06u", usec);
+            SYLAR_ASSERT(format_event(us, logger, sec + i, usec) == strftime_str("%H:%M:%S", sec + i) + buf + " %L");
+            SYLAR_ASSERT(format_event(def, logger, sec + i, usec) == strftime_str("%Y-%m-%d %H:%M:%S", sec + i));
+        }
+    }
+    // 格式比线程缓存多，缓存位置冲突
+    std::vector<sylar::LogFormatter::ptr> formatters;
+    for (int i = 0; i < 20; ++i) {
+        formatters.push_back(std::make_shared<sylar::LogFormatter>("%d{" + std::to_string(i) + " %H:%M:%S}"));
+    }
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 20; ++i) {
+            SYLAR_ASSERT(format_event(formatters[i], logger, sec + round, 0)
+                == strftime_str((std::to_string(i) + " %H:%M:%S").c_str(), sec + round));
+        }
+    }
+    SYLAR_LOG_INFO(g_logger) << "test_datetime ok";
+}
+
+// 时间格式化: 同一秒内命中缓存，与每次秒数都变化(每次localtime_r+strftime)对比
+void bench_datetime(size_t count) {
+    sylar::Logger::ptr logger(new sylar::Logger("datetime"));
+    sylar::LogFormatter::ptr formatter = std::make_shared<sylar::LogFormatter>("%d{%Y-%m-%d %H:%M:%S.%L}");
+    sylar::LogEvent::ptr same = std::make_shared<sylar::LogEvent>(logger, sylar::LogLevel::INFO, "a.cc", 10,
+        0, 1, 2, time(0), sylar::Thread::GetName());
+    uint64_t used[2] = { 0, 0 };
+    size_t bytes = 0;
+    for (int miss = 0; miss < 2; ++miss) {
+        uint64_t begin = sylar::GetCurrentUS();
+        for (size_t i = 0; i < count; ++i) {
+            sylar::LogEvent::ptr event = same;
+            sylar::LogEvent other(logger, sylar::LogLevel::INFO, "a.cc", 10, 0, 1, 2, time(0) + i, sylar::Thread::GetName());
+            if (miss) {
+                event = sylar::LogEvent::ptr(sylar::LogEvent::ptr(), &other);
+            }
+            sylar::LogStream os;
+            formatter->format(os, logger, sylar::LogLevel::INFO, event);
+            bytes += os.size();
+        }
+        used[miss] = sylar::GetCurrentUS() - begin;
+    }
+    SYLAR_LOG_INFO(g_logger) << "bench_datetime count=" << count << " cached=" << (count ? used[0] * 1000 / count : 0)
+        << "ns/op every_second=" << (count ? used[1] * 1000 / count : 0) << "ns/op bytes=" << bytes;
+}
+
+void bench(bool legacy, size_t count) {
+    sylar::Logger::ptr logger(new sylar::Logger("bench"));
+    logger->setFormatter(s_pattern);
+    NullLogAppender::ptr appender = std::make_shared<NullLogAppender>(legacy);
+    logger->addAppender(appender);
+    // 预热，线程局部的对象在这里创建
+    for (size_t i = 0; i < 100; ++i) {
+        legacy ? legacy_log(logger, i) : fast_log(logger, i);
+    }
+    uint64_t allocs = s_allocs;
+    uint64_t begin = sylar::GetCurrentUS();
+    for (size_t i = 0; i < count; ++i) {
+        legacy ? legacy_log(logger, i) : fast_log(logger, i);
+    }
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    allocs = s_allocs - allocs;
+    if (!legacy) {
+        SYLAR_ASSERT2(allocs == 0, std::to_string(allocs));
+    }
+    SYLAR_LOG_INFO(g_logger) << "bench " << (legacy ? "legacy" : "fast") << " count=" << count
+        << " used=" << used << "us ns/op=" << (count ? used * 1000 / count : 0)
+        << " allocs/op=" << (double)allocs / count << " bytes=" << appender->bytes;
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    test_same_output();
+    test_datetime();
+    size_t count = argc > 1 ? atoi(argv[1]) : 1000000;
+    bench_datetime(count);
+    bench(true, count);
+    bench(false, count);
+    return 0;
+}
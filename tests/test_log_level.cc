@@ -0,0 +1,155 @@
+// 这个文件按发布版本的方式编译，DEBUG日志在编译时去掉
+#undef SYLAR_LOG_MIN_LEVEL
+#define SYLAR_LOG_MIN_LEVEL 2
+
+#include "log.h"
+#include "config.h"
+#include "macro.h"
+#include "util.h"
+#include <yaml-cpp/yaml.h>
+#include <stdlib.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static int s_evaluated = 0;
+
+// 日志输出时才会被调用
+static int touch() {
+    return ++s_evaluated;
+}
+
+// 收到的日志放在内存中
+class MemoryLogAppender : public sylar::LogAppender
+{
+public:
+    using ptr = std::shared_ptr<MemoryLogAppender>;
+
+    void log(sylar::Logger::ptr logger, sylar::LogLevel::Level level, sylar::LogEvent::ptr event) override {
+        if (level >= m_level) {
+            sylar::LogStream os;
+            std::atomic_load(&m_formatter)->format(os, logger, level, event);
+            write(os.data(), os.size());
+        }
+    }
+
+    std::string data;
+
+protected:
+    void write(const char* data, size_t len) override {
+        MutexType::Lock lock(m_mutex);
+        this->data.append(data, len);
+    }
+};
+
+// 低于SYLAR_LOG_MIN_LEVEL的日志即使Logger的级别允许也不输出，参数也不求值
+void test_min_level() {
+    sylar::Logger::ptr logger(new sylar::Logger("min_level", sylar::LogLevel::DEBUG));
+    MemoryLogAppender::ptr appender = std::make_shared<MemoryLogAppender>();
+    appender->setFormatter("%p %m%n");
+    logger->addAppender(appender);
+    s_evaluated = 0;
+    SYLAR_LOG_DEBUG(logger) << "debug " << touch();
+    SYLAR_LOG_FMT_DEBUG(logger, "debug %d", touch());
+    SYLAR_LOG_NAME_DEBUG("min_level_site") << "debug " << touch();
+    SYLAR_ASSERT(s_evaluated == 0);
+    SYLAR_LOG_INFO(logger) << "info " << touch();
+    SYLAR_LOG_FMT_WARN(logger, "warn %d", touch());
+    SYLAR_ASSERT(s_evaluated == 2);
+    SYLAR_ASSERT2(appender->data == "INFO info 1\nWARN warn 2\n", appender->data);
+    SYLAR_LOG_INFO(g_logger) << "test_min_level ok";
+}
+
+static void site_log(int i) {
+    SYLAR_LOG_NAME_INFO("site") << "info " << i << " " << touch();
+}
+
+static void site_fmt(int i) {
+    SYLAR_LOG_NAME_FMT_ERROR("site", "error %d %d", i, touch());
+}
+
+// 调用点缓存的Logger和级别在setLevel或配置变化后重新判断
+void test_site() {
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME("site");
+    MemoryLogAppender::ptr appender = std::make_shared<MemoryLogAppender>();
+    appender->setFormatter("%c %p %m%n");
+    logger->addAppender(appender);
+    s_evaluated = 0;
+
+    logger->setLevel(sylar::LogLevel::WARN);
+    site_log(1);
+    site_fmt(1);
+    site_log(2);
+    SYLAR_ASSERT(s_evaluated == 1);
+    SYLAR_ASSERT2(appender->data == "site ERROR error 1 1\n", appender->data);
+
+    logger->setLevel(sylar::LogLevel::INFO);
+    site_log(3);
+    SYLAR_ASSERT(s_evaluated == 2);
+
+    logger->setLevel(sylar::LogLevel::FATAL);
+    site_log(4);
+    site_fmt(4);
+    SYLAR_ASSERT(s_evaluated == 2);
+    SYLAR_ASSERT2(appender->data == "site ERROR error 1 1\nsite INFO info 3 2\n", appender->data);
+
+    // 通过logs配置修改级别
+    YAML::Node root = YAML::Load(
+        "logs:\n"
+        "  - name: site\n"
+        "    level: info\n"
+        "    formatter: \"%c %p %m%n\"\n");
+    sylar::Config::LoadFromYaml(root);
+    SYLAR_ASSERT(logger == SYLAR_LOG_NAME("site"));
+    logger->addAppender(appender);
+    appender->data.clear();
+    site_log(5);
+    site_fmt(5);
+    SYLAR_ASSERT(s_evaluated == 4);
+    SYLAR_ASSERT2(appender->data == "site INFO info 5 3\nsite ERROR error 5 4\n", appender->data);
+
+    // 配置中删除后级别为UNKNOW，都输出
+    sylar::Config::LoadFromYaml(YAML::Load("logs:\n"));
+    site_fmt(6);
+    SYLAR_ASSERT(s_evaluated == 5);
+    SYLAR_LOG_INFO(g_logger) << "test_site ok";
+}
+
+// 不输出的日志: 调用点缓存、每次按名字查找、全局Logger
+void bench(size_t count) {
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME("bench_site");
+    logger->setLevel(sylar::LogLevel::ERROR);
+    s_evaluated = 0;
+
+    uint64_t begin = sylar::GetCurrentUS();
+    for (size_t i = 0; i < count; ++i) {
+        SYLAR_LOG_NAME_INFO("bench_site") << "disabled " << touch();
+    }
+    uint64_t site_used = sylar::GetCurrentUS() - begin;
+
+    begin = sylar::GetCurrentUS();
+    for (size_t i = 0; i < count; ++i) {
+        SYLAR_LOG_INFO(SYLAR_LOG_NAME("bench_site")) << "disabled " << touch();
+    }
+    uint64_t name_used = sylar::GetCurrentUS() - begin;
+
+    begin = sylar::GetCurrentUS();
+    for (size_t i = 0; i < count; ++i) {
+        SYLAR_LOG_INFO(logger) << "disabled " << touch();
+    }
+    uint64_t logger_used = sylar::GetCurrentUS() - begin;
+    SYLAR_ASSERT(s_evaluated == 0);
+
+    auto ns = [count](uint64_t us) { return count ? us * 1000.0 / count : 0; };
+    SYLAR_LOG_INFO(g_logger) << "bench disabled count=" << count
+        << " site=" << ns(site_used) << "ns/op"
+        << " SYLAR_LOG_NAME=" << ns(name_used) << "ns/op"
+        << " logger=" << ns(logger_used) << "ns/op";
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    test_min_level();
+    test_site();
+    bench(argc > 1 ? atoi(argv[1]) : 10000000);
+    return 0;
+}
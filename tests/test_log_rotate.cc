@@ -0,0 +1,295 @@
+#include "log.h"
+#include "config.h"
+#include "thread.h"
+#include "macro.h"
+#include "util.h"
+#include <yaml-cpp/yaml.h>
+#include <algorithm>
+#include <fstream>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <zlib.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const std::string s_dir = "/tmp/test_log_rotate";
+
+// 文件名中的切分时间和序号
+static std::pair<std::string, int> rotated_key(const std::string& file, size_t prefix) {
+    std::string rest = file.substr(prefix);
+    if (rest.size() > 3 && rest.compare(rest.size() - 3, 3, ".gz") == 0) {
+        rest.resize(rest.size() - 3);
+    }
+    return std::make_pair(rest.substr(0, 15), rest.size() > 16 ? atoi(rest.c_str() + 16) : 0);
+}
+
+// 切分出的文件，按切分的先后排序
+static std::vector<std::string> list_rotated(const std::string& name) {
+    std::vector<std::string> files;
+    DIR* dp = opendir(s_dir.c_str());
+    SYLAR_ASSERT(dp);
+    struct dirent* dirp = nullptr;
+    while ((dirp = readdir(dp)) != nullptr) {
+        std::string file = dirp->d_name;
+        if (file.size() > name.size() + 1 && file.compare(0, name.size() + 1, name + ".") == 0) {
+            files.push_back(s_dir + "/" + file);
+        }
+    }
+    closedir(dp);
+    size_t prefix = s_dir.size() + name.size() + 2;
+    std::sort(files.begin(), files.end(), [prefix](const std::string& a, const std::string& b) {
+        return rotated_key(a, prefix) < rotated_key(b, prefix);
+    });
+    return files;
+}
+
+static void clean_dir() {
+    DIR* dp = opendir(s_dir.c_str());
+    if (dp) {
+        struct dirent* dirp = nullptr;
+        while ((dirp = readdir(dp)) != nullptr) {
+            if (dirp->d_name[0] != '.') {
+                unlink((s_dir + "/" + dirp->d_name).c_str());
+            }
+        }
+        closedir(dp);
+    }
+    mkdir(s_dir.c_str(), 0755);
+}
+
+// .gz结尾的文件解压后读出
+static std::string read_file(const std::string& name) {
+    std::string data;
+    gzFile in = gzopen(name.c_str(), "rb");
+    SYLAR_ASSERT(in);
+    char buf[4096];
+    int n = 0;
+    while ((n = gzread(in, buf, sizeof(buf))) > 0) {
+        data.append(buf, n);
+    }
+    gzclose(in);
+    return data;
+}
+
+static std::vector<std::string> split_lines(const std::string& data) {
+    std::vector<std::string> lines;
+    std::stringstream ss(data);
+    std::string line;
+    while (std::getline(ss, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// 按切分的先后读出所有文件，最后是当前文件
+static std::vector<std::string> read_all(const std::string& name) {
+    std::vector<std::string> lines;
+    for (auto& file : list_rotated(name)) {
+        auto v = split_lines(read_file(file));
+        lines.insert(lines.end(), v.begin(), v.end());
+    }
+    auto v = split_lines(read_file(s_dir + "/" + name));
+    lines.insert(lines.end(), v.begin(), v.end());
+    return lines;
+}
+
+// 按大小切分，同步和异步写入时切分前后的日志都不丢失且有序，压缩后可以解压读出
+void test_size(bool async, bool compress) {
+    clean_dir();
+    const std::string name = "size.log";
+    sylar::Logger::ptr logger(new sylar::Logger("rotate_size"));
+    sylar::FileLogAppender::ptr appender = std::make_shared<sylar::FileLogAppender>(s_dir + "/" + name);
+    appender->setFormatter("%m%n");
+    sylar::FileLogAppender::RotateOption option;
+    option.max_size = 16 * 1024;
+    option.compress = compress;
+    appender->setRotate(option);
+    logger->addAppender(appender);
+    appender->setAsync(async);
+
+    const size_t count = 20000;
+    for (size_t i = 0; i < count; ++i) {
+        SYLAR_LOG_INFO(logger) << "line " << i;
+        if (async && i % 2000 == 0) {
+            sylar::LogAppender::FlushAsync();
+        }
+    }
+    sylar::LogAppender::FlushAsync();
+    sylar::FileLogAppender::WaitRotate();
+
+    std::vector<std::string> rotated = list_rotated(name);
+    // 异步时后台线程按批写入，每批写完后判断是否切分
+    SYLAR_ASSERT2(rotated.size() > 5, std::to_string(rotated.size()));
+    for (auto& file : rotated) {
+        bool gz = file.size() > 3 && file.compare(file.size() - 3, 3, ".gz") == 0;
+        SYLAR_ASSERT2(gz == compress, file);
+    }
+    std::vector<std::string> lines = read_all(name);
+    SYLAR_ASSERT2(lines.size() == count, std::to_string(lines.size()));
+    for (size_t i = 0; i < count; ++i) {
+        SYLAR_ASSERT(lines[i] == "line " + std::to_string(i));
+    }
+    appender->setAsync(false);
+    SYLAR_LOG_INFO(g_logger) << "test_size async=" << async << " compress=" << compress
+        << " ok rotated=" << rotated.size();
+}
+
+// 只保留最近的max_files个文件
+void test_max_files() {
+    clean_dir();
+    const std::string name = "max_files.log";
+    sylar::Logger::ptr logger(new sylar::Logger("rotate_max_files"));
+    sylar::FileLogAppender::ptr appender = std::make_shared<sylar::FileLogAppender>(s_dir + "/" + name);
+    appender->setFormatter("%m%n");
+    sylar::FileLogAppender::RotateOption option;
+    option.max_size = 4096;
+    option.max_files = 3;
+    appender->setRotate(option);
+    logger->addAppender(appender);
+    for (size_t round = 0; round < 10; ++round) {
+        for (size_t i = 0; i < 500; ++i) {
+            SYLAR_LOG_INFO(logger) << round << " " << i;
+        }
+        sylar::FileLogAppender::WaitRotate();
+    }
+    std::vector<std::string> rotated = list_rotated(name);
+    SYLAR_ASSERT2(rotated.size() == 3, std::to_string(rotated.size()));
+    // 保留的是最后切分的文件
+    std::vector<std::string> lines = read_all(name);
+    SYLAR_ASSERT(!lines.empty() && lines.back() == "9 499");
+    SYLAR_LOG_INFO(g_logger) << "test_max_files ok";
+}
+
+// 按时间切分，下一个切分时间按interval对齐
+void test_interval() {
+    clean_dir();
+    const std::string name = "interval.log";
+    sylar::Logger::ptr logger(new sylar::Logger("rotate_interval"));
+    sylar::FileLogAppender::ptr appender = std::make_shared<sylar::FileLogAppender>(s_dir + "/" + name);
+    appender->setFormatter("%m%n");
+    sylar::FileLogAppender::RotateOption option;
+    option.interval = 1;
+    appender->setRotate(option);
+    logger->addAppender(appender);
+    size_t count = 0;
+    uint64_t end = sylar::GetCurrentMS() + 3500;
+    while (sylar::GetCurrentMS() < end) {
+        SYLAR_LOG_INFO(logger) << "line " << count++;
+        usleep(10 * 1000);
+    }
+    sylar::FileLogAppender::WaitRotate();
+    std::vector<std::string> rotated = list_rotated(name);
+    SYLAR_ASSERT2(rotated.size() >= 3 && rotated.size() <= 4, std::to_string(rotated.size()));
+    SYLAR_ASSERT(read_all(name).size() == count);
+    SYLAR_LOG_INFO(g_logger) << "test_interval ok rotated=" << rotated.size();
+}
+
+// 通过logs配置切分
+void test_config() {
+    clean_dir();
+    YAML::Node root = YAML::Load(
+        "logs:\n"
+        "  - name: rotate_config\n"
+        "    level: info\n"
+        "    appenders:\n"
+        "      - type: FileLogAppender\n"
+        "        file: " + s_dir + "/config.log\n"
+        "        formatter: \"%m%n\"\n"
+        "        max_size: 8k\n"
+        "        rotate_interval: 1d\n"
+        "        max_files: 2\n"
+        "        compress: true\n");
+    sylar::Config::LoadFromYaml(root);
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME("rotate_config");
+    for (int round = 0; round < 5; ++round) {
+        for (int i = 0; i < 1000; ++i) {
+            SYLAR_LOG_INFO(logger) << "config " << round << " " << i;
+        }
+        sylar::FileLogAppender::WaitRotate();
+    }
+    std::vector<std::string> rotated = list_rotated("config.log");
+    SYLAR_ASSERT2(rotated.size() == 2, std::to_string(rotated.size()));
+    for (auto& file : rotated) {
+        SYLAR_ASSERT(file.compare(file.size() - 3, 3, ".gz") == 0);
+    }
+    SYLAR_LOG_INFO(g_logger) << "test_config ok";
+}
+
+// 新文件打不开时(文件描述符用完)改回原来的名字，继续写入的日志不会被压缩或删除
+void test_open_failure() {
+    clean_dir();
+    const std::string name = "open_failure.log";
+    sylar::Logger::ptr logger(new sylar::Logger("rotate_open_failure"));
+    sylar::FileLogAppender::ptr appender = std::make_shared<sylar::FileLogAppender>(s_dir + "/" + name);
+    appender->setFormatter("%m%n");
+    sylar::FileLogAppender::RotateOption option;
+    option.max_files = 1;
+    option.compress = true;
+    appender->setRotate(option);
+    logger->addAppender(appender);
+    SYLAR_LOG_INFO(logger) << "before";
+
+    std::vector<int> fds;
+    while (true) {
+        int fd = open("/dev/null", O_RDONLY);
+        if (fd < 0) {
+            break;
+        }
+        fds.push_back(fd);
+    }
+    appender->rotate();
+    sylar::FileLogAppender::WaitRotate();
+    for (int fd : fds) {
+        close(fd);
+    }
+    SYLAR_LOG_INFO(logger) << "after";
+
+    SYLAR_ASSERT(list_rotated(name).empty());
+    std::vector<std::string> lines = read_all(name);
+    SYLAR_ASSERT(lines.size() == 2 && lines[0] == "before" && lines[1] == "after");
+    SYLAR_LOG_INFO(g_logger) << "test_open_failure ok";
+}
+
+// 切分(包括压缩)时写日志的线程不等待，统计单条日志的最大耗时
+void bench(size_t count) {
+    clean_dir();
+    const std::string name = "bench.log";
+    sylar::Logger::ptr logger(new sylar::Logger("rotate_bench"));
+    sylar::FileLogAppender::ptr appender = std::make_shared<sylar::FileLogAppender>(s_dir + "/" + name);
+    sylar::FileLogAppender::RotateOption option;
+    option.max_size = 8 * 1024 * 1024;
+    option.max_files = 2;
+    option.compress = true;
+    appender->setRotate(option);
+    logger->addAppender(appender);
+
+    uint64_t max_us = 0;
+    uint64_t begin = sylar::GetCurrentUS();
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t t = sylar::GetCurrentUS();
+        SYLAR_LOG_INFO(logger) << "bench rotate log line " << i;
+        max_us = std::max(max_us, sylar::GetCurrentUS() - t);
+    }
+    uint64_t used = sylar::GetCurrentUS() - begin;
+    sylar::FileLogAppender::WaitRotate();
+    clean_dir();
+    SYLAR_LOG_INFO(g_logger) << "bench count=" << count << " used=" << used << "us ns/op="
+        << (count ? used * 1000 / count : 0) << " max=" << max_us << "us";
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    test_size(false, false);
+    test_size(true, false);
+    test_size(false, true);
+    test_size(true, true);
+    test_max_files();
+    test_interval();
+    test_config();
+    test_open_failure();
+    bench(argc > 1 ? atoi(argv[1]) : 500000);
+    return 0;
+}
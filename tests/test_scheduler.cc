@@ -1,6 +1,8 @@
 #include "scheduler.h"
 #include "log.h"
 #include <memory>
+#include <atomic>
+#include <thread>
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
@@ -15,7 +17,51 @@ void test_fiber() {
     }
 }
 
-int main() {
+// 扩展性测试: 主线程提交s_bench_roots个任务，每个任务在工作线程中再提交s_bench_children个子任务
+static const int s_bench_roots = 1000;
+static const int s_bench_children = 100;
+static std::atomic<uint64_t> s_bench_done(0);
+
+void bench_child() {
+    ++s_bench_done;
+}
+
+void bench_root() {
+    sylar::Scheduler* sc = sylar::Scheduler::GetThisScheduler();
+    for (int i = 0; i < s_bench_children; ++i) {
+        sc->schedule(&bench_child);
+    }
+    ++s_bench_done;
+}
+
+void bench_scheduler(size_t max_threads) {
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+    for (size_t n = 1; n <= max_threads; ++n) {
+        s_bench_done = 0;
+        uint64_t begin = sylar::GetCurrentMS();
+        {
+            sylar::Scheduler sc(n, false, "bench");
+            sc.start();
+            for (int i = 0; i < s_bench_roots; ++i) {
+                sc.schedule(&bench_root);
+            }
+            sc.stop();
+        }
+        uint64_t used = sylar::GetCurrentMS() - begin;
+        SYLAR_LOG_INFO(g_logger) << "bench_scheduler threads=" << n
+            << " tasks=" << s_bench_done
+            << " used=" << used << "ms"
+            << " tasks/s=" << (used ? s_bench_done * 1000 / used : 0);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        size_t max_threads = argc > 2 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+        bench_scheduler(max_threads ? max_threads : 1);
+        return 0;
+    }
 
     // sylar::Thread::SetName("main");
 
@@ -0,0 +1,114 @@
+#include "timer.h"
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+#include <unistd.h>
+#include <stdlib.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+class TestTimerManager : public sylar::TimerManager
+{
+protected:
+    void onTimerInsertedAtFront() override {}
+};
+
+static void set_wheel(bool wheel) {
+    sylar::Config::Lookup<bool>("timer.wheel")->setValue(wheel);
+}
+
+// 到期时间准确、取消的定时器不执行、循环定时器重复执行
+void test_expire(bool wheel) {
+    set_wheel(wheel);
+    TestTimerManager mgr;
+    SYLAR_ASSERT(mgr.isWheel() == wheel);
+
+    const int N = 1000;
+    uint64_t start = sylar::GetCurrentMS();
+    std::vector<uint64_t> expect(N);
+    std::vector<uint64_t> fired(N, 0);
+    std::vector<sylar::Timer::ptr> timers(N);
+    srand(1);
+    for (int i = 0; i < N; ++i) {
+        uint64_t ms = rand() % 600;
+        expect[i] = start + ms;
+        timers[i] = mgr.addTimer(ms, [i, &fired]() {
+            fired[i] = sylar::GetCurrentMS();
+        });
+    }
+    for (int i = 0; i < N; i += 10) {
+        SYLAR_ASSERT(timers[i]->cancel());
+    }
+    int recurring = 0;
+    sylar::Timer::ptr rt = mgr.addTimer(50, [&recurring]() { ++recurring; }, true);
+    // 很远的定时器不会提前执行
+    bool far_fired = false;
+    mgr.addTimer(3600 * 1000, [&far_fired]() { far_fired = true; });
+    mgr.addTimer(100ull * 24 * 3600 * 1000, [&far_fired]() { far_fired = true; });
+
+    while (sylar::GetCurrentMS() < start + 700) {
+        uint64_t next = mgr.getNextTimer();
+        SYLAR_ASSERT(next != ~0ull);
+        usleep(std::min<uint64_t>(next, 5) * 1000);
+        std::vector<std::function<void()>> cbs;
+        mgr.listExpiredCb(cbs);
+        for (auto& cb : cbs) {
+            cb();
+        }
+    }
+    rt->cancel();
+    for (int i = 0; i < N; ++i) {
+        if (i % 10 == 0) {
+            SYLAR_ASSERT(fired[i] == 0);
+        } else {
+            SYLAR_ASSERT2(fired[i] >= expect[i] && fired[i] <= expect[i] + 50,
+                "i=" + std::to_string(i) + " expect=" + std::to_string(expect[i])
+                + " fired=" + std::to_string(fired[i]));
+        }
+    }
+    SYLAR_ASSERT(recurring >= 10);
+    SYLAR_ASSERT(!far_fired);
+    SYLAR_LOG_INFO(g_logger) << "test_expire wheel=" << wheel << " recurring=" << recurring;
+}
+
+// 模拟大量连接的读写超时: 后台有live个定时器，每次IO添加一个定时器再取消
+void bench_churn(bool wheel, size_t live, size_t ops) {
+    set_wheel(wheel);
+    TestTimerManager mgr;
+    std::vector<sylar::Timer::ptr> background;
+    background.reserve(live);
+    srand(1);
+    uint64_t begin = sylar::GetCurrentMS();
+    for (size_t i = 0; i < live; ++i) {
+        background.push_back(mgr.addTimer(1000 + rand() % 60000, []() {}));
+    }
+    uint64_t used_add = sylar::GetCurrentMS() - begin;
+    begin = sylar::GetCurrentMS();
+    for (size_t i = 0; i < ops; ++i) {
+        sylar::Timer::ptr timer = mgr.addTimer(5000, []() {});
+        timer->cancel();
+    }
+    uint64_t used_churn = sylar::GetCurrentMS() - begin;
+    begin = sylar::GetCurrentMS();
+    for (auto& timer : background) {
+        timer->cancel();
+    }
+    uint64_t used_cancel = sylar::GetCurrentMS() - begin;
+    SYLAR_LOG_INFO(g_logger) << "bench_churn " << (wheel ? "wheel" : "set")
+        << " live=" << live << " add=" << used_add << "ms"
+        << " add+cancel(" << ops << ")=" << used_churn << "ms ops/s="
+        << (used_churn ? ops * 1000 / used_churn : 0)
+        << " cancel=" << used_cancel << "ms";
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(sylar::LogLevel::INFO);
+    test_expire(false);
+    test_expire(true);
+    size_t live = argc > 1 ? atoi(argv[1]) : 100000;
+    size_t ops = argc > 2 ? atoi(argv[2]) : 1000000;
+    bench_churn(false, live, ops);
+    bench_churn(true, live, ops);
+    return 0;
+}